@@ -15,9 +15,9 @@
 #include<unordered_map>
 
 #define MINEUTILS_MAJOR_VERSION "1"   //主版本号，对应不向下兼容的API或文件改动
-#define MINEUTILS_MINOR_VERSION "16"   //次版本号，对应不影响现有API使用的新功能增加
-#define MINEUTILS_PATCH_VERSION "1"   //修订版本号，对应不改变API的BUG修复或效能优化
-#define MINEUTILS_DATE_VERSION "20241231-release"   //日期版本号，对应文档和注释级别的改动和测试阶段
+#define MINEUTILS_MINOR_VERSION "17"   //次版本号，对应不影响现有API使用的新功能增加
+#define MINEUTILS_PATCH_VERSION "0"   //修订版本号，对应不改变API的BUG修复或效能优化
+#define MINEUTILS_DATE_VERSION "20261017-release"   //日期版本号，对应文档和注释级别的改动和测试阶段
 #ifdef __GNUC__ 
 #include<cxxabi.h>
 #endif
@@ -42,8 +42,10 @@
 //在不支持thread_local的编译器中，仅相当于普通变量，没有线程内只有一份实例的作用
 #if defined(__GNUC__) && (__GNUC__ < 5 && __GNUC_MINOR__ < 8)  //for qnx660
 #define MINE_THREAD_LOCAL_IF_HAVE
+#define MINE_HAVE_THREAD_LOCAL 0
 #else 
 #define MINE_THREAD_LOCAL_IF_HAVE thread_local   
+#define MINE_HAVE_THREAD_LOCAL 1
 #endif 
 
 //命名空间::类名::函数名格式的const char*字符串
@@ -4,27 +4,85 @@
 #ifndef THREAD_HPP_MINEUTILS
 #define THREAD_HPP_MINEUTILS
 
+#include<algorithm>
 #include<atomic>
 #include<condition_variable>
+#include<deque>
 #include<functional>
 #include<future>
+#include<iterator>
+#include<limits>
+#include<memory>
 #include<mutex>
-#include<queue>
 #include<stdexcept>
+#include<string>
 #include<thread>
+#include<type_traits>
 #include<vector>
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include<intrin.h>
+#endif
+#if defined(__linux__) && !defined(__ANDROID__)
+#include<pthread.h>
+#include<sched.h>
+#endif
+#if defined(__linux__)
+#include<linux/futex.h>
+#include<sys/syscall.h>
+#include<unistd.h>
+#endif
 
 #include"base.hpp"
 #include"time.hpp"
 #include"log.hpp"
 
+//CPU缓存行大小(字节)，用于隔离被不同线程频繁写入的数据，避免伪共享
+#ifndef MINE_CACHE_LINE_SIZE
+#define MINE_CACHE_LINE_SIZE 64
+#endif
+
+//SchedulePolicy::LockFreeQueue策略下ThreadPool任务队列的容量
+#ifndef MINE_LOCKFREE_TASK_QUEUE_CAPACITY
+#define MINE_LOCKFREE_TASK_QUEUE_CAPACITY 1024
+#endif
+
+//ScalableReadWriteMutex和Snapshot的读者计数槽以及ObjectPool的线程空闲链表数量，各线程按首次使用的顺序轮流分配到不同的槽
+#ifndef MINE_RWLOCK_READER_SLOTS
+#define MINE_RWLOCK_READER_SLOTS 16
+#endif
+
+//ThreadPool::resize允许的最大线程数，构造时指定的线程数更大时以构造时为准
+#ifndef MINE_THREADPOOL_MAX_SIZE
+#define MINE_THREADPOOL_MAX_SIZE 256
+#endif
+
+//ThreadPool任务的内联储存大小(字节)，绑定后不超过该大小且可无异常移动的任务不会产生堆内存分配
+#ifndef MINE_TASK_INLINE_SIZE
+#define MINE_TASK_INLINE_SIZE 64
+#endif
+
 namespace mineutils
 {
     /*--------------------------------------------用户接口--------------------------------------------*/
 
     namespace mthread
     {
-        //简易自旋锁，适用于临界区操作非常少的情况，线程安全
+        class ThreadPool;
+        class _InlineTask;
+        class _TaskRing;
+        class _PriorityTaskQueue;
+        class _WorkerStats;
+        template<class Ret>
+        class _TaskResult;
+        template<class Ret, class FnT>
+        struct _ThenReturn;
+        class _PipelineStageBase;
+        template<class T>
+        class _PipelineQueue;
+
+        /*  简易自旋锁，适用于临界区操作非常少的情况，线程安全
+            等待时只读取锁状态，并按指数增长的间隔暂停CPU，超过自旋上限后改为让出时间片，避免线程数多于CPU核数时长期占用持锁线程的时间片
+            不保证公平，需要按申请顺序获得锁时使用TicketSpinLock  */
         class SpinLock
         {
         private:
@@ -34,6 +92,9 @@ namespace mineutils
             SpinLock() = default;
 
             void lock();
+
+            //尝试加锁，不等待；成功返回true
+            bool tryLock();
             void unlock();
 
             /*  使用RAII方式对局部区域加锁
@@ -47,7 +108,156 @@ namespace mineutils
             SpinLock& operator=(SpinLock&& tmp_lock) = delete;
 
         private:
-            std::atomic_flag lock_flag_ = ATOMIC_FLAG_INIT;
+            std::atomic<bool> locked_{ false };
+        };
+
+        /*  排队自旋锁，按申请加锁的顺序获得锁，线程安全
+            等待间隔与前面排队的线程数成正比，超过自旋上限后改为让出时间片
+            线程数多于CPU核数时，排在前面的线程未被调度会阻塞其后所有线程，此时吞吐量低于SpinLock  */
+        class TicketSpinLock
+        {
+        private:
+            class Guard;
+
+        public:
+            TicketSpinLock() = default;
+
+            void lock();
+
+            //尝试加锁，不等待；有线程持锁或排队时返回false
+            bool tryLock();
+            void unlock();
+
+            /*  使用RAII方式对局部区域加锁
+                - 用法：auto guard = ticket_lock.lockGuard();
+                @return 一个私有类Guard对象，只能用auto推导；构造时加锁，析构时解锁  */
+            TicketSpinLock::Guard lockGuard();
+
+            TicketSpinLock(const TicketSpinLock& tmp_lock) = delete;
+            TicketSpinLock(TicketSpinLock&& tmp_lock) = delete;
+            TicketSpinLock& operator=(const TicketSpinLock& tmp_lock) = delete;
+            TicketSpinLock& operator=(TicketSpinLock&& tmp_lock) = delete;
+
+        private:
+            char pad0_[MINE_CACHE_LINE_SIZE];
+            std::atomic<unsigned int> next_ticket_{ 0 };
+            char pad1_[MINE_CACHE_LINE_SIZE - sizeof(std::atomic<unsigned int>)];
+            std::atomic<unsigned int> serving_ticket_{ 0 };
+            char pad2_[MINE_CACHE_LINE_SIZE - sizeof(std::atomic<unsigned int>)];
+        };
+
+        /*  先自旋后休眠的互斥锁，线程安全
+            无竞争时加锁和解锁各只有一次原子操作；短暂自旋仍未获得锁时休眠等待，Linux上通过futex实现，其他平台通过条件变量实现
+            适用于临界区长短不定或线程数可能多于CPU核数的情况  */
+        class HybridMutex
+        {
+        private:
+            class Guard;
+
+        public:
+            HybridMutex() = default;
+
+            void lock();
+
+            //尝试加锁，不等待；成功返回true
+            bool tryLock();
+            void unlock();
+
+            /*  使用RAII方式对局部区域加锁
+                - 用法：auto guard = hybrid_mtx.lockGuard();
+                @return 一个私有类Guard对象，只能用auto推导；构造时加锁，析构时解锁  */
+            HybridMutex::Guard lockGuard();
+
+            HybridMutex(const HybridMutex& tmp_lock) = delete;
+            HybridMutex(HybridMutex&& tmp_lock) = delete;
+            HybridMutex& operator=(const HybridMutex& tmp_lock) = delete;
+            HybridMutex& operator=(HybridMutex&& tmp_lock) = delete;
+
+        private:
+            //0表示未加锁，1表示已加锁且无等待者，2表示已加锁且可能有线程休眠等待
+            std::atomic<int> state_{ 0 };
+        };
+
+        //队列已满时新元素的处理方式
+        enum class OverflowPolicy
+        {
+            Reject = 0,   //拒绝新元素，push返回false
+            OverwriteOldest = 1   //丢弃最旧的元素以容纳新元素，适用于只关心最新数据的场景，如实时视频帧
+        };
+
+        /*  单生产者单消费者的无等待通道，只允许一个线程push、一个线程pop
+            读写位置各自独占缓存行，元素可以是只能移动的类型；T的移动构造和移动赋值不应抛出异常
+            OverwriteOldest模式下，若生产者追上消费者正在取出的元素，会等待这一次移动完成  */
+        template<class T>
+        class SPSCChannel
+        {
+        public:
+            /*  构造SPSCChannel对象
+                @param capacity: 通道容量，不小于1
+                @param policy: 通道已满时新元素的处理方式  */
+            explicit SPSCChannel(size_t capacity, mthread::OverflowPolicy policy = mthread::OverflowPolicy::Reject);
+
+            /*  放入一个元素，仅限生产者线程调用
+                @return Reject模式下通道已满时返回false，此时value不会被移动；OverwriteOldest模式下总是返回true  */
+            bool tryPush(const T& value);
+            bool tryPush(T&& value);
+
+            /*  批量放入元素，仅限生产者线程调用，元素会从values中移出
+                @param values: 待放入的元素数组
+                @param num: 元素数量
+                @return 实际放入的元素数量，Reject模式下可能小于num  */
+            size_t pushN(T* values, size_t num);
+
+            /*  取出一个元素，仅限消费者线程调用
+                @return 通道为空时返回false  */
+            bool tryPop(T& value);
+
+            /*  批量取出元素，仅限消费者线程调用
+                @param values: 接收元素的数组，长度不小于num
+                @param num: 最多取出的元素数量
+                @return 实际取出的元素数量  */
+            size_t popN(T* values, size_t num);
+
+            //获取当前元素数量，并发修改时仅为近似值
+            size_t size() const;
+            bool empty() const;
+            size_t capacity() const;
+
+            //获取OverwriteOldest模式下被丢弃的元素总数
+            unsigned long long droppedCount() const;
+
+            SPSCChannel(const SPSCChannel& tmp) = delete;
+            SPSCChannel& operator=(const SPSCChannel& tmp) = delete;
+            SPSCChannel(SPSCChannel&& tmp) = delete;
+            SPSCChannel& operator=(SPSCChannel&& tmp) = delete;
+            ~SPSCChannel();
+
+        private:
+            using Storage = typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type;
+
+            T* slotAt(size_t pos);
+            template<class U>
+            bool pushImpl(U&& value);
+            bool makeRoom(size_t tail);
+
+            char pad0_[MINE_CACHE_LINE_SIZE];
+            std::atomic<size_t> head_;   //消费者的读取位置
+            std::atomic<size_t> reading_pos_;   //OverwriteOldest模式下消费者正在取出的位置加1，为0表示没有正在取出的元素
+            char pad1_[MINE_CACHE_LINE_SIZE - 2 * sizeof(std::atomic<size_t>)];
+            std::atomic<size_t> tail_;   //生产者的写入位置
+            std::atomic<unsigned long long> num_dropped_;
+            char pad2_[MINE_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(std::atomic<unsigned long long>)];
+            std::unique_ptr<Storage[]> slots_;
+            size_t mask_;
+            size_t capacity_;
+            mthread::OverflowPolicy policy_;
+        };
+
+        //读写锁的优先策略
+        enum class LockPreference
+        {
+            PreferReader = 0,   //只要没有线程持有写锁，新的读者即可加锁；读者持续不断时写者可能一直等待
+            PreferWriter = 1   //有写者等待时，新的读者需等待写者完成，避免写者饥饿
         };
 
         //基于mutex实现的读写锁，线程安全
@@ -58,9 +268,24 @@ namespace mineutils
             class WGuard;
 
         public:
-            ReadWriteMutex() = default;
+            /*  构造ReadWriteMutex对象
+                @param preference: 读写优先策略，默认读者优先  */
+            explicit ReadWriteMutex(mthread::LockPreference preference = mthread::LockPreference::PreferReader);
 
             void lockRead();
+
+            //尝试加读锁，不等待；成功返回true
+            bool tryLockRead();
+
+            /*  尝试加读锁，最多等待timeout时长
+                @param timeout: 最长等待时间，如std::chrono::milliseconds(5)
+                @return 成功返回true，超时返回false  */
+            bool tryLockReadFor(const mtime::Duration& timeout);
+
+            /*  尝试加读锁，最多等待到deadline时刻
+                @param deadline: 等待截止时刻
+                @return 成功返回true，超时返回false  */
+            bool tryLockReadUntil(const mtime::TimePoint& deadline);
             void unlockRead();
 
             /*  使用RAII方式对局部区域加读锁
@@ -69,6 +294,19 @@ namespace mineutils
             ReadWriteMutex::RGuard lockReadGuard();
 
             void lockWrite();
+
+            //尝试加写锁，不等待；成功返回true
+            bool tryLockWrite();
+
+            /*  尝试加写锁，最多等待timeout时长
+                @param timeout: 最长等待时间，如std::chrono::milliseconds(5)
+                @return 成功返回true，超时返回false  */
+            bool tryLockWriteFor(const mtime::Duration& timeout);
+
+            /*  尝试加写锁，最多等待到deadline时刻
+                @param deadline: 等待截止时刻
+                @return 成功返回true，超时返回false  */
+            bool tryLockWriteUntil(const mtime::TimePoint& deadline);
             void unlockWrite();
 
             /*  使用RAII方式对局部区域加写锁
@@ -82,12 +320,305 @@ namespace mineutils
             ReadWriteMutex& operator=(ReadWriteMutex&& tmp_lock) = delete;
 
         private:
+            bool canRead() const;
+
             std::mutex mtx_;
-            std::condition_variable cv_;
+            std::condition_variable read_cond_;
+            std::condition_variable write_cond_;
             unsigned int num_readers_ = 0;
+            unsigned int num_waiting_writers_ = 0;
             bool is_writing_ = false;
+            mthread::LockPreference preference_;
+        };
+
+        /*  读者可扩展的读写锁，写者优先，线程安全
+            读者只修改本线程对应的独占缓存行的计数槽，多核并发读时不会争用同一缓存行；写者需要检查所有计数槽，开销比ReadWriteMutex大
+            适用于读远多于写的场景；同一线程不能重复加读锁，否则在有写者等待时会死锁
+            lockRead系列与unlockRead必须在同一线程调用，两者按调用线程定位计数槽；需要跨线程释放时使用lockReadGuard，RGuard记录加锁时的计数槽  */
+        class ScalableReadWriteMutex
+        {
+        private:
+            class RGuard;
+            class WGuard;
+
+        public:
+            ScalableReadWriteMutex() = default;
+
+            void lockRead();
+
+            //尝试加读锁，不等待；成功返回true
+            bool tryLockRead();
+
+            /*  尝试加读锁，最多等待timeout时长
+                @param timeout: 最长等待时间，如std::chrono::milliseconds(5)
+                @return 成功返回true，超时返回false  */
+            bool tryLockReadFor(const mtime::Duration& timeout);
+
+            /*  尝试加读锁，最多等待到deadline时刻
+                @param deadline: 等待截止时刻
+                @return 成功返回true，超时返回false  */
+            bool tryLockReadUntil(const mtime::TimePoint& deadline);
+            void unlockRead();
+
+            /*  使用RAII方式对局部区域加读锁
+                - 用法：auto guard = rw_lock.lockReadGuard();
+                @return 一个私有类RGuard对象，只能用auto推导；构造时加锁，析构时解锁  */
+            ScalableReadWriteMutex::RGuard lockReadGuard();
+
+            void lockWrite();
+
+            //尝试加写锁，不等待；成功返回true
+            bool tryLockWrite();
+
+            /*  尝试加写锁，最多等待timeout时长
+                @param timeout: 最长等待时间，如std::chrono::milliseconds(5)
+                @return 成功返回true，超时返回false  */
+            bool tryLockWriteFor(const mtime::Duration& timeout);
+
+            /*  尝试加写锁，最多等待到deadline时刻
+                @param deadline: 等待截止时刻
+                @return 成功返回true，超时返回false  */
+            bool tryLockWriteUntil(const mtime::TimePoint& deadline);
+            void unlockWrite();
+
+            /*  使用RAII方式对局部区域加写锁
+                - 用法：auto guard = rw_lock.lockWriteGuard();
+                @return 一个私有类WGuard对象，只能用auto推导；构造时加锁，析构时解锁  */
+            ScalableReadWriteMutex::WGuard lockWriteGuard();
+
+            ScalableReadWriteMutex(const ScalableReadWriteMutex& tmp_lock) = delete;
+            ScalableReadWriteMutex(ScalableReadWriteMutex&& tmp_lock) = delete;
+            ScalableReadWriteMutex& operator=(const ScalableReadWriteMutex& tmp_lock) = delete;
+            ScalableReadWriteMutex& operator=(ScalableReadWriteMutex&& tmp_lock) = delete;
+
+        private:
+            struct ReaderSlot
+            {
+                std::atomic<int> num_readers{ 0 };
+                char pad_[MINE_CACHE_LINE_SIZE - sizeof(std::atomic<int>)];
+            };
+
+            bool tryEnterRead(std::atomic<int>& num_readers);
+            void enterRead(std::atomic<int>& num_readers);
+            bool waitWriterFree(const mtime::TimePoint* deadline);
+            bool acquireWriterFlag(const mtime::TimePoint* deadline);
+
+            char pad0_[MINE_CACHE_LINE_SIZE];
+            //0表示没有写者，1表示有写者持锁或正在等待读者退出，2表示有写者且可能有线程休眠等待
+            std::atomic<int> writer_state_{ 0 };
+            char pad1_[MINE_CACHE_LINE_SIZE - sizeof(std::atomic<int>)];
+            ReaderSlot reader_slots_[MINE_RWLOCK_READER_SLOTS];
+        };
+
+        /*  读多写少数据的版本快照容器，线程安全，适用于每帧读取、很少更新的配置等数据
+            读者获得当前版本的只读视图，不加锁，只写入本线程对应的独占缓存行的计数槽；写者发布新版本后等待仍在读取旧版本的读者退出，再释放旧版本
+            写者之间互斥；读取期间不能在同一线程内写入同一个Snapshot，否则会死锁  */
+        template<class T>
+        class Snapshot
+        {
+        private:
+            class ReadGuard;
+
+        public:
+            //构造Snapshot对象，初始版本为T的默认值
+            Snapshot();
+
+            /*  构造Snapshot对象
+                @param value: 初始版本的值  */
+            explicit Snapshot(T value);
+
+            /*  获取当前版本的只读视图，视图存在期间该版本不会被释放
+                - 用法：auto view = snapshot.read(); view->xxx;
+                @return 一个私有类ReadGuard对象，只能用auto推导；可通过*和->访问const T，通过getVersion()获取版本号  */
+            Snapshot::ReadGuard read() const;
+
+            //获取当前版本的拷贝
+            T load() const;
+
+            /*  发布新版本，返回前会等待仍在读取旧版本的读者退出并释放旧版本
+                @param value: 新版本的值  */
+            void store(T value);
+
+            /*  基于当前版本拷贝修改后发布新版本，多个写者同时调用时不会丢失修改
+                @param func: 可调用对象，形式为void(T&)，参数为当前版本的拷贝  */
+            template<class Fn>
+            void update(Fn&& func);
+
+            //获取当前版本号，初始版本为0，每次发布加1
+            unsigned long long getVersion() const;
+
+            Snapshot(const Snapshot& tmp) = delete;
+            Snapshot(Snapshot&& tmp) = delete;
+            Snapshot& operator=(const Snapshot& tmp) = delete;
+            Snapshot& operator=(Snapshot&& tmp) = delete;
+            ~Snapshot();
+
+        private:
+            struct Version
+            {
+                T value;
+                unsigned long long version;
+            };
+
+            //按读取开始时的纪元奇偶分两个计数，写者翻转纪元后旧纪元的计数只减不增
+            struct ReaderSlot
+            {
+                std::atomic<int> num_readers[2];
+                char pad_[MINE_CACHE_LINE_SIZE - 2 * sizeof(std::atomic<int>)];
+            };
+
+            void publish(Version* new_version);
+            void waitReaders(int epoch_parity);
+
+            std::atomic<Version*> current_;
+            std::atomic<unsigned int> epoch_;
+            std::mutex write_mtx_;
+            char pad0_[MINE_CACHE_LINE_SIZE];
+            mutable ReaderSlot reader_slots_[MINE_RWLOCK_READER_SLOTS];
+        };
+
+        /*  可复用对象池，线程安全，用于反复使用的大对象，如图像缓冲区和结果列表
+            对象只在池中没有空闲对象时创建，归还后不析构，保留已分配的内存供下次使用；池析构时才释放所有对象
+            每个线程优先使用本线程对应的空闲链表，其次是全局空闲链表，都是无锁的；所有空闲链表为空时才创建新对象
+            池必须在所有Handle销毁后再析构  */
+        template<class T>
+        class ObjectPool
+        {
+        private:
+            struct Node;
+            struct FreeList;
+
+        public:
+            //持有池中一个对象的句柄，只能移动，销毁或reset时将对象归还到池中
+            class Handle;
+
+            /*  构造ObjectPool对象
+                @param creator: 创建新对象的函数，形式为T()，为空时使用T的默认构造
+                @param recycler: 对象归还时调用的函数，形式为void(T&)，可用于清空内容；为空时不处理  */
+            explicit ObjectPool(std::function<T()> creator = nullptr, std::function<void(T&)> recycler = nullptr);
+
+            //从池中取出一个对象，没有空闲对象时创建新对象
+            ObjectPool::Handle acquire();
+
+            /*  预先创建对象并放入全局空闲链表，使已创建的对象总数不少于num；线程安全
+                @param num: 期望的对象总数  */
+            void prewarm(size_t num);
+
+            //获取已创建的对象总数
+            size_t getNumCreated() const;
+
+            ObjectPool(const ObjectPool& tmp) = delete;
+            ObjectPool(ObjectPool&& tmp) = delete;
+            ObjectPool& operator=(const ObjectPool& tmp) = delete;
+            ObjectPool& operator=(ObjectPool&& tmp) = delete;
+            ~ObjectPool();
+
+        private:
+            //每个线程的空闲链表最多缓存的对象数，超出的部分归还到全局空闲链表
+            static const int LOCAL_CACHE_SIZE = 32;
+            //第k块存放(FIRST_CHUNK_SIZE << k)个节点
+            static const unsigned int FIRST_CHUNK_SIZE = 16;
+            static const int MAX_NUM_CHUNKS = 26;
+
+            Node* getNode(unsigned int index) const;
+            Node* createNode();
+            void release(Node* node);
+
+            std::function<T()> creator_;
+            std::function<void(T&)> recycler_;
+            std::mutex grow_mtx_;
+            std::atomic<Node*> chunks_[MAX_NUM_CHUNKS];
+            std::atomic<unsigned int> num_created_;
+            std::unique_ptr<FreeList[]> free_lists_;   //前MINE_RWLOCK_READER_SLOTS个为各线程的空闲链表，最后一个为全局空闲链表
+        };
+
+
+        /*  固定容量的多生产者多消费者无锁环形队列，线程安全
+            读写位置各自独占缓存行；阻塞的push和pop会先短暂自旋，仍未成功再休眠等待
+            T的移动构造和移动赋值不应抛出异常  */
+        template<class T>
+        class MPMCQueue
+        {
+        public:
+            /*  构造MPMCQueue对象
+                @param capacity: 队列容量，会向上取整为2的幂，不小于2  */
+            explicit MPMCQueue(size_t capacity);
+
+            //尝试入队，队列已满时立即返回false，此时value不会被移动
+            bool tryPush(const T& value);
+            bool tryPush(T&& value);
+
+            //尝试出队，队列为空时立即返回false
+            bool tryPop(T& value);
+
+            //入队，队列已满时先自旋等待，仍未成功则休眠直到有空位
+            void push(const T& value);
+            void push(T&& value);
+
+            //出队，队列为空时先自旋等待，仍未成功则休眠直到有元素
+            void pop(T& value);
+
+            //获取当前元素数量，并发修改时仅为近似值
+            size_t size() const;
+            bool empty() const;
+            size_t capacity() const;
+
+            MPMCQueue(const MPMCQueue& tmp) = delete;
+            MPMCQueue& operator=(const MPMCQueue& tmp) = delete;
+            MPMCQueue(MPMCQueue&& tmp) = delete;
+            MPMCQueue& operator=(MPMCQueue&& tmp) = delete;
+            ~MPMCQueue();
+
+        private:
+            struct Cell;
+
+            template<class U>
+            bool tryPushImpl(U&& value);
+            template<class U>
+            void pushImpl(U&& value);
+            void notifyPopWaiter();
+            void notifyPushWaiter();
+
+            char pad0_[MINE_CACHE_LINE_SIZE];
+            std::atomic<size_t> enqueue_pos_;
+            char pad1_[MINE_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+            std::atomic<size_t> dequeue_pos_;
+            char pad2_[MINE_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+            std::unique_ptr<Cell[]> cells_;
+            size_t mask_;
+
+            std::mutex mtx_;
+            std::condition_variable not_empty_cond_;
+            std::condition_variable not_full_cond_;
+            std::atomic<int> num_pop_waiters_;
+            std::atomic<int> num_push_waiters_;
+        };
+
+
+        //任务在开始执行前被取消时，获取其结果会抛出的异常
+        class TaskCancelledError :public std::runtime_error
+        {
+        public:
+            TaskCancelledError() :std::runtime_error("Error: Task was cancelled before it started!") {}
         };
 
+        /*  任务取消令牌，拷贝得到的对象共享同一个取消状态；线程安全
+            - 用法：相机重连时调用token.cancel()，所有用该令牌添加且尚未开始执行的任务都会被跳过，之后换用新的令牌  */
+        class CancellationToken
+        {
+        public:
+            CancellationToken();
+
+            //取消所有使用该令牌且尚未开始执行的任务，已开始执行的任务不受影响
+            void cancel();
+
+            //判断是否已取消
+            bool isCancelled() const;
+
+        private:
+            std::shared_ptr<std::atomic<bool>> cancelled_;
+            friend class ThreadPool;
+        };
 
         //任务结果状态
         template<class Ret>
@@ -106,26 +637,199 @@ namespace mineutils
             bool finished();
             //等待任务结束，如果任务为无效状态会立即返回；线程安全
             void wait();
-            //等待并获取任务结果，如果任务为无效状态会抛出std::runtime_error异常；线程安全
+            //等待并获取任务结果，如果任务为无效状态会抛出std::runtime_error异常，任务被取消时抛出mthread::TaskCancelledError异常；线程安全
             Ret get();
 
+            /*  取消尚未开始执行的任务，任务会在出队时被跳过，等待者和后续任务立即得到mthread::TaskCancelledError异常；线程安全
+                @return 取消是否成功，任务已开始执行、已结束或状态不是由ThreadPool创建时返回false  */
+            bool cancel();
+
+            /*  任务结束后将func作为后续任务提交到创建本任务的ThreadPool中执行，不会阻塞当前线程；线程安全
+                - 用法：auto state2 = state1.then([](int ret) { return ret * 2; });
+                每个任务状态只能注册一次后续任务(包括被whenAll和whenAny使用)，且只支持由ThreadPool创建的任务状态，否则抛出std::runtime_error异常
+                @param func: 后续任务函数，Ret为void时无参数，否则以本任务的返回值为参数；本任务抛出异常时不会调用func，返回的任务状态会得到同一个异常
+                @return 后续任务的结果状态   */
+            template<class Fn, class NewRet = typename mthread::_ThenReturn<Ret, typename std::decay<Fn>::type>::type>
+            TaskRetState<NewRet> then(Fn&& func);
+
             TaskRetState(const TaskRetState<Ret>& future_state) = delete;    //不支持拷贝构造
             TaskRetState& operator=(const TaskRetState<Ret>& future_state) = delete;   //不支持拷贝赋值
+            ~TaskRetState();
         private:
+            explicit TaskRetState(mthread::_TaskResult<Ret>* task_result) noexcept;
+
             std::shared_future<Ret> future_state_;
+            mthread::_TaskResult<Ret>* task_result_ = nullptr;   //由ThreadPool创建时使用的池化结果状态
+            friend class ThreadPool;
+            template<class OtherRet>
+            friend class TaskRetState;
+            template<class InRet>
+            friend TaskRetState<void> whenAll(std::vector<TaskRetState<InRet>>& states);
+            template<class InRet>
+            friend TaskRetState<int> whenAny(std::vector<TaskRetState<InRet>>& states);
+            template<class InRet>
+            friend mthread::ThreadPool* _getWhenOwner(std::vector<TaskRetState<InRet>>& states);
         };
 
         using TaskState = TaskRetState<void>;
 
+        /*  创建一个在所有输入任务都结束后才结束的任务状态，不阻塞当前线程；线程安全
+            - 用法：mthread::whenAll(states).then([&]() { ... });
+            输入任务是否抛出异常不影响返回的任务状态，需要通过各输入任务状态的get获取结果；输入的任务状态视为已注册后续任务
+            @param states: 由同一个ThreadPool创建的任务状态，否则抛出std::runtime_error异常
+            @return 无返回值的任务状态，可以继续调用then注册汇合后的后续任务；states为空时返回已结束的任务状态，其后续任务在调用then的线程中直接执行   */
+        template<class Ret>
+        TaskState whenAll(std::vector<TaskRetState<Ret>>& states);
+
+        /*  创建一个在任一输入任务结束后就结束的任务状态，不阻塞当前线程；线程安全
+            输入的任务状态视为已注册后续任务
+            @param states: 由同一个ThreadPool创建的任务状态，不能为空，否则抛出std::runtime_error异常
+            @return 返回值为最先结束的任务在states中的索引的任务状态；所有输入任务都已注册过后续任务时返回值为-1   */
+        template<class Ret>
+        TaskRetState<int> whenAny(std::vector<TaskRetState<Ret>>& states);
+
+
+        //线程池的任务调度策略
+        enum class SchedulePolicy
+        {
+            SharedQueue = 0,   //所有线程共享一个任务队列
+            WorkStealing = 1,   //每个线程拥有独立的任务队列，空闲线程从其他线程的队列中窃取任务，适用于线程多且任务短小的情况
+            LockFreeQueue = 2   //所有线程共享一个容量为MINE_LOCKFREE_TASK_QUEUE_CAPACITY的mthread::MPMCQueue无锁队列；队列满时，工作线程内添加的任务直接在该线程执行，其他线程添加任务会等待空位，线程池停止后不再等待并取消该任务
+        };
+
+        //ThreadPool::parallelFor的分块策略
+        enum class ChunkPolicy
+        {
+            Static = 0,   //按参与线程数均分为大小相同的块，适用于每个元素耗时相近的情况
+            Dynamic = 1,   //每次领取grain个元素，适用于元素耗时不均的情况
+            Guided = 2   //领取的块大小随剩余元素数递减，但不小于grain，兼顾调度开销与负载均衡
+        };
+
+        //ThreadPool任务的优先级
+        enum class TaskPriority
+        {
+            High = 0,   //时延敏感的任务，如推理
+            Normal = 1,   //先于未指定优先级的任务执行
+            Low = 2   //后台批量任务，如日志、写盘，在没有其他任务时才执行
+        };
+
+        //ThreadPool中一类优先级任务的排队统计
+        struct TaskQueueStats
+        {
+            long long num_pending = 0;   //正在排队的任务数
+            long long num_started = 0;   //已开始执行的任务数
+            long long mean_wait_us = 0;   //已开始执行的任务从添加到开始执行的平均等待时间
+            long long max_wait_us = 0;   //已开始执行的任务的最大等待时间
+            long long num_missed = 0;   //开始执行时已超过截止时间的任务数，仅对带截止时间的任务有效
+        };
+
+        //对数分桶的耗时直方图，第0个桶统计小于1纳秒的样本，第i个桶统计[2^(i-1), 2^i)纳秒的样本，超出范围的样本计入最后一个桶
+        struct LatencyHistogram
+        {
+            static const int NUM_BUCKETS = 40;
+
+            long long buckets[NUM_BUCKETS] = {};
+            long long count = 0;   //样本数
+            long long total_ns = 0;   //样本总和
+            long long max_ns = 0;   //最大样本
+
+            //获取平均值(纳秒)，没有样本时返回0
+            long long meanNs() const;
+
+            /*  获取百分位数(纳秒)，结果为所在桶的上界，且不超过最大样本
+                @param percent: 百分位，范围为[0, 100]，如99表示p99
+                @return 百分位数，没有样本时返回0  */
+            long long percentileNs(double percent) const;
+        };
+
+        //ThreadPool的运行统计快照
+        struct ThreadPoolStats
+        {
+            int pool_size = 0;   //当前线程数量
+            long long num_submitted = 0;   //已添加的任务数，即后三项之和
+            long long num_completed = 0;   //已出队并处理完毕的任务数，包括出队时发现已取消而跳过的任务
+            long long num_running = 0;   //正在执行的任务数
+            long long num_pending = 0;   //正在排队的任务数
+            long long elapsed_ns = 0;   //首次开启耗时统计至今的时间，未开启时为0
+            std::vector<long long> worker_busy_ns;   //开启耗时统计后各线程执行任务的总时间
+            std::vector<double> worker_busy_ratios;   //开启耗时统计后各线程执行任务的时间占比
+            mthread::LatencyHistogram queue_wait;   //通过addTask添加的任务从添加到开始执行的等待时间，开启耗时统计后添加的任务才会计入
+            mthread::LatencyHistogram run_time;   //任务的执行时间
+        };
+
+        /*  按线程分片的计数器，线程安全，适用于多个线程高频累加、偶尔读取的统计量，如已处理帧数、丢帧数
+            每个线程固定写入一个独占缓存行的分片，读取时汇总所有分片；线程数多于分片数时多个线程共用一个分片，结果仍然准确  */
+        class ShardedCounter
+        {
+        public:
+            ShardedCounter();
+
+            //累加delta；线程安全
+            void add(long long delta = 1);
+
+            //获取所有分片的总和，与add并发时为近似值；线程安全
+            long long get() const;
+
+            /*  清零所有分片；线程安全
+                @return 清零前的总和，与add并发时每次累加恰好计入本次返回值或之后的统计之一  */
+            long long reset();
+
+            ShardedCounter(const ShardedCounter& tmp) = delete;
+            ShardedCounter& operator=(const ShardedCounter& tmp) = delete;
+            ShardedCounter(ShardedCounter&& tmp) = delete;
+            ShardedCounter& operator=(ShardedCounter&& tmp) = delete;
+
+        private:
+            struct Shard
+            {
+                std::atomic<long long> value;
+                char pad_[MINE_CACHE_LINE_SIZE - sizeof(std::atomic<long long>)];
+            };
+
+            char pad0_[MINE_CACHE_LINE_SIZE];
+            Shard shards_[MINE_RWLOCK_READER_SLOTS];
+        };
+
+        /*  按线程分片的对数分桶直方图，线程安全，分桶方式与LatencyHistogram相同，读取时汇总为LatencyHistogram
+            适用于多个线程高频记录耗时、队列长度等非负整数样本，样本单位由调用方决定，通常为纳秒  */
+        class ShardedHistogram
+        {
+        public:
+            ShardedHistogram();
+
+            //记录一个样本，负值计入第0个桶；线程安全
+            void record(long long value);
 
-        //简易线程池，在rv1126上执行一个任务大概会引入接近200us的时间开销
+            //汇总所有分片，与record并发时为近似值；线程安全
+            mthread::LatencyHistogram snapshot() const;
+
+            //清零所有分片，与record并发时清零期间的样本可能部分保留；线程安全
+            void reset();
+
+            ShardedHistogram(const ShardedHistogram& tmp) = delete;
+            ShardedHistogram& operator=(const ShardedHistogram& tmp) = delete;
+            ShardedHistogram(ShardedHistogram&& tmp) = delete;
+            ShardedHistogram& operator=(ShardedHistogram&& tmp) = delete;
+
+        private:
+            struct Shard;
+
+            std::unique_ptr<Shard[]> shards_;
+        };
+
+        //简易线程池，任务对象内联储存于预分配的任务槽中，结果状态从对象池中复用，常规大小的任务在稳定运行后提交和执行均不产生堆内存分配
         class ThreadPool
         {
         public:
-            /*  构造ThreadPool对象
+            /*  构造ThreadPool对象，使用SchedulePolicy::SharedQueue调度策略
                 @param pool_size: 线程池线程数量，不小于1  */
             ThreadPool(int pool_size);
 
+            /*  构造ThreadPool对象
+                @param pool_size: 线程池线程数量，不小于1
+                @param policy: 任务调度策略，输入强枚举类型mthread::SchedulePolicy的成员  */
+            ThreadPool(int pool_size, mthread::SchedulePolicy policy);
+
             /*  添加一个任务到线程池中并异步执行(会拷贝所有输入用于储存)，规则涵盖std::bind的要求且更严格；线程安全     
                 推荐用法:
                 - addTask(function or &function, args...)
@@ -135,12 +839,124 @@ namespace mineutils
                 注意，经测试QNX的g++4.7.3对C++11特性支持不全，以下情况可能直接在模板内部编译错误而非触发SFINAE特性：
                 - 仿函数作为Fn，但被类似std::reference_wrapper的第三方引用包装传递时
                 - 仿函数作为Fn，但匹配Args...的operator()为私有或受保护的成员时
+                WorkStealing策略下，在本线程池的工作线程内添加的任务会进入该线程自己的队列，其他线程添加的任务轮流分配到各线程的队列
                 @param func: 任务函数。要求其参数类型不能为右值引用，返回类型必须为void或支持使用自身的右值赋值；如果func是一个函数对象(functor)类型，那么它的去引用类型必须支持使用自身的左值和右值对象进行构造，且不是volatile类型；如果func是成员函数或函数对象，它要保证要调用的函数的cv限定符与对象一致
                 @param args...: 任务函数的参数。需要左值引用传递的参数必须用std::ref或std::cref显式引用否则实际为值传递，其他非C数组参数的去引用类型必须支持使用自身的左值和右值对象进行构造
+                绑定后的任务大小超过MINE_TASK_INLINE_SIZE字节，或不能无异常移动时，会退化为在堆上储存
                 @return 任务结果状态，用于查询任务状态、等待任务结束以及获取任务返回值，注意ThreadPool对象析构后任务状态失效  */
             template<class Fn, class... Args, class Ret = typename mtype::StdBindChecker<Fn, Args...>::ReturnType, typename std::enable_if<std::is_same<Ret, typename mtype::StdBindChecker<Fn, Args...>::ReturnType>::value && (std::is_void<Ret>::value || std::is_move_assignable<typename std::remove_reference<Ret>::type>::value), int>::type = 0>
             TaskRetState<Ret> addTask(Fn&& func, Args&&... args);
 
+            /*  按优先级添加一个任务到线程池中并异步执行，其余规则同addTask(func, args...)；线程安全
+                - 用法：thd_pool.addTask(mthread::TaskPriority::High, infer_func, std::ref(frame));
+                工作线程总是先取带截止时间的任务，再依次取High、Normal优先级的任务、未指定优先级的任务，最后取Low优先级的任务；同一优先级内先进先出
+                指定了优先级的任务进入所有线程共享的优先级队列，不受调度策略影响
+                @param priority: 任务优先级，输入强枚举类型mthread::TaskPriority的成员
+                @return 任务结果状态  */
+            template<class Fn, class... Args, class Ret = typename mtype::StdBindChecker<Fn, Args...>::ReturnType, typename std::enable_if<std::is_same<Ret, typename mtype::StdBindChecker<Fn, Args...>::ReturnType>::value && (std::is_void<Ret>::value || std::is_move_assignable<typename std::remove_reference<Ret>::type>::value), int>::type = 0>
+            TaskRetState<Ret> addTask(mthread::TaskPriority priority, Fn&& func, Args&&... args);
+
+            /*  按截止时间添加一个任务到线程池中并异步执行，其余规则同addTask(func, args...)；线程安全
+                - 用法：thd_pool.addTask(mtime::now() + std::chrono::milliseconds(30), infer_func, std::ref(frame));
+                带截止时间的任务先于所有按优先级添加的任务执行，彼此之间截止时间早的先执行；超过截止时间的任务仍会执行，并计入统计
+                @param deadline: 任务的截止时间
+                @return 任务结果状态  */
+            template<class Fn, class... Args, class Ret = typename mtype::StdBindChecker<Fn, Args...>::ReturnType, typename std::enable_if<std::is_same<Ret, typename mtype::StdBindChecker<Fn, Args...>::ReturnType>::value && (std::is_void<Ret>::value || std::is_move_assignable<typename std::remove_reference<Ret>::type>::value), int>::type = 0>
+            TaskRetState<Ret> addTask(const mtime::TimePoint& deadline, Fn&& func, Args&&... args);
+
+            /*  添加一个可取消的任务到线程池中并异步执行，其余规则同addTask(func, args...)；线程安全
+                - 用法：thd_pool.addTask(token, process_frame, frame);
+                任务出队时若token已取消则不会执行，其结果状态得到mthread::TaskCancelledError异常
+                @param token: 取消令牌
+                @return 任务结果状态  */
+            template<class Fn, class... Args, class Ret = typename mtype::StdBindChecker<Fn, Args...>::ReturnType, typename std::enable_if<std::is_same<Ret, typename mtype::StdBindChecker<Fn, Args...>::ReturnType>::value && (std::is_void<Ret>::value || std::is_move_assignable<typename std::remove_reference<Ret>::type>::value), int>::type = 0>
+            TaskRetState<Ret> addTask(const mthread::CancellationToken& token, Fn&& func, Args&&... args);
+
+            /*  延迟一段时间后将任务添加到线程池中执行，其余规则同addTask(func, args...)；线程安全
+                - 用法：thd_pool.addDelayedTask(std::chrono::milliseconds(500), reconnect_func);
+                所有定时任务由同一个定时线程按到期时间放入任务队列，该线程在首次添加定时任务时创建
+                drain会等待已添加的延迟任务到期并执行完毕；abort或析构时尚未到期的任务不会执行，其结果状态得到mthread::TaskCancelledError异常
+                @param delay: 延迟时间，不大于0时立即放入任务队列
+                @return 任务结果状态  */
+            template<class Fn, class... Args, class Ret = typename mtype::StdBindChecker<Fn, Args...>::ReturnType, typename std::enable_if<std::is_same<Ret, typename mtype::StdBindChecker<Fn, Args...>::ReturnType>::value && (std::is_void<Ret>::value || std::is_move_assignable<typename std::remove_reference<Ret>::type>::value), int>::type = 0>
+            TaskRetState<Ret> addDelayedTask(const mtime::Duration& delay, Fn&& func, Args&&... args);
+
+            /*  以固定速率周期性地在线程池中执行任务，直到返回的令牌被取消；线程安全
+                - 用法：auto token = thd_pool.addPeriodicTask(std::chrono::seconds(1), send_heartbeat); ... token.cancel();
+                第n次执行的计划时间为添加时间加n个周期，不受每次执行耗时和调度延迟的影响，误差不会累积
+                上一次执行尚未结束或错过了计划时间时，跳过对应的周期，不会并发执行或事后补做；任务的返回值和异常被忽略
+                drain开始后周期任务不再触发
+                @param period: 执行周期，不大于0时不会执行，返回已取消的令牌
+                @param func: 任务函数，要求同addTask，且绑定后的可调用对象必须支持拷贝
+                @param args...: 任务函数的参数
+                @return 取消令牌，调用cancel()后停止触发  */
+            template<class Fn, class... Args>
+            mthread::CancellationToken addPeriodicTask(const mtime::Duration& period, Fn&& func, Args&&... args);
+
+            /*  等待所有已添加的任务(包括执行期间新添加的任务)执行完毕后停止所有线程；线程安全，但不能在本线程池的工作线程内调用
+                停止后添加的任务不会执行，其结果状态得到mthread::TaskCancelledError异常  */
+            void drain();
+
+            /*  等待各线程执行完当前任务后停止所有线程，丢弃尚未开始执行的任务；线程安全，但不能在本线程池的工作线程内调用
+                被丢弃以及停止后添加的任务不会执行，其结果状态得到mthread::TaskCancelledError异常；析构时会自动调用  */
+            void abort();
+
+            /*  开启或关闭任务耗时统计(等待时间、执行时间和线程繁忙占比)，开启后每个任务会多读取数次时钟，默认关闭；线程安全
+                统计数据从首次开启开始累计，需要某段时间内的数据时可以对前后两次snapshot的结果作差  */
+            void setStatsEnabled(bool enabled);
+
+            /*  获取运行统计快照，各计数为宽松读取的近似值，开销很小，可以定期轮询；线程安全
+                任务数计数不受setStatsEnabled影响，始终有效  */
+            mthread::ThreadPoolStats snapshot();
+
+            /*  获取指定优先级任务的排队统计；线程安全
+                @param priority: 任务优先级，输入强枚举类型mthread::TaskPriority的成员
+                @return 排队中的任务数以及已执行任务的等待时间统计  */
+            mthread::TaskQueueStats getQueueStats(mthread::TaskPriority priority);
+
+            //获取带截止时间任务的排队统计；线程安全
+            mthread::TaskQueueStats getDeadlineQueueStats();
+
+            /*  运行时调整线程数量；线程安全，但不能在本线程池的工作线程内调用
+                减少线程时会等待被移除的线程执行完当前任务，它们队列中剩余的任务由其他线程继续执行
+                @param pool_size: 新的线程数量，范围为[1, max(构造时的线程数, MINE_THREADPOOL_MAX_SIZE)]，超出范围时会被截断  */
+            void resize(int pool_size);
+
+            //获取当前线程数量；线程安全
+            int getPoolSize() const;
+
+            /*  将指定序号的工作线程绑定到一组CPU核心上，之后由resize新建的同序号线程同样生效；线程安全
+                - 用法：thd_pool.setWorkerAffinity(0, { 4, 5, 6, 7 });   //如big.LITTLE架构下绑定到大核
+                仅Linux(不含Android)下通过pthread_setaffinity_np实现，其他平台返回false
+                @param worker_idx: 工作线程序号，范围同resize的线程数量
+                @param cpu_ids: CPU核心序号，为空时解除绑定
+                @return 是否设置成功  */
+            bool setWorkerAffinity(int worker_idx, const std::vector<int>& cpu_ids);
+
+            /*  设置空闲工作线程在休眠前自旋等待新任务的时间，可以降低突发任务的唤醒延迟，但会占用CPU；线程安全
+                @param spin_us: 自旋时间(微秒)，不大于0时没有新任务立即休眠，默认为0  */
+            void setIdleSpinTime(long long spin_us);
+
+            /*  将[begin, end)范围分块后作为一批任务并行执行，调用线程同样参与执行，全部完成后返回；线程安全
+                - 用法：thd_pool.parallelFor(0, img_rows, 8, [&](int row) { ... });
+                注意func会在多个线程中被同时调用，任一调用抛出异常时剩余的块不再执行，并在返回前重新抛出第一个异常
+                @param begin: 起始索引，整数类型
+                @param end: 结束索引(不包含)
+                @param grain: 分块的最小元素数，小于1的值会被置为1
+                @param func: 以单个索引为参数的函数或函数对象，返回值被忽略
+                @param policy: 分块策略，输入强枚举类型mthread::ChunkPolicy的成员  */
+            template<class Index, class Fn, typename std::enable_if<std::is_integral<Index>::value, int>::type = 0>
+            void parallelFor(Index begin, Index end, Index grain, Fn&& func, mthread::ChunkPolicy policy = mthread::ChunkPolicy::Dynamic);
+
+            /*  对支持随机访问迭代器的容器中的每个元素并行调用func，调用线程同样参与执行，全部完成后返回；线程安全
+                - 用法：thd_pool.parallelForEach(boxes, [&](mmath::LTRB& box) { ... });
+                @param container: 容器，如std::vector、std::deque、std::array等
+                @param func: 以单个元素的引用为参数的函数或函数对象，返回值被忽略
+                @param grain: 分块的最小元素数，小于1的值会被置为1
+                @param policy: 分块策略，输入强枚举类型mthread::ChunkPolicy的成员  */
+            template<class Container, class Fn, typename std::enable_if<std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<decltype(std::begin(std::declval<Container&>()))>::iterator_category>::value, int>::type = 0>
+            void parallelForEach(Container& container, Fn&& func, long long grain = 1, mthread::ChunkPolicy policy = mthread::ChunkPolicy::Dynamic);
+
             ThreadPool(const ThreadPool& thd_pool) = delete;
             ThreadPool& operator=(const ThreadPool& thd_pool) = delete;
             ThreadPool(ThreadPool&& thd_pool) = delete;
@@ -148,21 +964,156 @@ namespace mineutils
             ~ThreadPool();
 
         private:
-            void worker();
+            class LocalQueue;
+            class TimerEntry;
+            class PeriodicJob;
+
+            void worker(int worker_idx);
+            void pollingWorker(int worker_idx);
+            void startWorker(int worker_idx);
+            void stopWorkers();
+            void addTimer(ThreadPool::TimerEntry&& entry);
+            void timerLoop();
+            void stopTimer();
+            void runTask(mthread::_InlineTask& task, int worker_idx);
+            void finishTask();
+            bool shouldExit(int worker_idx) const;
+            void idleSpin();
+            bool tryGetTask(int worker_idx, mthread::_InlineTask& task);
+            void wakeWorkers(int num_tasks);
+            bool pushTask(mthread::_InlineTask&& task);
+            template<class TaskFn>
+            void pushTaskBatch(const TaskFn& task_func, int num_tasks);
+            bool pushPriorityTask(int level, const mtime::TimePoint& deadline, mthread::_InlineTask&& task);
+            bool rejectTask(mthread::_InlineTask& task);
+            void discardLockFreeTasks();
+            bool popPriorityTask(int max_level, mthread::_InlineTask& task);
+            bool tryPopPriorityTask(int max_level, mthread::_InlineTask& task);
+            mthread::TaskQueueStats getLevelStats(int level);
+            template<class Ret, class BindT>
+            mthread::_InlineTask createTask(BindT&& bind_task, TaskRetState<Ret>& state);
+            bool popLocalTask(int worker_idx, mthread::_InlineTask& task);
+            bool stealTask(int worker_idx, mthread::_InlineTask& task);
+            int getCurrentWorkerIdx();
+            int findCurrentWorkerIdx();
+            void setWorkerId(int worker_idx, std::thread::id thread_id);
 
-            int pool_size_;
-            std::queue<std::function<void()>> task_queue_;
+            std::atomic<int> pool_size_;
+            int max_size_;
+            mthread::SchedulePolicy policy_;
+            std::unique_ptr<mthread::_TaskRing> task_queue_;
             std::vector<std::thread> work_thds_;
 
+            //预留max_size_个位置，只增不减，以便运行中调整线程数时其他线程可以无锁访问已创建的队列
+            std::vector<std::unique_ptr<LocalQueue>> local_queues_;
+            std::atomic<int> num_queues_;
+            std::unique_ptr<mthread::MPMCQueue<mthread::_InlineTask>> lockfree_queue_;
+            std::atomic<unsigned int> next_queue_idx_;
+            std::atomic<long long> num_pending_;
+            std::atomic<int> num_sleeping_;
+            std::atomic<long long> idle_spin_us_;
+
+            //drain等待num_pending_和num_running_均为0，工作线程只在有等待者时加锁通知
+            std::atomic<int> num_running_;
+            std::atomic<int> num_drainers_;
+            std::condition_variable idle_cond_;
+
+            //resize_mtx_保护work_thds_、worker_cpus_、stats_start_t_以及worker_stats_的创建
+            std::mutex resize_mtx_;
+            std::vector<std::vector<int>> worker_cpus_;
+            //与local_queues_一样预留max_size_个位置，按线程序号创建后不再释放，只由对应线程写入
+            std::vector<std::unique_ptr<mthread::_WorkerStats>> worker_stats_;
+            //各工作线程的线程id，由线程自己登记和清除；不支持thread_local时据此判断当前线程是否为工作线程
+            std::mutex worker_ids_mtx_;
+            std::vector<std::thread::id> worker_ids_;
+            std::atomic<bool> stats_on_;
+            mtime::TimePoint stats_start_t_;
+
+            //优先级队列及其统计由task_mtx_保护，num_prioritized_用于工作线程免锁判断是否有优先级任务
+            std::unique_ptr<mthread::_PriorityTaskQueue> priority_queue_;
+            std::atomic<long long> num_prioritized_;
+            class LevelCounter;
+            std::unique_ptr<LevelCounter[]> level_counters_;
+
             std::mutex task_mtx_;
             std::condition_variable cond_var_;
             std::atomic<bool> need_abort_;
 
+            //定时任务按到期时间保存在最小堆timer_heap_中，由timer_mtx_保护；num_delayed_为堆中尚未放入任务队列的延迟任务数，供drain等待
+            std::mutex timer_mtx_;
+            std::condition_variable timer_cond_;
+            std::vector<ThreadPool::TimerEntry> timer_heap_;
+            unsigned long long next_timer_seq_;
+            std::thread timer_thd_;
+            bool timer_stopped_;
+            bool timer_draining_;
+            std::atomic<long long> num_delayed_;
+
+            friend class TaskGraph;
+            friend class _TaskResultBase;
+
         public:
             //已废弃
             mdeprecated(R"(Deprecated. The parameter "wakeup_period_ms" is no longer used.)") ThreadPool(int pool_size, long long wakeup_period_ms); 
         };
 
+        /*  基于ThreadPool的任务依赖图(DAG)执行器，节点在所有前驱节点完成后才被提交到线程池执行，执行过程中不会有线程阻塞等待其他任务
+            构建一次后可以反复运行，如每帧运行一次 decode -> preprocess -> infer -> postprocess -> draw 的流水线
+            构建图的接口非线程安全，且不能在运行时调用；run、wait和finished线程安全  */
+        class TaskGraph
+        {
+        public:
+            TaskGraph() = default;
+
+            /*  添加一个节点
+                - 用法：int infer = graph.addNode([&]() { ... }, { preprocess });
+                @param func: 节点要执行的函数或函数对象，无参数，返回值被忽略
+                @param predecessors: 前驱节点的id，只能是已添加的节点，因此图中不会出现环
+                @return 节点id，添加失败时返回-1   */
+            template<class Fn>
+            int addNode(Fn&& func, const std::vector<int>& predecessors = std::vector<int>());
+
+            /*  在线程池上异步运行整张图，函数立即返回
+                线程池已停止(drain、abort或析构)时，未执行的节点被取消，本次运行仍会结束，wait抛出mthread::TaskCancelledError异常
+                @param thd_pool: 执行节点的线程池，运行结束前必须保持有效
+                @return 上一次运行尚未结束时返回false，否则返回true   */
+            bool run(mthread::ThreadPool& thd_pool);
+
+            //等待本次运行结束，如果有节点抛出异常或被取消，会在这里重新抛出第一个异常；线程安全
+            void wait();
+
+            //判断本次运行是否结束；线程安全
+            bool finished();
+
+            //获取节点数量
+            int size();
+
+            TaskGraph(const TaskGraph& tmp) = delete;
+            TaskGraph& operator=(const TaskGraph& tmp) = delete;
+            TaskGraph(TaskGraph&& tmp) = delete;
+            TaskGraph& operator=(TaskGraph&& tmp) = delete;
+            ~TaskGraph();
+
+        private:
+            class Node;
+            class NodeTask;
+
+            void runNode(int node_id);
+            void postNode(int node_id);
+            void cancelNode(int node_id);
+
+            std::vector<std::unique_ptr<Node>> nodes_;
+            std::vector<int> roots_;
+            mthread::ThreadPool* thd_pool_ = nullptr;
+            std::atomic<int> num_unfinished_{ 0 };
+            std::atomic<bool> failed_{ false };
+
+            std::mutex mtx_;
+            std::condition_variable cond_;
+            bool running_ = false;
+            std::exception_ptr exception_;
+        };
+
         //跨线程暂停，使用条件变量实现以代替循环sleep
         class ThreadPauser
         {
@@ -195,6 +1146,206 @@ namespace mineutils
             std::condition_variable cond_;
             std::atomic<bool> need_pause_;
         };
+
+        /*  跨线程暂停，暂停点直接休眠在原子变量上（Linux下为futex），不使用互斥锁和条件变量
+            - 未暂停时暂停点只读取一个原子变量；pause和resume不加锁，resume仅在有线程停靠时才发起唤醒
+            - 控制线程可通过pauseAndWaitAllParked等待所有暂停点确实停下，无需轮询状态量  */
+        class ParkingThreadPauser
+        {
+        public:
+            ParkingThreadPauser();
+
+            //设置暂停点，当调用ParkingThreadPauser::pause的时候就会在此处暂停；线程安全
+            void setPausePoint();
+
+            /*  设置暂停点，且输入一个状态量，当调用ParkingThreadPauser::pause的时候就会在此处暂停；线程安全
+                @param pause_point_state: 暂停点状态量，当该暂停点被阻塞时，pause_point_state的值被设为true，未阻塞时值被设为false；值不变时不写入  */
+            void setPausePoint(std::atomic<bool>& pause_point_state);
+
+            //发出暂停信号，在所有暂停点卡住线程；线程安全
+            void pause();
+
+            /*  发出暂停信号，并等待指定数量的暂停点都已停下；线程安全
+                @param num_pause_points: 需要等待停下的暂停点数量，通常为调用setPausePoint的线程数
+                @return 所有暂停点都已停下返回true，等待期间被resume返回false  */
+            bool pauseAndWaitAllParked(int num_pause_points);
+
+            /*  发出暂停信号，并等待指定数量的暂停点都已停下，最多等待timeout时长；线程安全
+                @param num_pause_points: 需要等待停下的暂停点数量，通常为调用setPausePoint的线程数
+                @param timeout: 最长等待时间，如std::chrono::milliseconds(5)
+                @return 所有暂停点都已停下返回true，超时或等待期间被resume返回false；超时后仍保持暂停状态  */
+            bool pauseAndWaitAllParked(int num_pause_points, const mtime::Duration& timeout);
+
+            //发出继续信号，唤醒所有暂停点；线程安全
+            void resume();
+
+            //获取当前是否为paused状态，仅代表是否调用了pause函数，不代表暂停点已触发；线程安全
+            bool isPaused();
+
+            //获取当前停在暂停点的线程数；线程安全
+            int getNumParked();
+
+            ParkingThreadPauser(const ParkingThreadPauser& tmp) = delete;
+            ParkingThreadPauser& operator=(const ParkingThreadPauser& tmp) = delete;
+            ParkingThreadPauser(ParkingThreadPauser&& tmp) = delete;
+            ParkingThreadPauser& operator=(ParkingThreadPauser&& tmp) = delete;
+            ~ParkingThreadPauser();
+        private:
+            void park(int epoch);
+            bool waitAllParked(int num_pause_points, const mtime::TimePoint* deadline);
+
+            //暂停纪元，每次pause和resume各加1，奇数表示暂停中；暂停点休眠在该变量上
+            std::atomic<int> epoch_;
+            //按暂停纪元交替使用的停靠计数，避免刚被唤醒、尚未离开的线程被计入下一次暂停
+            std::atomic<int> num_parked_[2];
+            //停靠和resume时递增，控制线程休眠在该变量上
+            std::atomic<int> park_seq_;
+            std::atomic<int> num_waiting_controllers_;
+        };
+
+        //Pipeline输出元素的顺序
+        enum class PipelineOrder
+        {
+            Ordered = 0,   //按输入顺序输出，并行阶段中先完成的元素会在末端等待排在前面的元素
+            Unordered = 1   //按完成顺序输出，延迟更低
+        };
+
+        //Pipeline中一个阶段的运行统计快照
+        struct PipelineStageStats
+        {
+            std::string name;   //阶段名
+            int parallelism = 0;   //工作线程数
+            size_t queue_capacity = 0;   //输入队列容量
+            size_t queue_size = 0;   //输入队列中正在排队的元素数
+            long long num_processed = 0;   //已处理完毕的元素数
+            long long num_failed = 0;   //处理函数抛出异常而被丢弃的元素数
+            long long busy_ns = 0;   //各线程执行处理函数的总时间
+            long long elapsed_ns = 0;   //启动至今的时间，未启动时为0
+            bool paused = false;   //是否调用了pauseStage
+
+            //获取每个元素的平均处理时间(纳秒)，没有样本时返回0
+            long long meanNs() const;
+
+            //获取启动至今的平均吞吐量(元素/秒)，未启动时返回0
+            double throughput() const;
+        };
+
+        /*  多阶段流水线，每个阶段有独立的有界输入队列和若干工作线程，线程安全
+            - 用法：
+                mthread::Pipeline<Frame, Result> pipeline(mthread::PipelineOrder::Ordered);
+                pipeline.addStage<Frame, Tensor>("preprocess", preprocess_func, 1, 4);
+                pipeline.addStage<Tensor, Result>("infer", infer_func, 2, 4);
+                pipeline.start();
+                pipeline.push(frame);   //生产线程
+                pipeline.pop(result);   //消费线程
+            - 下游队列已满时上游阶段阻塞等待，输出队列已满时最后一个阶段阻塞等待，第一个阶段的队列已满时push阻塞，从而形成背压
+            - 处理函数抛出异常时丢弃该元素并计入统计，不影响后续元素；每个阶段只在首次丢弃时输出警告
+            - 各阶段的元素类型需可默认构造和移动  */
+        template<class In, class Out>
+        class Pipeline
+        {
+        public:
+            /*  构造Pipeline对象
+                @param order: 输出元素的顺序
+                @param output_capacity: 输出队列容量，不小于1  */
+            explicit Pipeline(mthread::PipelineOrder order = mthread::PipelineOrder::Ordered, size_t output_capacity = 16);
+
+            /*  在末尾添加一个阶段，只能在start之前调用；第一个阶段的输入类型需为In，其余阶段的输入类型需与上一阶段的输出类型相同，否则抛出异常
+                @param name: 阶段名，用于统计输出
+                @param func: 处理函数，形如StageOut func(StageIn item)
+                @param parallelism: 该阶段的工作线程数，不小于1；大于1时元素可能乱序完成
+                @param queue_capacity: 该阶段输入队列的容量，不小于1
+                @return Pipeline自身的引用，可链式调用  */
+            template<class StageIn, class StageOut, class Fn>
+            Pipeline& addStage(const std::string& name, Fn&& func, int parallelism = 1, size_t queue_capacity = 16);
+
+            //启动所有阶段的工作线程；没有阶段、最后一个阶段的输出类型不是Out或重复启动时抛出异常
+            void start();
+
+            /*  输入一个元素，第一个阶段的队列已满时阻塞等待；只能在start之后调用
+                @return 已调用close或abort时返回false，元素被丢弃  */
+            bool push(In value);
+
+            /*  尝试输入一个元素，不等待；只能在start之后调用
+                @return 第一个阶段的队列已满、或已调用close或abort时返回false，元素被丢弃  */
+            bool tryPush(In value);
+
+            /*  取出一个输出元素，没有输出时阻塞等待
+                @return 取出成功返回true；调用close后所有元素都已取出，或调用abort后返回false  */
+            bool pop(Out& value);
+
+            //尝试取出一个输出元素，不等待；没有输出时返回false
+            bool tryPop(Out& value);
+
+            //结束输入，各阶段处理完已输入的元素后依次退出，输出取完后pop返回false
+            void close();
+
+            //中止流水线，丢弃所有未处理和未取出的元素，唤醒阻塞中的push和pop
+            void abort();
+
+            /*  暂停一个阶段，该阶段的线程取到下一个元素后停下，上游阶段在该阶段的队列满后因背压停下
+                @param stage_index: 阶段序号，按添加顺序从0开始  */
+            void pauseStage(int stage_index);
+
+            /*  恢复被暂停的阶段
+                @param stage_index: 阶段序号，按添加顺序从0开始  */
+            void resumeStage(int stage_index);
+
+            /*  获取阶段是否处于暂停状态
+                @param stage_index: 阶段序号，按添加顺序从0开始  */
+            bool isStagePaused(int stage_index);
+
+            int getNumStages();
+
+            /*  获取一个阶段的运行统计
+                @param stage_index: 阶段序号，按添加顺序从0开始
+                @return 统计快照  */
+            mthread::PipelineStageStats getStageStats(int stage_index);
+
+            /*  按MeanTimeCounter的格式输出各阶段的平均处理时间，并附带吞吐量和队列占用
+                @param time_unit: 输出信息中时间统计的单位，输入强枚举类型mtime::Unit的成员  */
+            void printStageStats(mtime::Unit time_unit = mtime::Unit::ms);
+
+            Pipeline(const Pipeline& tmp) = delete;
+            Pipeline& operator=(const Pipeline& tmp) = delete;
+            Pipeline(Pipeline&& tmp) = delete;
+            Pipeline& operator=(Pipeline&& tmp) = delete;
+
+            //析构时中止流水线并丢弃未处理的元素；需要处理完所有元素时，应先调用close并pop到返回false
+            ~Pipeline();
+
+        private:
+            mthread::_PipelineStageBase* getStage(int stage_index);
+            void deliver(unsigned long long seq, Out&& value);
+            void skip(unsigned long long seq);
+            size_t reserveReorderSlot(unsigned long long seq);
+            void flushReorderBuffer(std::unique_lock<std::mutex>& lk);
+
+            //有序模式缓冲区中每个序号的状态
+            enum
+            {
+                REORDER_EMPTY = 0,
+                REORDER_READY = 1,   //元素已完成，等待写入输出队列
+                REORDER_SKIPPED = 2   //元素已被丢弃，写入时跳过该序号
+            };
+
+            mthread::PipelineOrder order_;
+            std::vector<std::unique_ptr<mthread::_PipelineStageBase>> stages_;
+            mthread::_PipelineQueue<In>* input_queue_ = nullptr;
+            mthread::_PipelineQueue<Out> output_queue_;
+            std::atomic<unsigned long long> next_seq_;
+            bool started_ = false;
+
+            //有序模式下提前完成的元素，按序号对容量取模存放在环形缓冲区中，容量为2的幂；乱序跨度超过容量时容量加倍
+            std::mutex reorder_mtx_;
+            std::condition_variable reorder_cond_;
+            std::vector<Out> reorder_items_;
+            std::vector<unsigned char> reorder_states_;
+            unsigned long long next_output_seq_ = 0;
+            //同一时刻只有一个线程将连续就绪的元素写入输出队列，写入时不持有reorder_mtx_
+            bool reorder_flushing_ = false;
+            std::vector<std::pair<unsigned long long, Out>> reorder_batch_;
+        };
     }
 
 
@@ -206,6 +1357,95 @@ namespace mineutils
 
     namespace mthread
     {
+        //自旋等待时提示CPU降低功耗并让出流水线资源
+        inline void _cpuRelax()
+        {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+            _mm_pause();
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+            __builtin_ia32_pause();
+#elif defined(__GNUC__) && (defined(__aarch64__) || (defined(__arm__) && defined(__ARM_ARCH) && __ARM_ARCH >= 7))
+            __asm__ __volatile__("yield" ::: "memory");
+#endif
+        }
+
+        //阻塞等待前的自旋次数，前半段只暂停CPU，后半段让出时间片
+        inline int _getSpinCount()
+        {
+            return 64;
+        }
+
+#if !defined(__linux__)
+        struct _ParkingBucket
+        {
+            std::mutex mtx;
+            std::condition_variable cond;
+        };
+
+        //没有futex的平台上按地址散列到固定数量的等待桶，不同地址可能共用一个桶，唤醒时需要唤醒桶内所有线程
+        inline _ParkingBucket& _getParkingBucket(const void* addr)
+        {
+            static _ParkingBucket buckets[64];
+            return buckets[(reinterpret_cast<size_t>(addr) / sizeof(int)) % 64];
+        }
+#endif
+
+        //当前线程使用的读者计数槽序号，线程首次调用时轮流分配；不支持thread_local时所有线程共用一个槽，仍然正确但不再分散
+        inline int _getReaderSlotIndex()
+        {
+            static std::atomic<int> next_index(0);
+            static MINE_THREAD_LOCAL_IF_HAVE int slot_index = next_index.fetch_add(1) % MINE_RWLOCK_READER_SLOTS;
+            return slot_index;
+        }
+
+        //若word的值仍为expected则休眠，直到被_futexWake唤醒；可能虚假唤醒，调用方需循环检查条件
+        inline void _futexWait(std::atomic<int>& word, int expected)
+        {
+#if defined(__linux__)
+            syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+            _ParkingBucket& bucket = mthread::_getParkingBucket(&word);
+            std::unique_lock<std::mutex> lk(bucket.mtx);
+            if (word.load() == expected)
+                bucket.cond.wait(lk);
+#endif
+        }
+
+        //同_futexWait，但最多休眠到deadline时刻
+        inline void _futexWaitUntil(std::atomic<int>& word, int expected, const mtime::TimePoint& deadline)
+        {
+            long long remain_ns = mtime::ns(deadline - mtime::now());
+            if (remain_ns <= 0)
+                return;
+#if defined(__linux__)
+            struct timespec timeout;
+            timeout.tv_sec = static_cast<time_t>(remain_ns / 1000000000);
+            timeout.tv_nsec = static_cast<long>(remain_ns % 1000000000);
+            syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE, expected, &timeout, nullptr, 0);
+#else
+            _ParkingBucket& bucket = mthread::_getParkingBucket(&word);
+            std::unique_lock<std::mutex> lk(bucket.mtx);
+            if (word.load() == expected)
+                bucket.cond.wait_until(lk, deadline);
+#endif
+        }
+
+        //唤醒在word上休眠的线程，num_threads为最多唤醒的线程数；调用前应先修改word的值
+        inline void _futexWake(std::atomic<int>& word, int num_threads)
+        {
+#if defined(__linux__)
+            syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAKE_PRIVATE, num_threads, nullptr, nullptr, 0);
+#else
+            (void)num_threads;
+            _ParkingBucket& bucket = mthread::_getParkingBucket(&word);
+            {
+                std::lock_guard<std::mutex> lk(bucket.mtx);
+            }
+            bucket.cond.notify_all();
+#endif
+        }
+
+
         class SpinLock::Guard
         {
         public:
@@ -238,12 +1478,31 @@ namespace mineutils
 
         inline void SpinLock::lock()
         {
-            while (this->lock_flag_.test_and_set(std::memory_order_acquire)) {}
+            int backoff = 1;
+            while (this->locked_.exchange(true, std::memory_order_acquire))
+            {
+                //只读等待，锁释放前不反复写入缓存行
+                while (this->locked_.load(std::memory_order_relaxed))
+                {
+                    if (backoff <= mthread::_getSpinCount())
+                    {
+                        for (int i = 0; i < backoff; ++i)
+                            mthread::_cpuRelax();
+                        backoff <<= 1;
+                    }
+                    else std::this_thread::yield();
+                }
+            }
+        }
+
+        inline bool SpinLock::tryLock()
+        {
+            return !this->locked_.load(std::memory_order_relaxed) && !this->locked_.exchange(true, std::memory_order_acquire);
         }
 
         inline void SpinLock::unlock()
         {
-            this->lock_flag_.clear(std::memory_order_release);
+            this->locked_.store(false, std::memory_order_release);
         }
 
         inline SpinLock::Guard SpinLock::lockGuard()
@@ -252,437 +1511,6758 @@ namespace mineutils
         }
 
 
-        class ReadWriteMutex::RGuard
+        class TicketSpinLock::Guard
         {
         public:
-            RGuard(RGuard&& tmp) noexcept
+            Guard(Guard&& tmp) noexcept
             {
                 this->self_ = tmp.self_;
                 tmp.self_ = nullptr;
             }
-            ~RGuard()
+
+            ~Guard()
             {
                 if (this->self_)
-                    this->self_->unlockRead();
+                    this->self_->unlock();
             }
+
+            Guard(const Guard& tmp) = delete;
+            Guard& operator=(const Guard& tmp) = delete;
+            Guard& operator=(Guard&& tmp) = delete;
+
         private:
-            RGuard(ReadWriteMutex* self)
+            Guard(TicketSpinLock* self)
             {
                 this->self_ = self;
-                this->self_->lockRead();
+                this->self_->lock();
             }
 
-            ReadWriteMutex* self_ = nullptr;
-            friend ReadWriteMutex;
+            TicketSpinLock* self_ = nullptr;
+            friend TicketSpinLock;
         };
 
-        class ReadWriteMutex::WGuard
+        inline void TicketSpinLock::lock()
+        {
+            unsigned int ticket = this->next_ticket_.fetch_add(1, std::memory_order_relaxed);
+            int num_spins = 0;
+            while (true)
+            {
+                unsigned int num_ahead = ticket - this->serving_ticket_.load(std::memory_order_acquire);
+                if (num_ahead == 0)
+                    return;
+                if (num_spins < mthread::_getSpinCount())
+                {
+                    for (unsigned int i = 0; i < num_ahead; ++i)
+                        mthread::_cpuRelax();
+                    ++num_spins;
+                }
+                else std::this_thread::yield();
+            }
+        }
+
+        inline bool TicketSpinLock::tryLock()
+        {
+            unsigned int serving = this->serving_ticket_.load(std::memory_order_relaxed);
+            unsigned int ticket = serving;
+            return this->next_ticket_.compare_exchange_strong(ticket, serving + 1, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        inline void TicketSpinLock::unlock()
+        {
+            //只有持锁线程写入serving_ticket_
+            this->serving_ticket_.store(this->serving_ticket_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        inline TicketSpinLock::Guard TicketSpinLock::lockGuard()
+        {
+            return TicketSpinLock::Guard(this);
+        }
+
+
+        class HybridMutex::Guard
         {
         public:
-            WGuard(WGuard&& tmp) noexcept
+            Guard(Guard&& tmp) noexcept
             {
                 this->self_ = tmp.self_;
                 tmp.self_ = nullptr;
             }
-            ~WGuard()
+
+            ~Guard()
             {
                 if (this->self_)
-                    this->self_->unlockWrite();
+                    this->self_->unlock();
             }
+
+            Guard(const Guard& tmp) = delete;
+            Guard& operator=(const Guard& tmp) = delete;
+            Guard& operator=(Guard&& tmp) = delete;
+
         private:
-            WGuard(ReadWriteMutex* self)
+            Guard(HybridMutex* self)
             {
                 this->self_ = self;
-                this->self_->lockWrite();
+                this->self_->lock();
             }
 
-            ReadWriteMutex* self_ = nullptr;
-            friend ReadWriteMutex;
+            HybridMutex* self_ = nullptr;
+            friend HybridMutex;
         };
 
-        inline void ReadWriteMutex::lockRead()
-        {
-            std::unique_lock<std::mutex> lk(this->mtx_);
-            while (this->is_writing_)
-                this->cv_.wait(lk);
-            this->num_readers_++;
-        }
-
-        inline void ReadWriteMutex::unlockRead()
+        inline void HybridMutex::lock()
         {
+            int state = 0;
+            if (this->state_.compare_exchange_strong(state, 1, std::memory_order_acquire, std::memory_order_relaxed))
+                return;
+            for (int i = 0; i < mthread::_getSpinCount() && state != 2; ++i)
             {
-                std::lock_guard<std::mutex> lk(this->mtx_);
-                this->num_readers_--;
-                if (this->num_readers_ != 0)
+                mthread::_cpuRelax();
+                state = this->state_.load(std::memory_order_relaxed);
+                if (state == 0 && this->state_.compare_exchange_strong(state, 1, std::memory_order_acquire, std::memory_order_relaxed))
                     return;
             }
-            this->cv_.notify_one();
-        }
-
-        inline ReadWriteMutex::RGuard ReadWriteMutex::lockReadGuard()
-        {
-            return ReadWriteMutex::RGuard(this);
+            //标记为有等待者后休眠，醒来后仍以有等待者的状态加锁，保证解锁时不会漏掉其他休眠的线程
+            while (this->state_.exchange(2, std::memory_order_acquire) != 0)
+                mthread::_futexWait(this->state_, 2);
         }
 
-        inline void ReadWriteMutex::lockWrite()
+        inline bool HybridMutex::tryLock()
         {
-            std::unique_lock<std::mutex> lk(this->mtx_);
-            while (this->is_writing_ || this->num_readers_ != 0)
-                this->cv_.wait(lk);
-            this->is_writing_ = true;
+            int state = 0;
+            return this->state_.compare_exchange_strong(state, 1, std::memory_order_acquire, std::memory_order_relaxed);
         }
 
-        inline void ReadWriteMutex::unlockWrite()
+        inline void HybridMutex::unlock()
         {
-            {
-                std::lock_guard<std::mutex> lk(this->mtx_);
-                this->is_writing_ = false;
-            }
-            this->cv_.notify_all();
+            if (this->state_.exchange(0, std::memory_order_release) == 2)
+                mthread::_futexWake(this->state_, 1);
         }
 
-        inline ReadWriteMutex::WGuard ReadWriteMutex::lockWriteGuard()
+        inline HybridMutex::Guard HybridMutex::lockGuard()
         {
-            return ReadWriteMutex::WGuard(this);
+            return HybridMutex::Guard(this);
         }
 
 
-        template<class Ret>
-        inline TaskRetState<Ret>::TaskRetState(std::future<Ret>&& future_state) noexcept
+        template<class T>
+        inline SPSCChannel<T>::SPSCChannel(size_t capacity, mthread::OverflowPolicy policy)
         {
-            this->future_state_ = std::move(future_state);
+            if (capacity < 1)
+            {
+                mprintfW("Invalid param value capacity:%llu, which will be set to 1.\n", static_cast<unsigned long long>(capacity));
+                capacity = 1;
+            }
+            this->capacity_ = capacity;
+            this->policy_ = policy;
+            //覆盖模式多留一个槽位，使生产者写入的槽位通常不是消费者正在读取的槽位
+            size_t num_slots = 1;
+            while (num_slots < capacity + (policy == mthread::OverflowPolicy::OverwriteOldest ? 1 : 0))
+                num_slots <<= 1;
+            this->mask_ = num_slots - 1;
+            this->slots_.reset(new Storage[num_slots]);
+            this->head_.store(0, std::memory_order_relaxed);
+            this->reading_pos_.store(0, std::memory_order_relaxed);
+            this->tail_.store(0, std::memory_order_relaxed);
+            this->num_dropped_.store(0, std::memory_order_relaxed);
         }
 
-        template<class Ret>
-        inline TaskRetState<Ret>::TaskRetState(TaskRetState<Ret>&& tmp_state) noexcept
+        template<class T>
+        inline SPSCChannel<T>::~SPSCChannel()
         {
-            *this = std::move(tmp_state);
+            size_t tail = this->tail_.load();
+            for (size_t pos = this->head_.load(); pos != tail; ++pos)
+                this->slotAt(pos)->~T();
         }
 
-        template<class Ret>
-        inline TaskRetState<Ret>& TaskRetState<Ret>::operator=(TaskRetState<Ret>&& tmp_state) noexcept
+        template<class T>
+        inline T* SPSCChannel<T>::slotAt(size_t pos)
         {
-            this->future_state_ = std::move(tmp_state.future_state_);
-            return *this;
+            return reinterpret_cast<T*>(&this->slots_[pos & this->mask_]);
         }
 
-        template<class Ret>
-        inline bool TaskRetState<Ret>::valid()
+        template<class T>
+        inline bool SPSCChannel<T>::makeRoom(size_t tail)
         {
-            return this->future_state_.valid();
+            size_t head = this->head_.load(std::memory_order_acquire);
+            if (tail - head < this->capacity_)
+                return true;
+            if (this->policy_ == mthread::OverflowPolicy::Reject)
+                return false;
+            //与消费者竞争最旧的元素，竞争失败说明它已被取走，同样腾出了位置
+            if (this->head_.compare_exchange_strong(head, head + 1, std::memory_order_acq_rel))
+            {
+                this->slotAt(head)->~T();
+                this->num_dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+            //将写入的槽位上一次存放的元素若正被消费者取出，等待其完成
+            if (tail > this->mask_)
+            {
+                while (this->reading_pos_.load(std::memory_order_acquire) == tail - this->mask_)
+                    mthread::_cpuRelax();
+            }
+            return true;
         }
 
-        template<class Ret>
-        inline bool TaskRetState<Ret>::finished()
+        template<class T>
+        template<class U>
+        inline bool SPSCChannel<T>::pushImpl(U&& value)
         {
-            if (this->future_state_.valid())
-                return this->future_state_.wait_for(std::chrono::nanoseconds(0)) == std::future_status::ready;
-            mprintfW("Task is invalid, so the function returns value:true!\n");
+            size_t tail = this->tail_.load(std::memory_order_relaxed);
+            if (!this->makeRoom(tail))
+                return false;
+            new (this->slotAt(tail)) T(std::forward<U>(value));
+            this->tail_.store(tail + 1, std::memory_order_release);
             return true;
         }
 
-        template<class Ret>
-        inline void TaskRetState<Ret>::wait()
+        template<class T>
+        inline bool SPSCChannel<T>::tryPush(const T& value)
         {
-            if (this->future_state_.valid())
-                this->future_state_.wait();
-            else mprintfW("Task is invalid, so the function returns directly!\n");
+            return this->pushImpl(value);
         }
 
-        template<class Ret>
-        inline Ret TaskRetState<Ret>::get()
+        template<class T>
+        inline bool SPSCChannel<T>::tryPush(T&& value)
         {
-            if (this->future_state_.valid())
-                return this->future_state_.get();
-            else throw std::runtime_error("Error: Task is invalid!");
+            return this->pushImpl(std::move(value));
         }
 
-        inline ThreadPool::ThreadPool(int pool_size)
+        template<class T>
+        inline size_t SPSCChannel<T>::pushN(T* values, size_t num)
         {
-            if (pool_size <= 0)
+            if (this->policy_ == mthread::OverflowPolicy::OverwriteOldest)
             {
-                mprintfW("Invalid param value pool_size:%d, which will be set to 1.\n", pool_size);
-                pool_size = 1;
+                for (size_t i = 0; i < num; ++i)
+                    this->pushImpl(std::move(values[i]));
+                return num;
             }
-            this->pool_size_ = pool_size;
-            std::queue<std::function<void()>> empty_queue;
-            this->task_queue_.swap(empty_queue);
-            this->need_abort_ = false;
+            size_t tail = this->tail_.load(std::memory_order_relaxed);
+            size_t head = this->head_.load(std::memory_order_acquire);
+            size_t num_push = std::min(num, this->capacity_ - (tail - head));
+            for (size_t i = 0; i < num_push; ++i)
+                new (this->slotAt(tail + i)) T(std::move(values[i]));
+            this->tail_.store(tail + num_push, std::memory_order_release);
+            return num_push;
+        }
 
-            this->work_thds_.resize(pool_size);
-            for (int i = 0; i < pool_size; ++i)
+        template<class T>
+        inline bool SPSCChannel<T>::tryPop(T& value)
+        {
+            size_t head = this->head_.load(std::memory_order_relaxed);
+            if (this->policy_ == mthread::OverflowPolicy::OverwriteOldest)
             {
-                this->work_thds_[i] = std::thread(&ThreadPool::worker, this);
+                //先登记正在读取的位置再占用，生产者覆盖该槽位前会等待读取完成
+                do
+                {
+                    if (head == this->tail_.load(std::memory_order_acquire))
+                    {
+                        this->reading_pos_.store(0, std::memory_order_release);
+                        return false;
+                    }
+                    this->reading_pos_.store(head + 1, std::memory_order_seq_cst);
+                } while (!this->head_.compare_exchange_weak(head, head + 1, std::memory_order_seq_cst, std::memory_order_relaxed));
+                T* slot = this->slotAt(head);
+                value = std::move(*slot);
+                slot->~T();
+                this->reading_pos_.store(0, std::memory_order_release);
+                return true;
             }
+            if (head == this->tail_.load(std::memory_order_acquire))
+                return false;
+            T* slot = this->slotAt(head);
+            value = std::move(*slot);
+            slot->~T();
+            this->head_.store(head + 1, std::memory_order_release);
+            return true;
         }
 
-        inline ThreadPool::~ThreadPool()
+        template<class T>
+        inline size_t SPSCChannel<T>::popN(T* values, size_t num)
         {
+            if (this->policy_ == mthread::OverflowPolicy::OverwriteOldest)
             {
-                std::unique_lock<std::mutex> lk(this->task_mtx_);
-                this->need_abort_ = true;
+                size_t num_pop = 0;
+                while (num_pop < num && this->tryPop(values[num_pop]))
+                    ++num_pop;
+                return num_pop;
             }
-            this->cond_var_.notify_all();
-            for (auto& thd : this->work_thds_)
+            size_t head = this->head_.load(std::memory_order_relaxed);
+            size_t tail = this->tail_.load(std::memory_order_acquire);
+            size_t num_pop = std::min(num, tail - head);
+            for (size_t i = 0; i < num_pop; ++i)
             {
-                if (thd.joinable())
-                    thd.join();
-            } 
-            mprintfN("Destroyed.\n");
+                T* slot = this->slotAt(head + i);
+                values[i] = std::move(*slot);
+                slot->~T();
+            }
+            this->head_.store(head + num_pop, std::memory_order_release);
+            return num_pop;
+        }
+
+        template<class T>
+        inline size_t SPSCChannel<T>::size() const
+        {
+            size_t head = this->head_.load(std::memory_order_acquire);
+            size_t tail = this->tail_.load(std::memory_order_acquire);
+            return tail > head ? tail - head : 0;
+        }
+
+        template<class T>
+        inline bool SPSCChannel<T>::empty() const
+        {
+            return this->size() == 0;
+        }
+
+        template<class T>
+        inline size_t SPSCChannel<T>::capacity() const
+        {
+            return this->capacity_;
+        }
+
+        template<class T>
+        inline unsigned long long SPSCChannel<T>::droppedCount() const
+        {
+            return this->num_dropped_.load(std::memory_order_relaxed);
+        }
+
+
+        class ReadWriteMutex::RGuard
+        {
+        public:
+            RGuard(RGuard&& tmp) noexcept
+            {
+                this->self_ = tmp.self_;
+                tmp.self_ = nullptr;
+            }
+            ~RGuard()
+            {
+                if (this->self_)
+                    this->self_->unlockRead();
+            }
+        private:
+            RGuard(ReadWriteMutex* self)
+            {
+                this->self_ = self;
+                this->self_->lockRead();
+            }
+
+            ReadWriteMutex* self_ = nullptr;
+            friend ReadWriteMutex;
+        };
+
+        class ReadWriteMutex::WGuard
+        {
+        public:
+            WGuard(WGuard&& tmp) noexcept
+            {
+                this->self_ = tmp.self_;
+                tmp.self_ = nullptr;
+            }
+            ~WGuard()
+            {
+                if (this->self_)
+                    this->self_->unlockWrite();
+            }
+        private:
+            WGuard(ReadWriteMutex* self)
+            {
+                this->self_ = self;
+                this->self_->lockWrite();
+            }
+
+            ReadWriteMutex* self_ = nullptr;
+            friend ReadWriteMutex;
+        };
+
+        inline ReadWriteMutex::ReadWriteMutex(mthread::LockPreference preference)
+        {
+            this->preference_ = preference;
+        }
+
+        inline bool ReadWriteMutex::canRead() const
+        {
+            return !this->is_writing_ && (this->preference_ == mthread::LockPreference::PreferReader || this->num_waiting_writers_ == 0);
+        }
+
+        inline void ReadWriteMutex::lockRead()
+        {
+            std::unique_lock<std::mutex> lk(this->mtx_);
+            while (!this->canRead())
+                this->read_cond_.wait(lk);
+            this->num_readers_++;
+        }
+
+        inline bool ReadWriteMutex::tryLockRead()
+        {
+            std::lock_guard<std::mutex> lk(this->mtx_);
+            if (!this->canRead())
+                return false;
+            this->num_readers_++;
+            return true;
+        }
+
+        inline bool ReadWriteMutex::tryLockReadFor(const mtime::Duration& timeout)
+        {
+            return this->tryLockReadUntil(mtime::now() + timeout);
+        }
+
+        inline bool ReadWriteMutex::tryLockReadUntil(const mtime::TimePoint& deadline)
+        {
+            std::unique_lock<std::mutex> lk(this->mtx_);
+            while (!this->canRead())
+            {
+                if (this->read_cond_.wait_until(lk, deadline) == std::cv_status::timeout && !this->canRead())
+                    return false;
+            }
+            this->num_readers_++;
+            return true;
+        }
+
+        inline void ReadWriteMutex::unlockRead()
+        {
+            {
+                std::lock_guard<std::mutex> lk(this->mtx_);
+                this->num_readers_--;
+                if (this->num_readers_ != 0 || this->num_waiting_writers_ == 0)
+                    return;
+            }
+            this->write_cond_.notify_one();
+        }
+
+        inline ReadWriteMutex::RGuard ReadWriteMutex::lockReadGuard()
+        {
+            return ReadWriteMutex::RGuard(this);
+        }
+
+        inline void ReadWriteMutex::lockWrite()
+        {
+            std::unique_lock<std::mutex> lk(this->mtx_);
+            this->num_waiting_writers_++;
+            while (this->is_writing_ || this->num_readers_ != 0)
+                this->write_cond_.wait(lk);
+            this->num_waiting_writers_--;
+            this->is_writing_ = true;
+        }
+
+        inline bool ReadWriteMutex::tryLockWrite()
+        {
+            std::lock_guard<std::mutex> lk(this->mtx_);
+            if (this->is_writing_ || this->num_readers_ != 0)
+                return false;
+            this->is_writing_ = true;
+            return true;
+        }
+
+        inline bool ReadWriteMutex::tryLockWriteFor(const mtime::Duration& timeout)
+        {
+            return this->tryLockWriteUntil(mtime::now() + timeout);
+        }
+
+        inline bool ReadWriteMutex::tryLockWriteUntil(const mtime::TimePoint& deadline)
+        {
+            std::unique_lock<std::mutex> lk(this->mtx_);
+            this->num_waiting_writers_++;
+            while (this->is_writing_ || this->num_readers_ != 0)
+            {
+                if (this->write_cond_.wait_until(lk, deadline) == std::cv_status::timeout && (this->is_writing_ || this->num_readers_ != 0))
+                {
+                    //写者优先时，本线程的等待可能阻塞了新的读者
+                    this->num_waiting_writers_--;
+                    bool wake_readers = this->canRead();
+                    lk.unlock();
+                    if (wake_readers)
+                        this->read_cond_.notify_all();
+                    return false;
+                }
+            }
+            this->num_waiting_writers_--;
+            this->is_writing_ = true;
+            return true;
+        }
+
+        inline void ReadWriteMutex::unlockWrite()
+        {
+            bool wake_writer;
+            {
+                std::lock_guard<std::mutex> lk(this->mtx_);
+                this->is_writing_ = false;
+                wake_writer = this->num_waiting_writers_ != 0;
+            }
+            if (wake_writer)
+                this->write_cond_.notify_one();
+            //写者优先且仍有写者等待时读者无法加锁，不需要唤醒
+            if (!wake_writer || this->preference_ == mthread::LockPreference::PreferReader)
+                this->read_cond_.notify_all();
+        }
+
+        inline ReadWriteMutex::WGuard ReadWriteMutex::lockWriteGuard()
+        {
+            return ReadWriteMutex::WGuard(this);
+        }
+
+
+        class ScalableReadWriteMutex::RGuard
+        {
+        public:
+            RGuard(RGuard&& tmp) noexcept
+            {
+                this->num_readers_ = tmp.num_readers_;
+                tmp.num_readers_ = nullptr;
+            }
+            ~RGuard()
+            {
+                //释放加锁时的计数槽，RGuard被移动到其他线程析构时也不会减错槽
+                if (this->num_readers_)
+                    this->num_readers_->fetch_sub(1, std::memory_order_release);
+            }
+        private:
+            RGuard(ScalableReadWriteMutex* self)
+            {
+                this->num_readers_ = &self->reader_slots_[mthread::_getReaderSlotIndex()].num_readers;
+                self->enterRead(*this->num_readers_);
+            }
+
+            std::atomic<int>* num_readers_ = nullptr;
+            friend ScalableReadWriteMutex;
+        };
+
+        class ScalableReadWriteMutex::WGuard
+        {
+        public:
+            WGuard(WGuard&& tmp) noexcept
+            {
+                this->self_ = tmp.self_;
+                tmp.self_ = nullptr;
+            }
+            ~WGuard()
+            {
+                if (this->self_)
+                    this->self_->unlockWrite();
+            }
+        private:
+            WGuard(ScalableReadWriteMutex* self)
+            {
+                this->self_ = self;
+                this->self_->lockWrite();
+            }
+
+            ScalableReadWriteMutex* self_ = nullptr;
+            friend ScalableReadWriteMutex;
+        };
+
+        inline bool ScalableReadWriteMutex::tryEnterRead(std::atomic<int>& num_readers)
+        {
+            //先登记读者再检查写者，与写者先设置标记再检查读者计数相对应，两边都使用顺序一致的内存序
+            num_readers.fetch_add(1);
+            if (this->writer_state_.load() == 0)
+                return true;
+            num_readers.fetch_sub(1, std::memory_order_release);
+            return false;
+        }
+
+        inline void ScalableReadWriteMutex::enterRead(std::atomic<int>& num_readers)
+        {
+            while (!this->tryEnterRead(num_readers))
+                this->waitWriterFree(nullptr);
+        }
+
+        inline bool ScalableReadWriteMutex::waitWriterFree(const mtime::TimePoint* deadline)
+        {
+            int num_spins = 0;
+            while (true)
+            {
+                int state = this->writer_state_.load(std::memory_order_relaxed);
+                if (state == 0)
+                    return true;
+                if (deadline && mtime::now() >= *deadline)
+                    return false;
+                if (num_spins < mthread::_getSpinCount())
+                {
+                    mthread::_cpuRelax();
+                    ++num_spins;
+                    continue;
+                }
+                if (state == 1 && !this->writer_state_.compare_exchange_weak(state, 2, std::memory_order_relaxed))
+                    continue;
+                if (deadline)
+                    mthread::_futexWaitUntil(this->writer_state_, 2, *deadline);
+                else mthread::_futexWait(this->writer_state_, 2);
+            }
+        }
+
+        inline bool ScalableReadWriteMutex::acquireWriterFlag(const mtime::TimePoint* deadline)
+        {
+            int state = 0;
+            while (!this->writer_state_.compare_exchange_weak(state, 1))
+            {
+                if (!this->waitWriterFree(deadline))
+                    return false;
+                state = 0;
+            }
+            return true;
+        }
+
+        inline void ScalableReadWriteMutex::lockRead()
+        {
+            this->enterRead(this->reader_slots_[mthread::_getReaderSlotIndex()].num_readers);
+        }
+
+        inline bool ScalableReadWriteMutex::tryLockRead()
+        {
+            return this->tryEnterRead(this->reader_slots_[mthread::_getReaderSlotIndex()].num_readers);
+        }
+
+        inline bool ScalableReadWriteMutex::tryLockReadFor(const mtime::Duration& timeout)
+        {
+            return this->tryLockReadUntil(mtime::now() + timeout);
+        }
+
+        inline bool ScalableReadWriteMutex::tryLockReadUntil(const mtime::TimePoint& deadline)
+        {
+            std::atomic<int>& num_readers = this->reader_slots_[mthread::_getReaderSlotIndex()].num_readers;
+            while (!this->tryEnterRead(num_readers))
+            {
+                if (!this->waitWriterFree(&deadline))
+                    return false;
+            }
+            return true;
+        }
+
+        inline void ScalableReadWriteMutex::unlockRead()
+        {
+            this->reader_slots_[mthread::_getReaderSlotIndex()].num_readers.fetch_sub(1, std::memory_order_release);
+        }
+
+        inline ScalableReadWriteMutex::RGuard ScalableReadWriteMutex::lockReadGuard()
+        {
+            return ScalableReadWriteMutex::RGuard(this);
+        }
+
+        inline void ScalableReadWriteMutex::lockWrite()
+        {
+            this->acquireWriterFlag(nullptr);
+            //设置写者标记后新的读者不会再进入，等待已有读者退出
+            for (ReaderSlot& slot : this->reader_slots_)
+            {
+                for (int num_spins = 0; slot.num_readers.load() != 0; ++num_spins)
+                {
+                    if (num_spins < mthread::_getSpinCount())
+                        mthread::_cpuRelax();
+                    else std::this_thread::yield();
+                }
+            }
+        }
+
+        inline bool ScalableReadWriteMutex::tryLockWrite()
+        {
+            int state = 0;
+            if (!this->writer_state_.compare_exchange_strong(state, 1))
+                return false;
+            for (ReaderSlot& slot : this->reader_slots_)
+            {
+                if (slot.num_readers.load() != 0)
+                {
+                    this->unlockWrite();
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        inline bool ScalableReadWriteMutex::tryLockWriteFor(const mtime::Duration& timeout)
+        {
+            return this->tryLockWriteUntil(mtime::now() + timeout);
+        }
+
+        inline bool ScalableReadWriteMutex::tryLockWriteUntil(const mtime::TimePoint& deadline)
+        {
+            if (!this->acquireWriterFlag(&deadline))
+                return false;
+            for (ReaderSlot& slot : this->reader_slots_)
+            {
+                for (int num_spins = 0; slot.num_readers.load() != 0; ++num_spins)
+                {
+                    if (mtime::now() >= deadline)
+                    {
+                        this->unlockWrite();
+                        return false;
+                    }
+                    if (num_spins < mthread::_getSpinCount())
+                        mthread::_cpuRelax();
+                    else std::this_thread::yield();
+                }
+            }
+            return true;
+        }
+
+        inline void ScalableReadWriteMutex::unlockWrite()
+        {
+            if (this->writer_state_.exchange(0, std::memory_order_release) == 2)
+                mthread::_futexWake(this->writer_state_, std::numeric_limits<int>::max());
+        }
+
+        inline ScalableReadWriteMutex::WGuard ScalableReadWriteMutex::lockWriteGuard()
+        {
+            return ScalableReadWriteMutex::WGuard(this);
+        }
+
+
+        template<class T>
+        class Snapshot<T>::ReadGuard
+        {
+        public:
+            ReadGuard(ReadGuard&& tmp) noexcept
+            {
+                this->num_readers_ = tmp.num_readers_;
+                this->version_ = tmp.version_;
+                tmp.num_readers_ = nullptr;
+            }
+
+            ~ReadGuard()
+            {
+                if (this->num_readers_)
+                    this->num_readers_->fetch_sub(1, std::memory_order_release);
+            }
+
+            const T& operator*() const
+            {
+                return this->version_->value;
+            }
+
+            const T* operator->() const
+            {
+                return &this->version_->value;
+            }
+
+            unsigned long long getVersion() const
+            {
+                return this->version_->version;
+            }
+
+            ReadGuard(const ReadGuard& tmp) = delete;
+            ReadGuard& operator=(const ReadGuard& tmp) = delete;
+            ReadGuard& operator=(ReadGuard&& tmp) = delete;
+
+        private:
+            ReadGuard(const Snapshot<T>* self)
+            {
+                ReaderSlot& slot = self->reader_slots_[mthread::_getReaderSlotIndex()];
+                this->num_readers_ = &slot.num_readers[self->epoch_.load(std::memory_order_relaxed) & 1];
+                //先登记再读取版本指针，与写者先发布再检查计数相对应，两边都使用顺序一致的内存序
+                this->num_readers_->fetch_add(1);
+                this->version_ = self->current_.load();
+            }
+
+            std::atomic<int>* num_readers_ = nullptr;
+            const typename Snapshot<T>::Version* version_ = nullptr;
+            friend Snapshot<T>;
+        };
+
+        template<class T>
+        inline Snapshot<T>::Snapshot() : Snapshot(T())
+        {
+        }
+
+        template<class T>
+        inline Snapshot<T>::Snapshot(T value)
+        {
+            for (ReaderSlot& slot : this->reader_slots_)
+            {
+                slot.num_readers[0] = 0;
+                slot.num_readers[1] = 0;
+            }
+            this->epoch_ = 0;
+            this->current_ = new Version{ std::move(value), 0 };
+        }
+
+        template<class T>
+        inline typename Snapshot<T>::ReadGuard Snapshot<T>::read() const
+        {
+            return Snapshot<T>::ReadGuard(this);
+        }
+
+        template<class T>
+        inline T Snapshot<T>::load() const
+        {
+            auto view = this->read();
+            return *view;
+        }
+
+        template<class T>
+        inline void Snapshot<T>::store(T value)
+        {
+            std::lock_guard<std::mutex> lk(this->write_mtx_);
+            this->publish(new Version{ std::move(value), this->current_.load(std::memory_order_relaxed)->version + 1 });
+        }
+
+        template<class T>
+        template<class Fn>
+        inline void Snapshot<T>::update(Fn&& func)
+        {
+            std::lock_guard<std::mutex> lk(this->write_mtx_);
+            const Version* old_version = this->current_.load(std::memory_order_relaxed);
+            std::unique_ptr<Version> new_version(new Version{ old_version->value, old_version->version + 1 });
+            func(new_version->value);
+            this->publish(new_version.release());
+        }
+
+        template<class T>
+        inline unsigned long long Snapshot<T>::getVersion() const
+        {
+            return this->read().getVersion();
+        }
+
+        template<class T>
+        inline Snapshot<T>::~Snapshot()
+        {
+            delete this->current_.load();
+        }
+
+        template<class T>
+        inline void Snapshot<T>::publish(Version* new_version)
+        {
+            Version* old_version = this->current_.exchange(new_version);
+            //读者可能在翻转前读到旧纪元但稍后才登记，翻转两次并分别等待两个计数归零，才能保证旧版本不再被任何读者持有
+            for (int i = 0; i < 2; ++i)
+            {
+                unsigned int old_epoch = this->epoch_.fetch_add(1);
+                this->waitReaders(old_epoch & 1);
+            }
+            delete old_version;
+        }
+
+        template<class T>
+        inline void Snapshot<T>::waitReaders(int epoch_parity)
+        {
+            for (ReaderSlot& slot : this->reader_slots_)
+            {
+                for (int num_spins = 0; slot.num_readers[epoch_parity].load() != 0; ++num_spins)
+                {
+                    if (num_spins < mthread::_getSpinCount())
+                        mthread::_cpuRelax();
+                    else std::this_thread::yield();
+                }
+            }
+        }
+
+
+        template<class T>
+        struct ObjectPool<T>::Node
+        {
+            Node(T&& tmp_value, unsigned int node_index) : value(std::move(tmp_value)), next(0), index(node_index) {}
+
+            T value;
+            std::atomic<unsigned int> next;   //下一个空闲节点的序号加1，0表示没有
+            unsigned int index;
+        };
+
+        //带版本号的无锁栈，head_低32位为栈顶节点序号加1，高32位为每次修改递增的版本号，避免ABA问题
+        template<class T>
+        struct ObjectPool<T>::FreeList
+        {
+            void push(Node* node)
+            {
+                unsigned long long head = this->head_.load(std::memory_order_relaxed);
+                unsigned long long new_head;
+                do
+                {
+                    node->next.store(static_cast<unsigned int>(head & 0xffffffffULL), std::memory_order_relaxed);
+                    new_head = (((head >> 32) + 1) << 32) | (node->index + 1ULL);
+                } while (!this->head_.compare_exchange_weak(head, new_head, std::memory_order_release, std::memory_order_relaxed));
+                this->size_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            Node* pop(const ObjectPool<T>* pool)
+            {
+                unsigned long long head = this->head_.load(std::memory_order_acquire);
+                Node* node;
+                unsigned long long new_head;
+                do
+                {
+                    if ((head & 0xffffffffULL) == 0)
+                        return nullptr;
+                    //节点从不释放，即使已被其他线程取走，读取next也是安全的，版本号会使这次CAS失败
+                    node = pool->getNode(static_cast<unsigned int>(head & 0xffffffffULL) - 1);
+                    new_head = (((head >> 32) + 1) << 32) | node->next.load(std::memory_order_relaxed);
+                } while (!this->head_.compare_exchange_weak(head, new_head, std::memory_order_acquire, std::memory_order_acquire));
+                this->size_.fetch_sub(1, std::memory_order_relaxed);
+                return node;
+            }
+
+            int size() const
+            {
+                return this->size_.load(std::memory_order_relaxed);
+            }
+
+            std::atomic<unsigned long long> head_{ 0 };
+            std::atomic<int> size_{ 0 };
+            char pad_[MINE_CACHE_LINE_SIZE - sizeof(std::atomic<unsigned long long>) - sizeof(std::atomic<int>)];
+        };
+
+        template<class T>
+        class ObjectPool<T>::Handle
+        {
+        public:
+            Handle() = default;
+
+            Handle(Handle&& tmp) noexcept
+            {
+                this->pool_ = tmp.pool_;
+                this->node_ = tmp.node_;
+                tmp.node_ = nullptr;
+            }
+
+            Handle& operator=(Handle&& tmp) noexcept
+            {
+                if (this != &tmp)
+                {
+                    this->reset();
+                    this->pool_ = tmp.pool_;
+                    this->node_ = tmp.node_;
+                    tmp.node_ = nullptr;
+                }
+                return *this;
+            }
+
+            ~Handle()
+            {
+                this->reset();
+            }
+
+            T& operator*() const
+            {
+                return this->node_->value;
+            }
+
+            T* operator->() const
+            {
+                return &this->node_->value;
+            }
+
+            T* get() const
+            {
+                return this->node_ ? &this->node_->value : nullptr;
+            }
+
+            explicit operator bool() const
+            {
+                return this->node_ != nullptr;
+            }
+
+            //提前将对象归还到池中，之后句柄为空
+            void reset()
+            {
+                if (this->node_)
+                {
+                    this->pool_->release(this->node_);
+                    this->node_ = nullptr;
+                }
+            }
+
+            Handle(const Handle& tmp) = delete;
+            Handle& operator=(const Handle& tmp) = delete;
+
+        private:
+            Handle(ObjectPool<T>* pool, Node* node)
+            {
+                this->pool_ = pool;
+                this->node_ = node;
+            }
+
+            ObjectPool<T>* pool_ = nullptr;
+            Node* node_ = nullptr;
+            friend ObjectPool<T>;
+        };
+
+        template<class T>
+        inline ObjectPool<T>::ObjectPool(std::function<T()> creator, std::function<void(T&)> recycler)
+        {
+            this->creator_ = std::move(creator);
+            this->recycler_ = std::move(recycler);
+            for (auto& chunk : this->chunks_)
+                chunk = nullptr;
+            this->num_created_ = 0;
+            this->free_lists_.reset(new FreeList[MINE_RWLOCK_READER_SLOTS + 1]);
+        }
+
+        template<class T>
+        inline typename ObjectPool<T>::Handle ObjectPool<T>::acquire()
+        {
+            int slot_idx = mthread::_getReaderSlotIndex();
+            Node* node = this->free_lists_[slot_idx].pop(this);
+            if (!node)
+                node = this->free_lists_[MINE_RWLOCK_READER_SLOTS].pop(this);
+            //对象可能被其他线程归还到了它们的空闲链表中，创建新对象前先从中取用，避免生产者-消费者模式下对象数持续增长
+            for (int i = 1; !node && i < MINE_RWLOCK_READER_SLOTS; ++i)
+                node = this->free_lists_[(slot_idx + i) % MINE_RWLOCK_READER_SLOTS].pop(this);
+            if (!node)
+                node = this->createNode();
+            return ObjectPool<T>::Handle(this, node);
+        }
+
+        template<class T>
+        inline void ObjectPool<T>::prewarm(size_t num)
+        {
+            while (this->getNumCreated() < num)
+                this->free_lists_[MINE_RWLOCK_READER_SLOTS].push(this->createNode());
+        }
+
+        template<class T>
+        inline size_t ObjectPool<T>::getNumCreated() const
+        {
+            return this->num_created_.load();
+        }
+
+        template<class T>
+        inline ObjectPool<T>::~ObjectPool()
+        {
+            unsigned int num_created = this->num_created_.load();
+            for (unsigned int i = 0; i < num_created; ++i)
+                this->getNode(i)->~Node();
+            for (auto& chunk : this->chunks_)
+                ::operator delete(chunk.load());
+        }
+
+        template<class T>
+        inline typename ObjectPool<T>::Node* ObjectPool<T>::getNode(unsigned int index) const
+        {
+            unsigned int chunk_idx = 0;
+            unsigned int chunk_size = FIRST_CHUNK_SIZE;
+            while (index >= chunk_size)
+            {
+                index -= chunk_size;
+                chunk_size <<= 1;
+                ++chunk_idx;
+            }
+            return this->chunks_[chunk_idx].load(std::memory_order_acquire) + index;
+        }
+
+        template<class T>
+        inline typename ObjectPool<T>::Node* ObjectPool<T>::createNode()
+        {
+            std::lock_guard<std::mutex> lk(this->grow_mtx_);
+            unsigned int index = this->num_created_.load(std::memory_order_relaxed);
+            unsigned int chunk_idx = 0;
+            unsigned int chunk_size = FIRST_CHUNK_SIZE;
+            unsigned int offset = index;
+            while (offset >= chunk_size)
+            {
+                offset -= chunk_size;
+                chunk_size <<= 1;
+                ++chunk_idx;
+            }
+            if (chunk_idx >= static_cast<unsigned int>(MAX_NUM_CHUNKS))
+                throw std::runtime_error("Error: ObjectPool has too many objects!");
+            Node* chunk = this->chunks_[chunk_idx].load(std::memory_order_relaxed);
+            if (!chunk)
+            {
+                chunk = static_cast<Node*>(::operator new(sizeof(Node) * chunk_size));
+                this->chunks_[chunk_idx].store(chunk, std::memory_order_release);
+            }
+            Node* node = new (chunk + offset) Node(this->creator_ ? this->creator_() : T(), index);
+            this->num_created_.store(index + 1);
+            return node;
+        }
+
+        template<class T>
+        inline void ObjectPool<T>::release(Node* node)
+        {
+            if (this->recycler_)
+                this->recycler_(node->value);
+            FreeList& local_list = this->free_lists_[mthread::_getReaderSlotIndex()];
+            if (local_list.size() < LOCAL_CACHE_SIZE)
+                local_list.push(node);
+            else this->free_lists_[MINE_RWLOCK_READER_SLOTS].push(node);
+        }
+
+
+        template<class T>
+        struct MPMCQueue<T>::Cell
+        {
+            std::atomic<size_t> sequence;
+            typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage;
+        };
+
+        template<class T>
+        inline MPMCQueue<T>::MPMCQueue(size_t capacity)
+        {
+            size_t real_capacity = 2;
+            while (real_capacity < capacity)
+                real_capacity <<= 1;
+            this->mask_ = real_capacity - 1;
+            this->cells_.reset(new MPMCQueue<T>::Cell[real_capacity]);
+            for (size_t i = 0; i < real_capacity; ++i)
+                this->cells_[i].sequence.store(i, std::memory_order_relaxed);
+            this->enqueue_pos_.store(0, std::memory_order_relaxed);
+            this->dequeue_pos_.store(0, std::memory_order_relaxed);
+            this->num_pop_waiters_.store(0);
+            this->num_push_waiters_.store(0);
+        }
+
+        template<class T>
+        inline MPMCQueue<T>::~MPMCQueue()
+        {
+            size_t enqueue_pos = this->enqueue_pos_.load();
+            for (size_t pos = this->dequeue_pos_.load(); pos != enqueue_pos; ++pos)
+                reinterpret_cast<T*>(&this->cells_[pos & this->mask_].storage)->~T();
+        }
+
+        template<class T>
+        template<class U>
+        inline bool MPMCQueue<T>::tryPushImpl(U&& value)
+        {
+            MPMCQueue<T>::Cell* cell;
+            size_t pos = this->enqueue_pos_.load(std::memory_order_relaxed);
+            while (true)
+            {
+                cell = &this->cells_[pos & this->mask_];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+                if (diff == 0)
+                {
+                    if (this->enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                    return false;
+                else pos = this->enqueue_pos_.load(std::memory_order_relaxed);
+            }
+            new (&cell->storage) T(std::forward<U>(value));
+            cell->sequence.store(pos + 1, std::memory_order_release);
+            this->notifyPopWaiter();
+            return true;
+        }
+
+        template<class T>
+        inline bool MPMCQueue<T>::tryPush(const T& value)
+        {
+            return this->tryPushImpl(value);
+        }
+
+        template<class T>
+        inline bool MPMCQueue<T>::tryPush(T&& value)
+        {
+            return this->tryPushImpl(std::move(value));
+        }
+
+        template<class T>
+        inline bool MPMCQueue<T>::tryPop(T& value)
+        {
+            MPMCQueue<T>::Cell* cell;
+            size_t pos = this->dequeue_pos_.load(std::memory_order_relaxed);
+            while (true)
+            {
+                cell = &this->cells_[pos & this->mask_];
+                size_t seq = cell->sequence.load(std::memory_order_acquire);
+                std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+                if (diff == 0)
+                {
+                    if (this->dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                    return false;
+                else pos = this->dequeue_pos_.load(std::memory_order_relaxed);
+            }
+            T* stored = reinterpret_cast<T*>(&cell->storage);
+            value = std::move(*stored);
+            stored->~T();
+            cell->sequence.store(pos + this->mask_ + 1, std::memory_order_release);
+            this->notifyPushWaiter();
+            return true;
+        }
+
+        template<class T>
+        template<class U>
+        inline void MPMCQueue<T>::pushImpl(U&& value)
+        {
+            for (int i = 0; i < mthread::_getSpinCount(); ++i)
+            {
+                if (this->tryPushImpl(std::forward<U>(value)))
+                    return;
+                if (i < mthread::_getSpinCount() / 2)
+                    mthread::_cpuRelax();
+                else std::this_thread::yield();
+            }
+            std::unique_lock<std::mutex> lk(this->mtx_);
+            this->num_push_waiters_.fetch_add(1);
+            //与notifyPushWaiter配合：先登记等待者再检查队列，保证不会遗漏唤醒
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (!this->tryPushImpl(std::forward<U>(value)))
+            {
+                this->not_full_cond_.wait(lk);
+            }
+            this->num_push_waiters_.fetch_sub(1);
+        }
+
+        template<class T>
+        inline void MPMCQueue<T>::push(const T& value)
+        {
+            this->pushImpl(value);
+        }
+
+        template<class T>
+        inline void MPMCQueue<T>::push(T&& value)
+        {
+            this->pushImpl(std::move(value));
+        }
+
+        template<class T>
+        inline void MPMCQueue<T>::pop(T& value)
+        {
+            for (int i = 0; i < mthread::_getSpinCount(); ++i)
+            {
+                if (this->tryPop(value))
+                    return;
+                if (i < mthread::_getSpinCount() / 2)
+                    mthread::_cpuRelax();
+                else std::this_thread::yield();
+            }
+            std::unique_lock<std::mutex> lk(this->mtx_);
+            this->num_pop_waiters_.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (!this->tryPop(value))
+            {
+                this->not_empty_cond_.wait(lk);
+            }
+            this->num_pop_waiters_.fetch_sub(1);
+        }
+
+        template<class T>
+        inline void MPMCQueue<T>::notifyPopWaiter()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (this->num_pop_waiters_.load(std::memory_order_relaxed) > 0)
+            {
+                {
+                    std::lock_guard<std::mutex> lk(this->mtx_);
+                }
+                this->not_empty_cond_.notify_one();
+            }
+        }
+
+        template<class T>
+        inline void MPMCQueue<T>::notifyPushWaiter()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (this->num_push_waiters_.load(std::memory_order_relaxed) > 0)
+            {
+                {
+                    std::lock_guard<std::mutex> lk(this->mtx_);
+                }
+                this->not_full_cond_.notify_one();
+            }
+        }
+
+        template<class T>
+        inline size_t MPMCQueue<T>::size() const
+        {
+            size_t enqueue_pos = this->enqueue_pos_.load(std::memory_order_relaxed);
+            size_t dequeue_pos = this->dequeue_pos_.load(std::memory_order_relaxed);
+            return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+        }
+
+        template<class T>
+        inline bool MPMCQueue<T>::empty() const
+        {
+            return this->size() == 0;
+        }
+
+        template<class T>
+        inline size_t MPMCQueue<T>::capacity() const
+        {
+            return this->mask_ + 1;
+        }
+
+
+        //仅支持移动的void()可调用对象，小对象直接构造在内部缓冲区中以避免堆内存分配；非线程安全
+        class _InlineTask
+        {
+        public:
+            _InlineTask() = default;
+
+            template<class Fn, typename std::enable_if<!std::is_same<typename std::decay<Fn>::type, _InlineTask>::value, int>::type = 0>
+            explicit _InlineTask(Fn&& func)
+            {
+                using FnT = typename std::decay<Fn>::type;
+                this->ops_ = &_InlineTask::OpsImpl<FnT, _InlineTask::FitsInline<FnT>::value>::ops;
+                _InlineTask::OpsImpl<FnT, _InlineTask::FitsInline<FnT>::value>::construct(&this->storage_, std::forward<Fn>(func));
+            }
+
+            _InlineTask(_InlineTask&& tmp) noexcept
+            {
+                *this = std::move(tmp);
+            }
+
+            _InlineTask& operator=(_InlineTask&& tmp) noexcept
+            {
+                if (this != &tmp)
+                {
+                    this->reset();
+                    if (tmp.ops_)
+                    {
+                        tmp.ops_->move(&this->storage_, &tmp.storage_);
+                        this->ops_ = tmp.ops_;
+                        tmp.ops_ = nullptr;
+                    }
+                }
+                return *this;
+            }
+
+            ~_InlineTask()
+            {
+                this->reset();
+            }
+
+            void operator()()
+            {
+                this->ops_->invoke(&this->storage_);
+            }
+
+            explicit operator bool() const
+            {
+                return this->ops_ != nullptr;
+            }
+
+            void reset()
+            {
+                if (this->ops_)
+                {
+                    this->ops_->destroy(&this->storage_);
+                    this->ops_ = nullptr;
+                }
+            }
+
+            _InlineTask(const _InlineTask& tmp) = delete;
+            _InlineTask& operator=(const _InlineTask& tmp) = delete;
+
+        private:
+            using Storage = typename std::aligned_storage<MINE_TASK_INLINE_SIZE>::type;
+
+            struct Ops
+            {
+                void (*invoke)(void* storage);
+                void (*move)(void* dst_storage, void* src_storage);
+                void (*destroy)(void* storage);
+            };
+
+            template<class FnT>
+            struct FitsInline : std::integral_constant<bool, sizeof(FnT) <= sizeof(Storage) && std::alignment_of<Storage>::value % std::alignment_of<FnT>::value == 0 && std::is_nothrow_move_constructible<FnT>::value> {};
+
+            template<class FnT, bool is_inline>
+            struct OpsImpl;
+
+            Storage storage_;
+            const Ops* ops_ = nullptr;
+        };
+
+        template<class FnT>
+        struct _InlineTask::OpsImpl<FnT, true>
+        {
+            template<class Fn>
+            static void construct(void* storage, Fn&& func)
+            {
+                new (storage) FnT(std::forward<Fn>(func));
+            }
+            static void invoke(void* storage)
+            {
+                (*static_cast<FnT*>(storage))();
+            }
+            static void move(void* dst_storage, void* src_storage)
+            {
+                new (dst_storage) FnT(std::move(*static_cast<FnT*>(src_storage)));
+                static_cast<FnT*>(src_storage)->~FnT();
+            }
+            static void destroy(void* storage)
+            {
+                static_cast<FnT*>(storage)->~FnT();
+            }
+            static const _InlineTask::Ops ops;
+        };
+
+        template<class FnT>
+        const _InlineTask::Ops _InlineTask::OpsImpl<FnT, true>::ops = { &_InlineTask::OpsImpl<FnT, true>::invoke, &_InlineTask::OpsImpl<FnT, true>::move, &_InlineTask::OpsImpl<FnT, true>::destroy };
+
+        template<class FnT>
+        struct _InlineTask::OpsImpl<FnT, false>
+        {
+            template<class Fn>
+            static void construct(void* storage, Fn&& func)
+            {
+                *static_cast<FnT**>(storage) = new FnT(std::forward<Fn>(func));
+            }
+            static void invoke(void* storage)
+            {
+                (**static_cast<FnT**>(storage))();
+            }
+            static void move(void* dst_storage, void* src_storage)
+            {
+                *static_cast<FnT**>(dst_storage) = *static_cast<FnT**>(src_storage);
+            }
+            static void destroy(void* storage)
+            {
+                delete *static_cast<FnT**>(storage);
+            }
+            static const _InlineTask::Ops ops;
+        };
+
+        template<class FnT>
+        const _InlineTask::Ops _InlineTask::OpsImpl<FnT, false>::ops = { &_InlineTask::OpsImpl<FnT, false>::invoke, &_InlineTask::OpsImpl<FnT, false>::move, &_InlineTask::OpsImpl<FnT, false>::destroy };
+
+
+        //预分配槽位的环形任务队列，两端均可取出，容量不足时翻倍扩容，稳定运行后不再分配内存；非线程安全
+        class _TaskRing
+        {
+        public:
+            explicit _TaskRing(size_t init_capacity = 64)
+            {
+                size_t capacity = 1;
+                while (capacity < init_capacity)
+                    capacity <<= 1;
+                this->slots_.resize(capacity);
+            }
+
+            bool empty() const
+            {
+                return this->size_ == 0;
+            }
+
+            size_t size() const
+            {
+                return this->size_;
+            }
+
+            void pushBack(_InlineTask&& task)
+            {
+                if (this->size_ == this->slots_.size())
+                    this->grow();
+                this->slots_[(this->head_ + this->size_) & (this->slots_.size() - 1)] = std::move(task);
+                this->size_++;
+            }
+
+            bool popFront(_InlineTask& task)
+            {
+                if (this->size_ == 0)
+                    return false;
+                task = std::move(this->slots_[this->head_]);
+                this->head_ = (this->head_ + 1) & (this->slots_.size() - 1);
+                this->size_--;
+                return true;
+            }
+
+            bool popBack(_InlineTask& task)
+            {
+                if (this->size_ == 0)
+                    return false;
+                this->size_--;
+                task = std::move(this->slots_[(this->head_ + this->size_) & (this->slots_.size() - 1)]);
+                return true;
+            }
+
+            void clear()
+            {
+                _InlineTask task;
+                while (this->popFront(task))
+                    task.reset();
+            }
+
+            void swap(_TaskRing& other)
+            {
+                this->slots_.swap(other.slots_);
+                std::swap(this->head_, other.head_);
+                std::swap(this->size_, other.size_);
+            }
+
+        private:
+            void grow()
+            {
+                std::vector<_InlineTask> new_slots(this->slots_.size() * 2);
+                for (size_t i = 0; i < this->size_; ++i)
+                    new_slots[i] = std::move(this->slots_[(this->head_ + i) & (this->slots_.size() - 1)]);
+                this->slots_.swap(new_slots);
+                this->head_ = 0;
+            }
+
+            std::vector<_InlineTask> slots_;
+            size_t head_ = 0;
+            size_t size_ = 0;
+        };
+
+        /*  按紧急程度排序的任务堆，非线程安全
+            级别0为带截止时间的任务，按截止时间排序；其余级别数值越小越紧急，同级别内先进先出  */
+        class _PriorityTaskQueue
+        {
+        public:
+            static const int DEADLINE_LEVEL = 0;
+            static const int NUM_LEVELS = 4;
+
+            static int levelOf(mthread::TaskPriority priority)
+            {
+                return static_cast<int>(priority) + 1;
+            }
+
+            class Entry
+            {
+            public:
+                int level;
+                mtime::TimePoint deadline;
+                mtime::TimePoint enqueue_t;
+                unsigned long long seq;
+                _InlineTask task;
+            };
+
+            bool empty() const
+            {
+                return this->heap_.empty();
+            }
+
+            //获取最紧急任务的级别，队列为空时返回NUM_LEVELS
+            int topLevel() const
+            {
+                return this->heap_.empty() ? NUM_LEVELS : this->heap_.front().level;
+            }
+
+            void push(int level, const mtime::TimePoint& deadline, const mtime::TimePoint& enqueue_t, _InlineTask&& task)
+            {
+                this->heap_.emplace_back();
+                Entry& entry = this->heap_.back();
+                entry.level = level;
+                entry.deadline = deadline;
+                entry.enqueue_t = enqueue_t;
+                entry.seq = this->next_seq_++;
+                entry.task = std::move(task);
+                std::push_heap(this->heap_.begin(), this->heap_.end(), &_PriorityTaskQueue::lessUrgent);
+            }
+
+            void pop(Entry& entry)
+            {
+                std::pop_heap(this->heap_.begin(), this->heap_.end(), &_PriorityTaskQueue::lessUrgent);
+                entry = std::move(this->heap_.back());
+                this->heap_.pop_back();
+            }
+
+            void clear()
+            {
+                this->heap_.clear();
+            }
+
+        private:
+            static bool lessUrgent(const Entry& a, const Entry& b)
+            {
+                if (a.level != b.level)
+                    return a.level > b.level;
+                if (a.level == DEADLINE_LEVEL && a.deadline != b.deadline)
+                    return a.deadline > b.deadline;
+                return a.seq > b.seq;
+            }
+
+            std::vector<Entry> heap_;
+            unsigned long long next_seq_ = 0;
+        };
+
+
+        //池化的任务结果状态中与返回类型无关的部分，引用计数归零后回收到对应类型的对象池中
+        class _TaskResultBase
+        {
+        public:
+            bool ready() const
+            {
+                return this->ready_.load(std::memory_order_acquire);
+            }
+
+            void wait()
+            {
+                if (this->ready())
+                    return;
+                std::unique_lock<std::mutex> lk(this->mtx_);
+                this->num_waiters_.fetch_add(1);
+                while (!this->ready_.load())
+                {
+                    this->cond_.wait(lk);
+                }
+                this->num_waiters_.fetch_sub(1);
+            }
+
+            void setException(std::exception_ptr exception)
+            {
+                this->exception_ = std::move(exception);
+                this->markReady();
+            }
+
+            void addRef()
+            {
+                this->num_refs_.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            mthread::ThreadPool* getOwner() const
+            {
+                return this->owner_;
+            }
+
+            void setCancelFlag(const std::shared_ptr<std::atomic<bool>>& cancel_flag)
+            {
+                this->cancel_flag_ = cancel_flag;
+            }
+
+            void setEnqueueTime(const mtime::TimePoint& enqueue_t)
+            {
+                this->enqueue_t_ = enqueue_t;
+            }
+
+            //开启了耗时统计时，将排队等待时间计入执行本任务的工作线程的统计
+            void recordQueueWait() const;
+
+            //任务未开始时将其标记为已取消并结束，等待者和后续任务得到TaskCancelledError异常
+            bool cancel()
+            {
+                int state = _TaskResultBase::PENDING;
+                if (!this->run_state_.compare_exchange_strong(state, _TaskResultBase::CANCELLED))
+                    return false;
+                this->setException(std::make_exception_ptr(mthread::TaskCancelledError()));
+                return true;
+            }
+
+            //执行任务前调用，返回false表示任务已被取消，不应执行
+            bool tryStart()
+            {
+                if (this->cancel_flag_ && this->cancel_flag_->load(std::memory_order_acquire))
+                {
+                    this->cancel();
+                    return false;
+                }
+                int state = _TaskResultBase::PENDING;
+                return this->run_state_.compare_exchange_strong(state, _TaskResultBase::STARTED);
+            }
+
+            void setOwner(mthread::ThreadPool* owner)
+            {
+                this->owner_ = owner;
+            }
+
+            /*  注册任务结束后的后续任务，已结束时立即执行或提交
+                @param continuation: 后续任务
+                @param run_inline: 为true时在结束任务的线程中直接执行，否则提交到owner线程池
+                @return 已注册过后续任务时返回false  */
+            bool setContinuation(mthread::_InlineTask&& continuation, bool run_inline)
+            {
+                {
+                    std::lock_guard<std::mutex> lk(this->mtx_);
+                    if (this->has_continuation_.load())
+                        return false;
+                    //与markReady中先标记结束再检查后续任务的顺序配合，保证后续任务恰好被触发一次
+                    this->has_continuation_.store(true);
+                    if (!this->ready_.load())
+                    {
+                        this->continuation_ = std::move(continuation);
+                        this->continuation_inline_ = run_inline;
+                        return true;
+                    }
+                }
+                this->dispatchContinuation(continuation, run_inline);
+                return true;
+            }
+
+        protected:
+            _TaskResultBase() = default;
+
+            void markReady()
+            {
+                //与wait中先登记等待再检查状态的顺序配合，无等待者和后续任务时跳过加锁和通知
+                this->ready_.store(true);
+                if (this->num_waiters_.load() > 0 || this->has_continuation_.load())
+                {
+                    mthread::_InlineTask continuation;
+                    bool run_inline;
+                    {
+                        std::lock_guard<std::mutex> lk(this->mtx_);
+                        continuation = std::move(this->continuation_);
+                        run_inline = this->continuation_inline_;
+                    }
+                    this->cond_.notify_all();
+                    if (continuation)
+                        this->dispatchContinuation(continuation, run_inline);
+                }
+            }
+
+            void dispatchContinuation(mthread::_InlineTask& continuation, bool run_inline)
+            {
+                if (run_inline || this->owner_ == nullptr)
+                    continuation();
+                else this->owner_->pushTask(std::move(continuation));
+            }
+
+            void rethrowIfFailed()
+            {
+                if (this->exception_)
+                    std::rethrow_exception(this->exception_);
+            }
+
+            void resetBase()
+            {
+                this->exception_ = nullptr;
+                this->cancel_flag_.reset();
+                this->enqueue_t_ = mtime::TimePoint();
+                this->run_state_.store(_TaskResultBase::PENDING, std::memory_order_relaxed);
+                this->owner_ = nullptr;
+                this->continuation_.reset();
+                this->has_continuation_.store(false, std::memory_order_relaxed);
+                this->ready_.store(false, std::memory_order_relaxed);
+            }
+
+            std::atomic<int> num_refs_{ 0 };
+            std::atomic<bool> ready_{ false };
+            std::atomic<int> num_waiters_{ 0 };
+            std::mutex mtx_;
+            std::condition_variable cond_;
+            std::exception_ptr exception_;
+
+            mthread::ThreadPool* owner_ = nullptr;
+            std::atomic<bool> has_continuation_{ false };
+
+            static const int PENDING = 0;
+            static const int STARTED = 1;
+            static const int CANCELLED = 2;
+            std::atomic<int> run_state_{ PENDING };
+            std::shared_ptr<std::atomic<bool>> cancel_flag_;
+            mtime::TimePoint enqueue_t_;
+            mthread::_InlineTask continuation_;
+            bool continuation_inline_ = false;
+
+            _TaskResultBase(const _TaskResultBase& tmp) = delete;
+            _TaskResultBase& operator=(const _TaskResultBase& tmp) = delete;
+        };
+
+        //某一返回类型的任务结果状态对象池，进程内共享，对象只回收不释放；线程安全
+        template<class ResultT>
+        class _TaskResultPool
+        {
+        public:
+            static ResultT* acquire()
+            {
+                _TaskResultPool& pool = _TaskResultPool::getInstance();
+                {
+                    auto guard = pool.lock_.lockGuard();
+                    if (pool.free_head_)
+                    {
+                        ResultT* result = pool.free_head_;
+                        pool.free_head_ = result->next_free_;
+                        result->next_free_ = nullptr;
+                        return result;
+                    }
+                }
+                return new ResultT;
+            }
+
+            static void recycle(ResultT* result)
+            {
+                _TaskResultPool& pool = _TaskResultPool::getInstance();
+                auto guard = pool.lock_.lockGuard();
+                result->next_free_ = pool.free_head_;
+                pool.free_head_ = result;
+            }
+
+        private:
+            static _TaskResultPool& getInstance()
+            {
+                //有意不释放，避免静态对象析构顺序导致进程退出时仍在使用的结果状态失效
+                static _TaskResultPool* pool = new _TaskResultPool;
+                return *pool;
+            }
+
+            mthread::SpinLock lock_;
+            ResultT* free_head_ = nullptr;
+        };
+
+        template<class Ret>
+        class _TaskResult :public _TaskResultBase
+        {
+        public:
+            using ValueT = typename std::remove_cv<Ret>::type;
+
+            static _TaskResult* create()
+            {
+                _TaskResult* result = _TaskResultPool<_TaskResult>::acquire();
+                result->num_refs_.store(1, std::memory_order_relaxed);
+                return result;
+            }
+
+            void release()
+            {
+                if (this->num_refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    if (this->has_value_)
+                    {
+                        reinterpret_cast<ValueT*>(&this->storage_)->~ValueT();
+                        this->has_value_ = false;
+                    }
+                    this->resetBase();
+                    _TaskResultPool<_TaskResult>::recycle(this);
+                }
+            }
+
+            template<class BindT>
+            void run(BindT& bind_func)
+            {
+                new (&this->storage_) ValueT(bind_func());
+                this->has_value_ = true;
+                this->markReady();
+            }
+
+            Ret get()
+            {
+                this->wait();
+                this->rethrowIfFailed();
+                return *reinterpret_cast<ValueT*>(&this->storage_);
+            }
+
+        private:
+            typename std::aligned_storage<sizeof(ValueT), std::alignment_of<ValueT>::value>::type storage_;
+            bool has_value_ = false;
+            _TaskResult* next_free_ = nullptr;
+            friend class _TaskResultPool<_TaskResult>;
+        };
+
+        template<class Ret>
+        class _TaskResult<Ret&> :public _TaskResultBase
+        {
+        public:
+            static _TaskResult* create()
+            {
+                _TaskResult* result = _TaskResultPool<_TaskResult>::acquire();
+                result->num_refs_.store(1, std::memory_order_relaxed);
+                return result;
+            }
+
+            void release()
+            {
+                if (this->num_refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    this->value_ = nullptr;
+                    this->resetBase();
+                    _TaskResultPool<_TaskResult>::recycle(this);
+                }
+            }
+
+            template<class BindT>
+            void run(BindT& bind_func)
+            {
+                this->value_ = &bind_func();
+                this->markReady();
+            }
+
+            Ret& get()
+            {
+                this->wait();
+                this->rethrowIfFailed();
+                return *this->value_;
+            }
+
+        private:
+            Ret* value_ = nullptr;
+            _TaskResult* next_free_ = nullptr;
+            friend class _TaskResultPool<_TaskResult>;
+        };
+
+        template<>
+        class _TaskResult<void> :public _TaskResultBase
+        {
+        public:
+            static _TaskResult* create()
+            {
+                _TaskResult* result = _TaskResultPool<_TaskResult>::acquire();
+                result->num_refs_.store(1, std::memory_order_relaxed);
+                return result;
+            }
+
+            void release()
+            {
+                if (this->num_refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    this->resetBase();
+                    _TaskResultPool<_TaskResult>::recycle(this);
+                }
+            }
+
+            template<class BindT>
+            void run(BindT& bind_func)
+            {
+                bind_func();
+                this->markReady();
+            }
+
+            void get()
+            {
+                this->wait();
+                this->rethrowIfFailed();
+            }
+
+        private:
+            _TaskResult* next_free_ = nullptr;
+            friend class _TaskResultPool<_TaskResult>;
+        };
+
+        //只由一个线程写入的耗时直方图，其他线程可以同时宽松读取
+        //样本在LatencyHistogram中所属的桶序号
+        inline int _getLatencyBucketIndex(long long ns)
+        {
+            if (ns < 0)
+                return 0;
+            int idx = 0;
+            for (unsigned long long bound = 1; idx < LatencyHistogram::NUM_BUCKETS - 1 && static_cast<unsigned long long>(ns) >= bound; bound <<= 1)
+                ++idx;
+            return idx;
+        }
+
+        class _LatencyRecorder
+        {
+        public:
+            void record(long long ns)
+            {
+                this->increase(this->buckets_[mthread::_getLatencyBucketIndex(ns)], 1);
+                this->increase(this->count_, 1);
+                this->increase(this->total_ns_, ns);
+                if (ns > this->max_ns_.load(std::memory_order_relaxed))
+                    this->max_ns_.store(ns, std::memory_order_relaxed);
+            }
+
+            //将数据累加到hist中
+            void mergeTo(mthread::LatencyHistogram& hist) const
+            {
+                for (int i = 0; i < LatencyHistogram::NUM_BUCKETS; ++i)
+                    hist.buckets[i] += this->buckets_[i].load(std::memory_order_relaxed);
+                hist.count += this->count_.load(std::memory_order_relaxed);
+                hist.total_ns += this->total_ns_.load(std::memory_order_relaxed);
+                hist.max_ns = std::max(hist.max_ns, this->max_ns_.load(std::memory_order_relaxed));
+            }
+
+        private:
+            //只有一个写入者，不需要原子的读-改-写
+            static void increase(std::atomic<long long>& value, long long delta)
+            {
+                value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+            }
+
+            std::atomic<long long> buckets_[LatencyHistogram::NUM_BUCKETS] = {};
+            std::atomic<long long> count_{ 0 };
+            std::atomic<long long> total_ns_{ 0 };
+            std::atomic<long long> max_ns_{ 0 };
+        };
+
+        //ThreadPool单个工作线程的统计数据，前后填充以独占缓存行
+        class _WorkerStats
+        {
+        public:
+            char pad0_[MINE_CACHE_LINE_SIZE];
+            std::atomic<long long> num_completed{ 0 };
+            std::atomic<long long> busy_ns{ 0 };
+            mthread::_LatencyRecorder queue_wait;
+            mthread::_LatencyRecorder run_time;
+            char pad1_[MINE_CACHE_LINE_SIZE];
+        };
+
+        struct _PoolWorkerTag
+        {
+            const ThreadPool* pool = nullptr;
+            int worker_idx = -1;
+            mthread::_WorkerStats* stats = nullptr;
+        };
+
+        /*  当前线程所属的线程池及序号
+            不支持thread_local的编译器上所有线程共用同一个标记，只能作为任务分配的参考；需要确定当前线程是否为工作线程时使用ThreadPool::findCurrentWorkerIdx  */
+        inline _PoolWorkerTag& _getPoolWorkerTag()
+        {
+            static MINE_THREAD_LOCAL_IF_HAVE _PoolWorkerTag worker_tag;
+            return worker_tag;
+        }
+
+        inline void _TaskResultBase::recordQueueWait() const
+        {
+            if (this->enqueue_t_ == mtime::TimePoint())
+                return;
+#if MINE_HAVE_THREAD_LOCAL
+            _PoolWorkerTag& worker_tag = mthread::_getPoolWorkerTag();
+            if (worker_tag.pool == this->owner_ && worker_tag.stats)
+                worker_tag.stats->queue_wait.record(mtime::ns(mtime::now() - this->enqueue_t_));
+#else
+            //所有线程共用一个标记，按线程id查找执行本任务的工作线程，避免写入其他线程的统计
+            int worker_idx = this->owner_ ? this->owner_->findCurrentWorkerIdx() : -1;
+            if (worker_idx >= 0)
+                this->owner_->worker_stats_[worker_idx]->queue_wait.record(mtime::ns(mtime::now() - this->enqueue_t_));
+#endif
+        }
+
+        //线程池中储存的任务，执行时将结果写入池化的结果状态；已取消时跳过执行，未执行即被销毁时视为取消
+        template<class Ret, class BindT>
+        class _BoundTask
+        {
+        public:
+            _BoundTask(BindT&& bind_func, mthread::_TaskResult<Ret>* task_result) :bind_func_(std::move(bind_func))
+            {
+                this->task_result_ = task_result;
+            }
+
+            _BoundTask(_BoundTask&& tmp) noexcept(std::is_nothrow_move_constructible<BindT>::value) :bind_func_(std::move(tmp.bind_func_))
+            {
+                this->task_result_ = tmp.task_result_;
+                tmp.task_result_ = nullptr;
+            }
+
+            ~_BoundTask()
+            {
+                if (this->task_result_)
+                {
+                    this->task_result_->cancel();
+                    this->task_result_->release();
+                }
+            }
+
+            void operator()()
+            {
+                if (this->task_result_->tryStart())
+                {
+                    this->task_result_->recordQueueWait();
+                    try
+                    {
+                        this->task_result_->run(this->bind_func_);
+                    }
+                    catch (...)
+                    {
+                        this->task_result_->setException(std::current_exception());
+                    }
+                }
+                this->task_result_->release();
+                this->task_result_ = nullptr;
+            }
+
+            _BoundTask(const _BoundTask& tmp) = delete;
+            _BoundTask& operator=(const _BoundTask& tmp) = delete;
+            _BoundTask& operator=(_BoundTask&& tmp) = delete;
+
+        private:
+            BindT bind_func_;
+            mthread::_TaskResult<Ret>* task_result_ = nullptr;
+        };
+
+
+        template<class Ret, class FnT>
+        struct _ThenReturn
+        {
+            using type = decltype(std::declval<FnT&>()(std::declval<Ret>()));
+        };
+
+        template<class FnT>
+        struct _ThenReturn<void, FnT>
+        {
+            using type = decltype(std::declval<FnT&>()());
+        };
+
+        //then注册的后续任务函数，持有前驱任务结果状态的引用，以前驱任务的返回值调用func
+        template<class Ret, class FnT>
+        class _ThenCall
+        {
+        public:
+            template<class Fn>
+            _ThenCall(Fn&& func, mthread::_TaskResult<Ret>* prev_result) :func_(std::forward<Fn>(func))
+            {
+                this->prev_result_ = prev_result;
+            }
+
+            _ThenCall(_ThenCall&& tmp) noexcept(std::is_nothrow_move_constructible<FnT>::value) :func_(std::move(tmp.func_))
+            {
+                this->prev_result_ = tmp.prev_result_;
+                tmp.prev_result_ = nullptr;
+            }
+
+            ~_ThenCall()
+            {
+                if (this->prev_result_)
+                    this->prev_result_->release();
+            }
+
+            typename _ThenReturn<Ret, FnT>::type operator()()
+            {
+                return this->call(std::is_void<Ret>());
+            }
+
+            _ThenCall(const _ThenCall& tmp) = delete;
+            _ThenCall& operator=(const _ThenCall& tmp) = delete;
+            _ThenCall& operator=(_ThenCall&& tmp) = delete;
+
+        private:
+            typename _ThenReturn<Ret, FnT>::type call(std::false_type)
+            {
+                return this->func_(this->prev_result_->get());
+            }
+
+            typename _ThenReturn<Ret, FnT>::type call(std::true_type)
+            {
+                this->prev_result_->get();
+                return this->func_();
+            }
+
+            FnT func_;
+            mthread::_TaskResult<Ret>* prev_result_ = nullptr;
+        };
+
+        //whenAll和whenAny的共享状态，所有输入任务的回调和调用线程都到达后释放
+        template<class Ret>
+        class _WhenControl
+        {
+        public:
+            _WhenControl(int num_arrivals, mthread::_TaskResult<Ret>* task_result)
+            {
+                this->num_arrivals_.store(num_arrivals);
+                this->task_result_ = task_result;
+            }
+
+            //whenAll：最后一个到达者结束任务
+            void arriveAll()
+            {
+                if (this->num_arrivals_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    auto done = []() {};
+                    this->task_result_->run(done);
+                    this->task_result_->release();
+                    delete this;
+                }
+            }
+
+            //whenAny：第一个到达的输入任务结束任务
+            void arriveAny(int index)
+            {
+                if (index >= 0 && !this->triggered_.exchange(true))
+                {
+                    auto first_index = [index]() { return index; };
+                    this->task_result_->run(first_index);
+                }
+                if (this->num_arrivals_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    if (!this->triggered_.exchange(true))
+                    {
+                        auto no_index = []() { return -1; };
+                        this->task_result_->run(no_index);
+                    }
+                    this->task_result_->release();
+                    delete this;
+                }
+            }
+
+        private:
+            std::atomic<int> num_arrivals_;
+            std::atomic<bool> triggered_{ false };
+            mthread::_TaskResult<Ret>* task_result_;
+        };
+
+
+        template<class Ret>
+        inline TaskRetState<Ret>::TaskRetState(std::future<Ret>&& future_state) noexcept
+        {
+            this->future_state_ = std::move(future_state);
+        }
+
+        template<class Ret>
+        inline TaskRetState<Ret>::TaskRetState(mthread::_TaskResult<Ret>* task_result) noexcept
+        {
+            this->task_result_ = task_result;
+        }
+
+        template<class Ret>
+        inline TaskRetState<Ret>::TaskRetState(TaskRetState<Ret>&& tmp_state) noexcept
+        {
+            *this = std::move(tmp_state);
+        }
+
+        template<class Ret>
+        inline TaskRetState<Ret>& TaskRetState<Ret>::operator=(TaskRetState<Ret>&& tmp_state) noexcept
+        {
+            if (this != &tmp_state)
+            {
+                if (this->task_result_)
+                    this->task_result_->release();
+                this->future_state_ = std::move(tmp_state.future_state_);
+                this->task_result_ = tmp_state.task_result_;
+                tmp_state.task_result_ = nullptr;
+            }
+            return *this;
+        }
+
+        template<class Ret>
+        inline TaskRetState<Ret>::~TaskRetState()
+        {
+            if (this->task_result_)
+                this->task_result_->release();
+        }
+
+        template<class Ret>
+        inline bool TaskRetState<Ret>::valid()
+        {
+            return this->task_result_ != nullptr || this->future_state_.valid();
+        }
+
+        template<class Ret>
+        inline bool TaskRetState<Ret>::finished()
+        {
+            if (this->task_result_)
+                return this->task_result_->ready();
+            if (this->future_state_.valid())
+                return this->future_state_.wait_for(std::chrono::nanoseconds(0)) == std::future_status::ready;
+            mprintfW("Task is invalid, so the function returns value:true!\n");
+            return true;
+        }
+
+        template<class Ret>
+        inline void TaskRetState<Ret>::wait()
+        {
+            if (this->task_result_)
+                this->task_result_->wait();
+            else if (this->future_state_.valid())
+                this->future_state_.wait();
+            else mprintfW("Task is invalid, so the function returns directly!\n");
+        }
+
+        template<class Ret>
+        inline Ret TaskRetState<Ret>::get()
+        {
+            if (this->task_result_)
+                return this->task_result_->get();
+            else if (this->future_state_.valid())
+                return this->future_state_.get();
+            else throw std::runtime_error("Error: Task is invalid!");
+        }
+
+        template<class Ret>
+        inline bool TaskRetState<Ret>::cancel()
+        {
+            if (this->task_result_)
+                return this->task_result_->cancel();
+            return false;
+        }
+
+        template<class Ret>
+        template<class Fn, class NewRet>
+        inline TaskRetState<NewRet> TaskRetState<Ret>::then(Fn&& func)
+        {
+            using ThenT = mthread::_ThenCall<Ret, typename std::decay<Fn>::type>;
+            //池化结果状态只由ThreadPool和whenAll创建，没有所属线程池的只有空输入的whenAll，其后续任务直接执行
+            if (this->task_result_ == nullptr)
+                throw std::runtime_error("Error: Task is invalid or not created by ThreadPool!");
+
+            mthread::_TaskResult<NewRet>* next_result = mthread::_TaskResult<NewRet>::create();
+            next_result->setOwner(this->task_result_->getOwner());
+            next_result->addRef();
+            TaskRetState<NewRet> next_state(next_result);
+            this->task_result_->addRef();
+            mthread::_InlineTask continuation(mthread::_BoundTask<NewRet, ThenT>(ThenT(std::forward<Fn>(func), this->task_result_), next_result));
+            if (!this->task_result_->setContinuation(std::move(continuation), false))
+                throw std::runtime_error("Error: Task already has a continuation!");
+            return next_state;
+        }
+
+        //检查whenAll和whenAny的输入都由同一个ThreadPool创建，返回该线程池；没有所属线程池的输入(空输入的whenAll)不参与检查
+        template<class Ret>
+        inline mthread::ThreadPool* _getWhenOwner(std::vector<TaskRetState<Ret>>& states)
+        {
+            mthread::ThreadPool* owner = nullptr;
+            for (auto& state : states)
+            {
+                if (state.task_result_ == nullptr)
+                    throw std::runtime_error("Error: Task is invalid or not created by ThreadPool!");
+                mthread::ThreadPool* state_owner = state.task_result_->getOwner();
+                if (owner == nullptr)
+                    owner = state_owner;
+                else if (state_owner != nullptr && state_owner != owner)
+                    throw std::runtime_error("Error: Tasks of whenAll and whenAny must be created by the same ThreadPool!");
+            }
+            return owner;
+        }
+
+        template<class Ret>
+        inline TaskState whenAll(std::vector<TaskRetState<Ret>>& states)
+        {
+            mthread::ThreadPool* owner = mthread::_getWhenOwner(states);
+
+            mthread::_TaskResult<void>* all_result = mthread::_TaskResult<void>::create();
+            all_result->setOwner(owner);
+            all_result->addRef();
+            TaskState all_state(all_result);
+            //调用线程也作为一个到达者，保证注册完所有回调前不会结束
+            auto control = new mthread::_WhenControl<void>(static_cast<int>(states.size()) + 1, all_result);
+            for (auto& state : states)
+            {
+                if (!state.task_result_->setContinuation(mthread::_InlineTask([control]() { control->arriveAll(); }), true))
+                {
+                    mprintfW("Task already has a continuation, so whenAll will not wait for it!\n");
+                    control->arriveAll();
+                }
+            }
+            control->arriveAll();
+            return all_state;
+        }
+
+        template<class Ret>
+        inline TaskRetState<int> whenAny(std::vector<TaskRetState<Ret>>& states)
+        {
+            if (states.empty())
+                throw std::runtime_error("Error: whenAny needs at least one task!");
+            mthread::ThreadPool* owner = mthread::_getWhenOwner(states);
+
+            mthread::_TaskResult<int>* any_result = mthread::_TaskResult<int>::create();
+            any_result->setOwner(owner);
+            any_result->addRef();
+            TaskRetState<int> any_state(any_result);
+            auto control = new mthread::_WhenControl<int>(static_cast<int>(states.size()) + 1, any_result);
+            for (int i = 0; i < static_cast<int>(states.size()); ++i)
+            {
+                if (!states[i].task_result_->setContinuation(mthread::_InlineTask([control, i]() { control->arriveAny(i); }), true))
+                {
+                    mprintfW("Task already has a continuation, so whenAny will ignore it!\n");
+                    control->arriveAny(-1);
+                }
+            }
+            control->arriveAny(-1);
+            return any_state;
+        }
+
+        //parallelFor一批任务的共享状态，由调用线程和各辅助任务共同持有
+        class _ParallelForControl
+        {
+        public:
+            _ParallelForControl(long long begin, long long end, long long grain, mthread::ChunkPolicy policy, int num_participants)
+            {
+                this->next_ = begin;
+                this->end_ = end;
+                this->grain_ = grain;
+                this->policy_ = policy;
+                this->num_participants_ = num_participants;
+                long long static_chunk = (end - begin + num_participants - 1) / num_participants;
+                this->static_chunk_ = static_chunk > grain ? static_chunk : grain;
+            }
+
+            //领取下一个块，已无剩余元素时返回false；线程安全
+            bool claim(long long& chunk_begin, long long& chunk_end)
+            {
+                long long chunk_size;
+                if (this->policy_ == mthread::ChunkPolicy::Guided)
+                {
+                    chunk_begin = this->next_.load(std::memory_order_relaxed);
+                    do
+                    {
+                        if (chunk_begin >= this->end_)
+                            return false;
+                        chunk_size = (this->end_ - chunk_begin) / (2 * this->num_participants_);
+                        chunk_size = chunk_size > this->grain_ ? chunk_size : this->grain_;
+                    } while (!this->next_.compare_exchange_weak(chunk_begin, chunk_begin + chunk_size, std::memory_order_relaxed));
+                }
+                else
+                {
+                    chunk_size = this->policy_ == mthread::ChunkPolicy::Static ? this->static_chunk_ : this->grain_;
+                    chunk_begin = this->next_.fetch_add(chunk_size, std::memory_order_relaxed);
+                    if (chunk_begin >= this->end_)
+                        return false;
+                }
+                chunk_end = chunk_begin + chunk_size < this->end_ ? chunk_begin + chunk_size : this->end_;
+                return true;
+            }
+
+            //辅助任务开始执行前调用，调用线程已完成汇合时返回false，此时辅助任务不可再访问func
+            bool enter()
+            {
+                std::lock_guard<std::mutex> lk(this->mtx_);
+                if (this->joined_)
+                    return false;
+                this->num_active_++;
+                return true;
+            }
+
+            void leave()
+            {
+                {
+                    std::lock_guard<std::mutex> lk(this->mtx_);
+                    this->num_active_--;
+                    if (this->num_active_ != 0 || !this->joined_)
+                        return;
+                }
+                this->cond_.notify_one();
+            }
+
+            //调用线程完成自己的部分后汇合，等待已开始执行的辅助任务结束，尚未开始的辅助任务之后会直接退出
+            void join()
+            {
+                std::unique_lock<std::mutex> lk(this->mtx_);
+                this->joined_ = true;
+                while (this->num_active_ != 0)
+                {
+                    this->cond_.wait(lk);
+                }
+            }
+
+            void setException(std::exception_ptr exception)
+            {
+                {
+                    std::lock_guard<std::mutex> lk(this->mtx_);
+                    if (!this->exception_)
+                        this->exception_ = std::move(exception);
+                }
+                this->next_.store(this->end_, std::memory_order_relaxed);
+            }
+
+            void rethrowIfFailed()
+            {
+                if (this->exception_)
+                    std::rethrow_exception(this->exception_);
+            }
+
+        private:
+            std::atomic<long long> next_;
+            long long end_;
+            long long grain_;
+            long long static_chunk_;
+            int num_participants_;
+            mthread::ChunkPolicy policy_;
+
+            std::mutex mtx_;
+            std::condition_variable cond_;
+            int num_active_ = 0;
+            bool joined_ = false;
+            std::exception_ptr exception_;
+        };
+
+        template<class Index, class Fn>
+        inline void _runParallelForChunks(mthread::_ParallelForControl& control, Fn& func)
+        {
+            long long chunk_begin, chunk_end;
+            try
+            {
+                while (control.claim(chunk_begin, chunk_end))
+                {
+                    for (long long i = chunk_begin; i < chunk_end; ++i)
+                        func(static_cast<Index>(i));
+                }
+            }
+            catch (...)
+            {
+                control.setException(std::current_exception());
+            }
+        }
+
+
+        class ThreadPool::LocalQueue
+        {
+        public:
+            mthread::SpinLock lock;
+            mthread::_TaskRing tasks;
+        };
+
+        inline CancellationToken::CancellationToken() :cancelled_(std::make_shared<std::atomic<bool>>(false)) {}
+
+        inline void CancellationToken::cancel()
+        {
+            this->cancelled_->store(true, std::memory_order_release);
+        }
+
+        inline bool CancellationToken::isCancelled() const
+        {
+            return this->cancelled_->load(std::memory_order_acquire);
+        }
+
+        class ThreadPool::LevelCounter
+        {
+        public:
+            long long num_pending = 0;
+            long long num_started = 0;
+            long long total_wait_us = 0;
+            long long max_wait_us = 0;
+            long long num_missed = 0;
+        };
+
+        class ThreadPool::PeriodicJob
+        {
+        public:
+            void run()
+            {
+                try
+                {
+                    this->func();
+                }
+                catch (...)
+                {
+                    this->running = false;
+                    throw;
+                }
+                this->running = false;
+            }
+
+            std::function<void()> func;
+            mtime::Duration period;
+            mthread::CancellationToken token;
+            std::atomic<bool> running{ false };
+        };
+
+        //周期任务的条目带有job，延迟任务的条目带有task
+        class ThreadPool::TimerEntry
+        {
+        public:
+            //用于std::push_heap等构造最小堆，到期时间相同时先添加的在前
+            static bool later(const TimerEntry& left, const TimerEntry& right)
+            {
+                return left.due_t != right.due_t ? left.due_t > right.due_t : left.seq > right.seq;
+            }
+
+            mtime::TimePoint due_t;
+            unsigned long long seq = 0;
+            mthread::_InlineTask task;
+            std::shared_ptr<ThreadPool::PeriodicJob> job;
+        };
+
+        inline ThreadPool::ThreadPool(int pool_size) :ThreadPool(pool_size, mthread::SchedulePolicy::SharedQueue) {}
+
+        inline ThreadPool::ThreadPool(int pool_size, mthread::SchedulePolicy policy)
+        {
+            if (pool_size <= 0)
+            {
+                mprintfW("Invalid param value pool_size:%d, which will be set to 1.\n", pool_size);
+                pool_size = 1;
+            }
+            this->pool_size_ = pool_size;
+            this->max_size_ = std::max(pool_size, MINE_THREADPOOL_MAX_SIZE);
+            this->policy_ = policy;
+            this->task_queue_.reset(new mthread::_TaskRing);
+            this->priority_queue_.reset(new mthread::_PriorityTaskQueue);
+            this->num_prioritized_ = 0;
+            this->level_counters_.reset(new ThreadPool::LevelCounter[mthread::_PriorityTaskQueue::NUM_LEVELS]);
+            this->next_queue_idx_ = 0;
+            this->num_pending_ = 0;
+            this->num_sleeping_ = 0;
+            this->idle_spin_us_ = 0;
+            this->num_running_ = 0;
+            this->num_drainers_ = 0;
+            this->stats_on_ = false;
+            this->need_abort_ = false;
+            this->next_timer_seq_ = 0;
+            this->timer_stopped_ = false;
+            this->timer_draining_ = false;
+            this->num_delayed_ = 0;
+            this->num_queues_ = 0;
+            this->worker_cpus_.resize(this->max_size_);
+            this->worker_stats_.resize(this->max_size_);
+            this->worker_ids_.resize(this->max_size_);
+
+            if (this->policy_ == mthread::SchedulePolicy::WorkStealing)
+            {
+                this->local_queues_.resize(this->max_size_);
+                for (int i = 0; i < pool_size; ++i)
+                    this->local_queues_[i].reset(new ThreadPool::LocalQueue);
+                this->num_queues_ = pool_size;
+            }
+            else if (this->policy_ == mthread::SchedulePolicy::LockFreeQueue)
+                this->lockfree_queue_.reset(new mthread::MPMCQueue<mthread::_InlineTask>(MINE_LOCKFREE_TASK_QUEUE_CAPACITY));
+
+            std::lock_guard<std::mutex> resize_lk(this->resize_mtx_);
+            for (int i = 0; i < pool_size; ++i)
+                this->startWorker(i);
+        }
+
+        inline ThreadPool::~ThreadPool()
+        {
+            this->abort();
+            mprintfN("Destroyed.\n");
+        }
+
+        inline void ThreadPool::drain()
+        {
+            if (this->findCurrentWorkerIdx() >= 0)
+            {
+                mprintfW("ThreadPool cannot be drained in its own worker thread.\n");
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> timer_lk(this->timer_mtx_);
+                this->timer_draining_ = true;
+            }
+            {
+                std::unique_lock<std::mutex> lk(this->task_mtx_);
+                this->num_drainers_.fetch_add(1);
+                //依次检查延迟数、排队数和执行数，与定时线程先增加排队数再减少延迟数、工作线程先增加执行数再减少排队数的顺序配合
+                while (this->num_delayed_.load() > 0 || this->num_pending_.load() > 0 || this->num_running_.load() > 0)
+                {
+                    this->idle_cond_.wait(lk);
+                }
+                this->num_drainers_.fetch_sub(1);
+            }
+            this->stopWorkers();
+        }
+
+        inline void ThreadPool::abort()
+        {
+            if (this->findCurrentWorkerIdx() >= 0)
+            {
+                mprintfW("ThreadPool cannot be aborted in its own worker thread.\n");
+                return;
+            }
+            this->stopWorkers();
+        }
+
+        inline void ThreadPool::stopWorkers()
+        {
+            //先停止定时线程，此后不会再有定时任务进入队列
+            this->stopTimer();
+            std::lock_guard<std::mutex> resize_lk(this->resize_mtx_);
+            {
+                std::unique_lock<std::mutex> lk(this->task_mtx_);
+                this->need_abort_ = true;
+            }
+            //与pushTask中无锁队列放入任务后的检查配合
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            this->cond_var_.notify_all();
+            for (auto& thd : this->work_thds_)
+            {
+                if (thd.joinable())
+                    thd.join();
+            }
+            /*  丢弃未执行的任务，它们的结果状态被标记为已取消
+                - 在添加任务时使用的同一把锁内取出任务，pushTask在锁内复查need_abort_，此后不会再有任务进入队列
+                - 任务在锁外销毁，被取消的后续任务会再次调用pushTask并被拒绝   */
+            std::unique_ptr<mthread::_TaskRing> dropped_tasks(new mthread::_TaskRing);
+            std::unique_ptr<mthread::_PriorityTaskQueue> dropped_priority_tasks(new mthread::_PriorityTaskQueue);
+            {
+                std::lock_guard<std::mutex> lk(this->task_mtx_);
+                this->task_queue_.swap(dropped_tasks);
+                this->priority_queue_.swap(dropped_priority_tasks);
+            }
+            dropped_tasks.reset();
+            dropped_priority_tasks.reset();
+            for (int i = 0; i < this->num_queues_; ++i)
+            {
+                mthread::_TaskRing dropped_local_tasks;
+                {
+                    auto guard = this->local_queues_[i]->lock.lockGuard();
+                    this->local_queues_[i]->tasks.swap(dropped_local_tasks);
+                }
+            }
+            if (this->lockfree_queue_)
+                this->discardLockFreeTasks();
+        }
+
+        //销毁被拒绝的任务，其结果状态被标记为已取消；调用时不能持有任何队列锁
+        inline bool ThreadPool::rejectTask(mthread::_InlineTask& task)
+        {
+            task.reset();
+            return false;
+        }
+
+        inline void ThreadPool::discardLockFreeTasks()
+        {
+            mthread::_InlineTask task;
+            while (this->lockfree_queue_->tryPop(task))
+                task.reset();
+        }
+
+        inline void ThreadPool::runTask(mthread::_InlineTask& task, int worker_idx)
+        {
+            mthread::_WorkerStats& stats = *this->worker_stats_[worker_idx];
+            if (this->stats_on_.load(std::memory_order_relaxed))
+            {
+                auto start_t = mtime::now();
+                task();
+                long long run_ns = mtime::ns(mtime::now() - start_t);
+                stats.run_time.record(run_ns);
+                stats.busy_ns.store(stats.busy_ns.load(std::memory_order_relaxed) + run_ns, std::memory_order_relaxed);
+            }
+            else task();
+            task.reset();
+            stats.num_completed.store(stats.num_completed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            this->finishTask();
+        }
+
+        inline void ThreadPool::finishTask()
+        {
+            if (this->num_running_.fetch_sub(1) == 1 && this->num_pending_.load() <= 0 && this->num_drainers_.load() > 0)
+            {
+                {
+                    std::lock_guard<std::mutex> lk(this->task_mtx_);
+                }
+                this->idle_cond_.notify_all();
+            }
+        }
+
+        template<class Ret, class BindT>
+        inline mthread::_InlineTask ThreadPool::createTask(BindT&& bind_task, TaskRetState<Ret>& state)
+        {
+            using BindDecayT = typename std::decay<BindT>::type;
+            mthread::_TaskResult<Ret>* task_result = mthread::_TaskResult<Ret>::create();
+            task_result->setOwner(this);
+            if (this->stats_on_.load(std::memory_order_relaxed))
+                task_result->setEnqueueTime(mtime::now());
+            task_result->addRef();
+            state = TaskRetState<Ret>(task_result);
+            return mthread::_InlineTask(mthread::_BoundTask<Ret, BindDecayT>(std::forward<BindT>(bind_task), task_result));
+        }
+
+        template<class Fn, class... Args, class Ret, typename std::enable_if<std::is_same<Ret, typename mtype::StdBindChecker<Fn, Args...>::ReturnType>::value && (std::is_void<Ret>::value || std::is_move_assignable<typename std::remove_reference<Ret>::type>::value), int>::type>
+        inline TaskRetState<Ret> ThreadPool::addTask(Fn&& func, Args&&... args)
+        {
+            TaskRetState<Ret> state;
+            this->pushTask(this->createTask<Ret>(std::bind(std::forward<Fn>(func), std::forward<Args>(args)...), state));
+            return state;
+        }
+
+        template<class Fn, class... Args, class Ret, typename std::enable_if<std::is_same<Ret, typename mtype::StdBindChecker<Fn, Args...>::ReturnType>::value && (std::is_void<Ret>::value || std::is_move_assignable<typename std::remove_reference<Ret>::type>::value), int>::type>
+        inline TaskRetState<Ret> ThreadPool::addTask(mthread::TaskPriority priority, Fn&& func, Args&&... args)
+        {
+            TaskRetState<Ret> state;
+            this->pushPriorityTask(mthread::_PriorityTaskQueue::levelOf(priority), mtime::TimePoint(), this->createTask<Ret>(std::bind(std::forward<Fn>(func), std::forward<Args>(args)...), state));
+            return state;
+        }
+
+        template<class Fn, class... Args, class Ret, typename std::enable_if<std::is_same<Ret, typename mtype::StdBindChecker<Fn, Args...>::ReturnType>::value && (std::is_void<Ret>::value || std::is_move_assignable<typename std::remove_reference<Ret>::type>::value), int>::type>
+        inline TaskRetState<Ret> ThreadPool::addTask(const mtime::TimePoint& deadline, Fn&& func, Args&&... args)
+        {
+            TaskRetState<Ret> state;
+            this->pushPriorityTask(mthread::_PriorityTaskQueue::DEADLINE_LEVEL, deadline, this->createTask<Ret>(std::bind(std::forward<Fn>(func), std::forward<Args>(args)...), state));
+            return state;
+        }
+
+        template<class Fn, class... Args, class Ret, typename std::enable_if<std::is_same<Ret, typename mtype::StdBindChecker<Fn, Args...>::ReturnType>::value && (std::is_void<Ret>::value || std::is_move_assignable<typename std::remove_reference<Ret>::type>::value), int>::type>
+        inline TaskRetState<Ret> ThreadPool::addTask(const mthread::CancellationToken& token, Fn&& func, Args&&... args)
+        {
+            TaskRetState<Ret> state;
+            mthread::_InlineTask task = this->createTask<Ret>(std::bind(std::forward<Fn>(func), std::forward<Args>(args)...), state);
+            state.task_result_->setCancelFlag(token.cancelled_);
+            this->pushTask(std::move(task));
+            return state;
+        }
+
+        template<class Fn, class... Args, class Ret, typename std::enable_if<std::is_same<Ret, typename mtype::StdBindChecker<Fn, Args...>::ReturnType>::value && (std::is_void<Ret>::value || std::is_move_assignable<typename std::remove_reference<Ret>::type>::value), int>::type>
+        inline TaskRetState<Ret> ThreadPool::addDelayedTask(const mtime::Duration& delay, Fn&& func, Args&&... args)
+        {
+            TaskRetState<Ret> state;
+            ThreadPool::TimerEntry entry;
+            entry.due_t = mtime::now() + std::max(delay, mtime::Duration::zero());
+            entry.task = this->createTask<Ret>(std::bind(std::forward<Fn>(func), std::forward<Args>(args)...), state);
+            this->addTimer(std::move(entry));
+            return state;
+        }
+
+        template<class Fn, class... Args>
+        inline mthread::CancellationToken ThreadPool::addPeriodicTask(const mtime::Duration& period, Fn&& func, Args&&... args)
+        {
+            std::shared_ptr<ThreadPool::PeriodicJob> job = std::make_shared<ThreadPool::PeriodicJob>();
+            if (period <= mtime::Duration::zero())
+            {
+                mprintfW("Invalid param value period:%lldns, the periodic task will not run.\n", mtime::ns(period));
+                job->token.cancel();
+                return job->token;
+            }
+            job->func = std::bind(std::forward<Fn>(func), std::forward<Args>(args)...);
+            job->period = period;
+            ThreadPool::TimerEntry entry;
+            entry.due_t = mtime::now() + period;
+            entry.job = job;
+            this->addTimer(std::move(entry));
+            return job->token;
+        }
+
+        inline void ThreadPool::addTimer(ThreadPool::TimerEntry&& entry)
+        {
+            std::unique_lock<std::mutex> timer_lk(this->timer_mtx_);
+            //已停止时直接丢弃，延迟任务的结果状态因此被标记为已取消
+            if (this->timer_stopped_ || this->need_abort_.load())
+                return;
+            if (!entry.job)
+                this->num_delayed_.fetch_add(1);
+            entry.seq = this->next_timer_seq_++;
+            bool is_earliest = this->timer_heap_.empty() || ThreadPool::TimerEntry::later(this->timer_heap_.front(), entry);
+            this->timer_heap_.push_back(std::move(entry));
+            std::push_heap(this->timer_heap_.begin(), this->timer_heap_.end(), ThreadPool::TimerEntry::later);
+            if (!this->timer_thd_.joinable())
+                this->timer_thd_ = std::thread(&ThreadPool::timerLoop, this);
+            else if (is_earliest)
+            {
+                timer_lk.unlock();
+                this->timer_cond_.notify_one();
+            }
+        }
+
+        inline void ThreadPool::timerLoop()
+        {
+            std::unique_lock<std::mutex> timer_lk(this->timer_mtx_);
+            while (!this->timer_stopped_)
+            {
+                if (this->timer_heap_.empty())
+                {
+                    this->timer_cond_.wait(timer_lk);
+                    continue;
+                }
+                mtime::TimePoint now_t = mtime::now();
+                if (this->timer_heap_.front().due_t > now_t)
+                {
+                    this->timer_cond_.wait_until(timer_lk, this->timer_heap_.front().due_t);
+                    continue;
+                }
+                std::pop_heap(this->timer_heap_.begin(), this->timer_heap_.end(), ThreadPool::TimerEntry::later);
+                ThreadPool::TimerEntry entry = std::move(this->timer_heap_.back());
+                this->timer_heap_.pop_back();
+
+                if (!entry.job)
+                {
+                    timer_lk.unlock();
+                    this->pushTask(std::move(entry.task));
+                    //任务可能在减少延迟数之前已执行完毕，此时drain已错过工作线程的通知
+                    if (this->num_delayed_.fetch_sub(1) == 1 && this->num_drainers_.load() > 0)
+                    {
+                        {
+                            std::lock_guard<std::mutex> lk(this->task_mtx_);
+                        }
+                        this->idle_cond_.notify_all();
+                    }
+                    timer_lk.lock();
+                    continue;
+                }
+
+                std::shared_ptr<ThreadPool::PeriodicJob> job = entry.job;
+                if (job->token.isCancelled() || this->timer_draining_)
+                    continue;
+                //按添加时的时间网格推进，落后时跳过错过的周期而不是从当前时间重新计时，避免误差累积
+                entry.due_t += job->period;
+                if (entry.due_t <= now_t)
+                    entry.due_t += job->period * ((now_t - entry.due_t) / job->period + 1);
+                entry.seq = this->next_timer_seq_++;
+                this->timer_heap_.push_back(std::move(entry));
+                std::push_heap(this->timer_heap_.begin(), this->timer_heap_.end(), ThreadPool::TimerEntry::later);
+
+                bool expected = false;
+                if (job->running.compare_exchange_strong(expected, true))
+                {
+                    timer_lk.unlock();
+                    this->addTask(job->token, [job]() { job->run(); });
+                    timer_lk.lock();
+                }
+            }
+        }
+
+        inline void ThreadPool::stopTimer()
+        {
+            std::vector<ThreadPool::TimerEntry> entries;
+            {
+                std::lock_guard<std::mutex> timer_lk(this->timer_mtx_);
+                this->timer_stopped_ = true;
+                entries.swap(this->timer_heap_);
+            }
+            this->timer_cond_.notify_all();
+            if (this->timer_thd_.joinable())
+                this->timer_thd_.join();
+            for (const auto& entry : entries)
+            {
+                if (!entry.job)
+                    this->num_delayed_.fetch_sub(1);
+            }
+        }
+
+        inline void ThreadPool::setStatsEnabled(bool enabled)
+        {
+            std::lock_guard<std::mutex> resize_lk(this->resize_mtx_);
+            if (enabled && this->stats_start_t_ == mtime::TimePoint())
+                this->stats_start_t_ = mtime::now();
+            this->stats_on_.store(enabled);
+        }
+
+        inline mthread::ThreadPoolStats ThreadPool::snapshot()
+        {
+            mthread::ThreadPoolStats stats;
+            std::lock_guard<std::mutex> resize_lk(this->resize_mtx_);
+            stats.pool_size = this->pool_size_.load();
+            if (this->stats_start_t_ != mtime::TimePoint())
+                stats.elapsed_ns = mtime::ns(mtime::now() - this->stats_start_t_);
+            //被resize移除的线程的数据同样计入总数
+            for (const auto& worker_stats : this->worker_stats_)
+            {
+                if (!worker_stats)
+                    break;
+                stats.num_completed += worker_stats->num_completed.load(std::memory_order_relaxed);
+                worker_stats->queue_wait.mergeTo(stats.queue_wait);
+                worker_stats->run_time.mergeTo(stats.run_time);
+            }
+            for (int i = 0; i < stats.pool_size; ++i)
+            {
+                long long busy_ns = this->worker_stats_[i]->busy_ns.load(std::memory_order_relaxed);
+                stats.worker_busy_ns.push_back(busy_ns);
+                stats.worker_busy_ratios.push_back(stats.elapsed_ns > 0 ? static_cast<double>(busy_ns) / stats.elapsed_ns : 0.0);
+            }
+            stats.num_running = std::max(this->num_running_.load(std::memory_order_relaxed), 0);
+            stats.num_pending = std::max(this->num_pending_.load(std::memory_order_relaxed), 0LL);
+            stats.num_submitted = stats.num_completed + stats.num_running + stats.num_pending;
+            return stats;
+        }
+
+        inline long long LatencyHistogram::meanNs() const
+        {
+            return this->count > 0 ? this->total_ns / this->count : 0;
+        }
+
+        inline long long LatencyHistogram::percentileNs(double percent) const
+        {
+            if (this->count <= 0)
+                return 0;
+            long long target = static_cast<long long>(this->count * std::min(std::max(percent, 0.0), 100.0) / 100.0);
+            if (target < 1)
+                target = 1;
+            long long accumulated = 0;
+            for (int i = 0; i < LatencyHistogram::NUM_BUCKETS; ++i)
+            {
+                accumulated += this->buckets[i];
+                if (accumulated >= target)
+                    return i == 0 ? 0 : std::min(1LL << i, this->max_ns);
+            }
+            return this->max_ns;
+        }
+
+
+        inline ShardedCounter::ShardedCounter()
+        {
+            for (Shard& shard : this->shards_)
+                shard.value.store(0, std::memory_order_relaxed);
+        }
+
+        inline void ShardedCounter::add(long long delta)
+        {
+            this->shards_[mthread::_getReaderSlotIndex()].value.fetch_add(delta, std::memory_order_relaxed);
+        }
+
+        inline long long ShardedCounter::get() const
+        {
+            long long sum = 0;
+            for (const Shard& shard : this->shards_)
+                sum += shard.value.load(std::memory_order_relaxed);
+            return sum;
+        }
+
+        inline long long ShardedCounter::reset()
+        {
+            long long sum = 0;
+            for (Shard& shard : this->shards_)
+                sum += shard.value.exchange(0, std::memory_order_relaxed);
+            return sum;
+        }
+
+        //前后填充以独占缓存行，分片在数组中相邻时也不会互相干扰
+        struct ShardedHistogram::Shard
+        {
+            char pad0_[MINE_CACHE_LINE_SIZE];
+            std::atomic<long long> buckets[LatencyHistogram::NUM_BUCKETS];
+            std::atomic<long long> count;
+            std::atomic<long long> total;
+            std::atomic<long long> max_value;
+            char pad1_[MINE_CACHE_LINE_SIZE];
+        };
+
+        inline ShardedHistogram::ShardedHistogram()
+        {
+            this->shards_.reset(new Shard[MINE_RWLOCK_READER_SLOTS]);
+            this->reset();
+        }
+
+        inline void ShardedHistogram::record(long long value)
+        {
+            Shard& shard = this->shards_[mthread::_getReaderSlotIndex()];
+            shard.buckets[mthread::_getLatencyBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+            shard.count.fetch_add(1, std::memory_order_relaxed);
+            shard.total.fetch_add(value, std::memory_order_relaxed);
+            long long max_value = shard.max_value.load(std::memory_order_relaxed);
+            while (value > max_value && !shard.max_value.compare_exchange_weak(max_value, value, std::memory_order_relaxed));
+        }
+
+        inline mthread::LatencyHistogram ShardedHistogram::snapshot() const
+        {
+            mthread::LatencyHistogram hist;
+            for (int i = 0; i < MINE_RWLOCK_READER_SLOTS; ++i)
+            {
+                const Shard& shard = this->shards_[i];
+                for (int j = 0; j < LatencyHistogram::NUM_BUCKETS; ++j)
+                    hist.buckets[j] += shard.buckets[j].load(std::memory_order_relaxed);
+                hist.count += shard.count.load(std::memory_order_relaxed);
+                hist.total_ns += shard.total.load(std::memory_order_relaxed);
+                hist.max_ns = std::max(hist.max_ns, shard.max_value.load(std::memory_order_relaxed));
+            }
+            return hist;
+        }
+
+        inline void ShardedHistogram::reset()
+        {
+            for (int i = 0; i < MINE_RWLOCK_READER_SLOTS; ++i)
+            {
+                Shard& shard = this->shards_[i];
+                for (int j = 0; j < LatencyHistogram::NUM_BUCKETS; ++j)
+                    shard.buckets[j].store(0, std::memory_order_relaxed);
+                shard.count.store(0, std::memory_order_relaxed);
+                shard.total.store(0, std::memory_order_relaxed);
+                shard.max_value.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        inline mthread::TaskQueueStats ThreadPool::getQueueStats(mthread::TaskPriority priority)
+        {
+            return this->getLevelStats(mthread::_PriorityTaskQueue::levelOf(priority));
+        }
+
+        inline mthread::TaskQueueStats ThreadPool::getDeadlineQueueStats()
+        {
+            return this->getLevelStats(mthread::_PriorityTaskQueue::DEADLINE_LEVEL);
+        }
+
+        inline mthread::TaskQueueStats ThreadPool::getLevelStats(int level)
+        {
+            mthread::TaskQueueStats stats;
+            std::lock_guard<std::mutex> lk(this->task_mtx_);
+            const ThreadPool::LevelCounter& counter = this->level_counters_[level];
+            stats.num_pending = counter.num_pending;
+            stats.num_started = counter.num_started;
+            stats.mean_wait_us = counter.num_started > 0 ? counter.total_wait_us / counter.num_started : 0;
+            stats.max_wait_us = counter.max_wait_us;
+            stats.num_missed = counter.num_missed;
+            return stats;
+        }
+
+        template<class Index, class Fn, typename std::enable_if<std::is_integral<Index>::value, int>::type>
+        inline void ThreadPool::parallelFor(Index begin, Index end, Index grain, Fn&& func, mthread::ChunkPolicy policy)
+        {
+            if (grain < 1)
+            {
+                mprintfW("Invalid param value grain:%lld, which will be set to 1.\n", static_cast<long long>(grain));
+                grain = 1;
+            }
+            if (!(begin < end))
+                return;
+
+            long long num_items = static_cast<long long>(end) - static_cast<long long>(begin);
+            long long max_chunks = (num_items + grain - 1) / grain;
+            int num_helpers = static_cast<int>(std::min<long long>(this->pool_size_.load(), max_chunks - 1));
+            if (num_helpers <= 0)
+            {
+                for (long long i = begin; i < static_cast<long long>(end); ++i)
+                    func(static_cast<Index>(i));
+                return;
+            }
+
+            auto control = std::make_shared<mthread::_ParallelForControl>(begin, end, grain, policy, num_helpers + 1);
+            typename std::remove_reference<Fn>::type* func_ptr = &func;
+            this->pushTaskBatch([control, func_ptr]()
+                {
+                    if (control->enter())
+                    {
+                        mthread::_runParallelForChunks<Index>(*control, *func_ptr);
+                        control->leave();
+                    }
+                }, num_helpers);
+            mthread::_runParallelForChunks<Index>(*control, func);
+            control->join();
+            control->rethrowIfFailed();
+        }
+
+        template<class Container, class Fn, typename std::enable_if<std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<decltype(std::begin(std::declval<Container&>()))>::iterator_category>::value, int>::type>
+        inline void ThreadPool::parallelForEach(Container& container, Fn&& func, long long grain, mthread::ChunkPolicy policy)
+        {
+            auto first = std::begin(container);
+            long long num_items = static_cast<long long>(std::end(container) - first);
+            this->parallelFor(0LL, num_items, grain, [&first, &func](long long i) { func(first[i]); }, policy);
+        }
+
+        template<class TaskFn>
+        inline void ThreadPool::pushTaskBatch(const TaskFn& task_func, int num_tasks)
+        {
+            if (this->policy_ == mthread::SchedulePolicy::WorkStealing)
+            {
+                //分散到各线程的队列，减少窃取
+                int worker_idx = this->getCurrentWorkerIdx();
+                unsigned int start_idx = worker_idx >= 0 ? static_cast<unsigned int>(worker_idx) + 1 : this->next_queue_idx_.fetch_add(num_tasks, std::memory_order_relaxed);
+                unsigned int pool_size = static_cast<unsigned int>(this->pool_size_.load());
+                int num_pushed = 0;
+                for (; num_pushed < num_tasks; ++num_pushed)
+                {
+                    ThreadPool::LocalQueue& local_queue = *this->local_queues_[(start_idx + num_pushed) % pool_size];
+                    auto guard = local_queue.lock.lockGuard();
+                    if (this->need_abort_.load(std::memory_order_relaxed))
+                        break;
+                    local_queue.tasks.pushBack(mthread::_InlineTask(task_func));
+                }
+                this->num_pending_.fetch_add(num_pushed);
+                this->wakeWorkers(num_pushed);
+            }
+            else if (this->policy_ == mthread::SchedulePolicy::LockFreeQueue)
+            {
+                for (int i = 0; i < num_tasks; ++i)
+                    this->pushTask(mthread::_InlineTask(task_func));
+            }
+            else
+            {
+                {
+                    std::lock_guard<std::mutex> lk(this->task_mtx_);
+                    if (this->need_abort_.load(std::memory_order_relaxed))
+                        return;
+                    for (int i = 0; i < num_tasks; ++i)
+                        this->task_queue_->pushBack(mthread::_InlineTask(task_func));
+                    this->num_pending_.fetch_add(num_tasks);
+                }
+                for (int i = 0; i < num_tasks; ++i)
+                    this->cond_var_.notify_one();
+            }
+        }
+
+        //任务进入队列时返回true；线程池已停止时立即销毁任务并返回false，任务的结果状态被标记为已取消
+        inline bool ThreadPool::pushTask(mthread::_InlineTask&& task)
+        {
+            if (munlikely(this->need_abort_.load(std::memory_order_relaxed)))
+                return this->rejectTask(task);
+            if (this->policy_ == mthread::SchedulePolicy::WorkStealing)
+            {
+                int worker_idx = this->getCurrentWorkerIdx();
+                if (worker_idx < 0)
+                    worker_idx = static_cast<int>(this->next_queue_idx_.fetch_add(1, std::memory_order_relaxed) % static_cast<unsigned int>(this->pool_size_.load()));
+                ThreadPool::LocalQueue& local_queue = *this->local_queues_[worker_idx];
+                bool rejected;
+                {
+                    //在队列锁内复查，stopWorkers设置need_abort_后在同一把锁内取出剩余任务
+                    auto guard = local_queue.lock.lockGuard();
+                    rejected = this->need_abort_.load(std::memory_order_relaxed);
+                    if (!rejected)
+                        local_queue.tasks.pushBack(std::move(task));
+                }
+                if (rejected)
+                    return this->rejectTask(task);
+                this->num_pending_.fetch_add(1);
+                this->wakeWorkers(1);
+            }
+            else if (this->policy_ == mthread::SchedulePolicy::LockFreeQueue)
+            {
+                if (!this->lockfree_queue_->tryPush(std::move(task)))
+                {
+                    //队列已满时工作线程直接执行任务，避免所有工作线程互相等待空位；与出队执行一样计入执行数和统计，drain会等待它结束
+                    //只有本线程池的工作线程可以写入其统计，需要准确判断
+                    int worker_idx = this->findCurrentWorkerIdx();
+                    if (worker_idx >= 0)
+                    {
+                        this->num_running_.fetch_add(1);
+                        this->runTask(task, worker_idx);
+                        return true;
+                    }
+                    //其他线程等待空位，线程池停止后不再等待，直接取消任务
+                    for (int i = 1; !this->lockfree_queue_->tryPush(std::move(task)); ++i)
+                    {
+                        if (this->need_abort_.load())
+                            return this->rejectTask(task);
+                        if (i < mthread::_getSpinCount())
+                            mthread::_cpuRelax();
+                        else std::this_thread::yield();
+                    }
+                }
+                //无锁队列没有可复查的锁：放入后再检查，与stopWorkers先设置need_abort_再清空队列的顺序配合，两者至少有一方会丢弃该任务
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (munlikely(this->need_abort_.load(std::memory_order_relaxed)))
+                {
+                    this->discardLockFreeTasks();
+                    return true;
+                }
+                this->num_pending_.fetch_add(1);
+                this->wakeWorkers(1);
+            }
+            else
+            {
+                bool rejected;
+                {
+                    std::lock_guard<std::mutex> lk(this->task_mtx_);
+                    rejected = this->need_abort_.load(std::memory_order_relaxed);
+                    if (!rejected)
+                    {
+                        this->task_queue_->pushBack(std::move(task));
+                        this->num_pending_.fetch_add(1);
+                    }
+                }
+                if (rejected)
+                    return this->rejectTask(task);
+                this->cond_var_.notify_one();
+            }
+            return true;
+        }
+
+        inline bool ThreadPool::pushPriorityTask(int level, const mtime::TimePoint& deadline, mthread::_InlineTask&& task)
+        {
+            if (munlikely(this->need_abort_.load(std::memory_order_relaxed)))
+                return this->rejectTask(task);
+            bool rejected;
+            {
+                std::lock_guard<std::mutex> lk(this->task_mtx_);
+                rejected = this->need_abort_.load(std::memory_order_relaxed);
+                if (!rejected)
+                {
+                    this->priority_queue_->push(level, deadline, mtime::now(), std::move(task));
+                    this->level_counters_[level].num_pending++;
+                    this->num_prioritized_.fetch_add(1);
+                    //在锁内计数，与pollingWorker在锁内检查任务数的顺序一致，不会遗漏唤醒
+                    this->num_pending_.fetch_add(1);
+                }
+            }
+            if (rejected)
+                return this->rejectTask(task);
+            this->cond_var_.notify_one();
+            return true;
+        }
+
+        //调用者需持有task_mtx_，只取出级别不大于max_level的任务
+        inline bool ThreadPool::popPriorityTask(int max_level, mthread::_InlineTask& task)
+        {
+            if (this->priority_queue_->topLevel() > max_level)
+                return false;
+            mthread::_PriorityTaskQueue::Entry entry;
+            this->priority_queue_->pop(entry);
+            this->num_prioritized_.fetch_sub(1);
+            auto now_t = mtime::now();
+            long long wait_us = mtime::us(now_t - entry.enqueue_t);
+            ThreadPool::LevelCounter& counter = this->level_counters_[entry.level];
+            counter.num_pending--;
+            counter.num_started++;
+            counter.total_wait_us += wait_us;
+            counter.max_wait_us = std::max(counter.max_wait_us, wait_us);
+            if (entry.level == mthread::_PriorityTaskQueue::DEADLINE_LEVEL && now_t > entry.deadline)
+                counter.num_missed++;
+            task = std::move(entry.task);
+            return true;
+        }
+
+        inline bool ThreadPool::tryPopPriorityTask(int max_level, mthread::_InlineTask& task)
+        {
+            if (this->num_prioritized_.load(std::memory_order_relaxed) <= 0)
+                return false;
+            std::lock_guard<std::mutex> lk(this->task_mtx_);
+            return this->popPriorityTask(max_level, task);
+        }
+
+        inline void ThreadPool::wakeWorkers(int num_tasks)
+        {
+            //与pollingWorker中先登记休眠再检查任务数的顺序配合，保证不会遗漏唤醒
+            if (this->num_sleeping_.load() > 0)
+            {
+                {
+                    std::lock_guard<std::mutex> lk(this->task_mtx_);
+                }
+                for (int i = 0; i < num_tasks; ++i)
+                    this->cond_var_.notify_one();
+            }
+        }
+
+        inline int ThreadPool::getCurrentWorkerIdx()
+        {
+            _PoolWorkerTag& worker_tag = mthread::_getPoolWorkerTag();
+            if (worker_tag.pool == this)
+                return worker_tag.worker_idx;
+            return -1;
+        }
+
+        //与getCurrentWorkerIdx相同，但结果总是准确的；不支持thread_local时需要加锁按线程id查找，只用于影响正确性的判断
+        inline int ThreadPool::findCurrentWorkerIdx()
+        {
+#if MINE_HAVE_THREAD_LOCAL
+            return this->getCurrentWorkerIdx();
+#else
+            std::thread::id thread_id = std::this_thread::get_id();
+            std::lock_guard<std::mutex> lk(this->worker_ids_mtx_);
+            for (int i = 0; i < static_cast<int>(this->worker_ids_.size()); ++i)
+            {
+                if (this->worker_ids_[i] == thread_id)
+                    return i;
+            }
+            return -1;
+#endif
+        }
+
+        inline void ThreadPool::setWorkerId(int worker_idx, std::thread::id thread_id)
+        {
+            std::lock_guard<std::mutex> lk(this->worker_ids_mtx_);
+            this->worker_ids_[worker_idx] = thread_id;
+        }
+
+        inline bool ThreadPool::popLocalTask(int worker_idx, mthread::_InlineTask& task)
+        {
+            ThreadPool::LocalQueue& local_queue = *this->local_queues_[worker_idx];
+            auto guard = local_queue.lock.lockGuard();
+            return local_queue.tasks.popBack(task);
+        }
+
+        inline bool ThreadPool::stealTask(int worker_idx, mthread::_InlineTask& task)
+        {
+            //包括已被resize移除的线程留下的队列
+            int num_queues = this->num_queues_.load();
+            for (int i = 1; i < num_queues; ++i)
+            {
+                ThreadPool::LocalQueue& victim_queue = *this->local_queues_[(worker_idx + i) % num_queues];
+                auto guard = victim_queue.lock.lockGuard();
+                if (victim_queue.tasks.popFront(task))
+                    return true;
+            }
+            return false;
+        }
+
+        inline void ThreadPool::worker(int worker_idx)
+        {
+            _PoolWorkerTag& worker_tag = mthread::_getPoolWorkerTag();
+            worker_tag.pool = this;
+            worker_tag.worker_idx = worker_idx;
+            worker_tag.stats = this->worker_stats_[worker_idx].get();
+            this->setWorkerId(worker_idx, std::this_thread::get_id());
+
+            mthread::_InlineTask task;
+            while (true)
+            {
+                this->idleSpin();
+                {
+                    std::unique_lock<std::mutex> lk(this->task_mtx_);
+                    while (!this->shouldExit(worker_idx) && this->task_queue_->empty() && this->priority_queue_->empty())
+                    {
+                        this->cond_var_.wait(lk);
+                    }
+                    if (this->shouldExit(worker_idx))
+                        break;
+                    if (!this->popPriorityTask(mthread::_PriorityTaskQueue::levelOf(mthread::TaskPriority::Normal), task) && !this->task_queue_->popFront(task))
+                        this->popPriorityTask(mthread::_PriorityTaskQueue::levelOf(mthread::TaskPriority::Low), task);
+                    this->num_running_.fetch_add(1);
+                    this->num_pending_.fetch_sub(1);
+                }
+                this->runTask(task, worker_idx);
+            }
+            //被resize移除时可能消耗了一次唤醒，转交给其他线程
+            this->cond_var_.notify_all();
+            this->setWorkerId(worker_idx, std::thread::id());
+            worker_tag.pool = nullptr;
+            worker_tag.worker_idx = -1;
+            worker_tag.stats = nullptr;
+        }
+
+        inline bool ThreadPool::tryGetTask(int worker_idx, mthread::_InlineTask& task)
+        {
+            if (this->tryPopPriorityTask(mthread::_PriorityTaskQueue::levelOf(mthread::TaskPriority::Normal), task))
+                return true;
+            if (this->policy_ == mthread::SchedulePolicy::LockFreeQueue)
+            {
+                if (this->lockfree_queue_->tryPop(task))
+                    return true;
+            }
+            //自己的队列后进先出以利用缓存，窃取时从其他队列头部取最早的任务
+            else if (this->popLocalTask(worker_idx, task) || this->stealTask(worker_idx, task))
+                return true;
+            return this->tryPopPriorityTask(mthread::_PriorityTaskQueue::levelOf(mthread::TaskPriority::Low), task);
+        }
+
+        inline void ThreadPool::pollingWorker(int worker_idx)
+        {
+            _PoolWorkerTag& worker_tag = mthread::_getPoolWorkerTag();
+            worker_tag.pool = this;
+            worker_tag.worker_idx = worker_idx;
+            worker_tag.stats = this->worker_stats_[worker_idx].get();
+            this->setWorkerId(worker_idx, std::this_thread::get_id());
+
+            mthread::_InlineTask task;
+            bool has_spun = false;
+            while (!this->shouldExit(worker_idx))
+            {
+                if (this->tryGetTask(worker_idx, task))
+                {
+                    this->num_running_.fetch_add(1);
+                    this->num_pending_.fetch_sub(1);
+                    this->runTask(task, worker_idx);
+                    has_spun = false;
+                    continue;
+                }
+                if (!has_spun)
+                {
+                    has_spun = true;
+                    this->idleSpin();
+                    continue;
+                }
+                has_spun = false;
+                std::unique_lock<std::mutex> lk(this->task_mtx_);
+                this->num_sleeping_.fetch_add(1);
+                while (!this->shouldExit(worker_idx) && this->num_pending_.load() <= 0)
+                {
+                    this->cond_var_.wait(lk);
+                }
+                this->num_sleeping_.fetch_sub(1);
+            }
+            //被resize移除时队列中可能还有任务，唤醒其他线程接手
+            this->cond_var_.notify_all();
+            this->setWorkerId(worker_idx, std::thread::id());
+            worker_tag.pool = nullptr;
+            worker_tag.worker_idx = -1;
+            worker_tag.stats = nullptr;
+        }
+
+        inline bool ThreadPool::shouldExit(int worker_idx) const
+        {
+            return this->need_abort_.load() || worker_idx >= this->pool_size_.load();
+        }
+
+        inline void ThreadPool::idleSpin()
+        {
+            long long spin_us = this->idle_spin_us_.load(std::memory_order_relaxed);
+            if (spin_us <= 0)
+                return;
+            auto start_t = mtime::now();
+            for (int i = 1; this->num_pending_.load(std::memory_order_relaxed) <= 0 && !this->need_abort_.load(std::memory_order_relaxed); ++i)
+            {
+                mthread::_cpuRelax();
+                //降低读取时钟的频率
+                if ((i & 63) == 0 && mtime::us(mtime::now() - start_t) >= spin_us)
+                    break;
+            }
+        }
+
+        inline bool _setThreadAffinity(std::thread& thd, const std::vector<int>& cpu_ids)
+        {
+#if defined(__linux__) && !defined(__ANDROID__)
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            if (cpu_ids.empty())
+            {
+                for (int i = 0; i < CPU_SETSIZE; ++i)
+                    CPU_SET(i, &cpu_set);
+            }
+            for (int cpu_id : cpu_ids)
+            {
+                if (cpu_id < 0 || cpu_id >= CPU_SETSIZE)
+                {
+                    mprintfW("Invalid cpu id:%d.\n", cpu_id);
+                    return false;
+                }
+                CPU_SET(cpu_id, &cpu_set);
+            }
+            int ret = pthread_setaffinity_np(thd.native_handle(), sizeof(cpu_set_t), &cpu_set);
+            if (ret != 0)
+                mprintfW("Failed to set thread affinity, error code:%d.\n", ret);
+            return ret == 0;
+#else
+            (void)thd;
+            (void)cpu_ids;
+            mprintfW("Thread affinity is only supported on Linux.\n");
+            return false;
+#endif
+        }
+
+        //调用者需持有resize_mtx_
+        inline void ThreadPool::startWorker(int worker_idx)
+        {
+            if (!this->worker_stats_[worker_idx])
+                this->worker_stats_[worker_idx].reset(new mthread::_WorkerStats);
+            if (this->policy_ == mthread::SchedulePolicy::SharedQueue)
+                this->work_thds_.emplace_back(&ThreadPool::worker, this, worker_idx);
+            else this->work_thds_.emplace_back(&ThreadPool::pollingWorker, this, worker_idx);
+            if (!this->worker_cpus_[worker_idx].empty())
+                mthread::_setThreadAffinity(this->work_thds_.back(), this->worker_cpus_[worker_idx]);
+        }
+
+        inline void ThreadPool::resize(int pool_size)
+        {
+            if (pool_size <= 0 || pool_size > this->max_size_)
+            {
+                int valid_size = pool_size <= 0 ? 1 : this->max_size_;
+                mprintfW("Invalid param value pool_size:%d, which will be set to %d.\n", pool_size, valid_size);
+                pool_size = valid_size;
+            }
+            if (this->findCurrentWorkerIdx() >= 0)
+            {
+                mprintfW("ThreadPool cannot be resized in its own worker thread.\n");
+                return;
+            }
+            std::lock_guard<std::mutex> resize_lk(this->resize_mtx_);
+            int old_size = this->pool_size_.load();
+            if (pool_size > old_size)
+            {
+                if (this->policy_ == mthread::SchedulePolicy::WorkStealing)
+                {
+                    //先创建队列再增加线程数，使按线程数分配任务的线程总能访问到已创建的队列
+                    for (int i = this->num_queues_.load(); i < pool_size; ++i)
+                        this->local_queues_[i].reset(new ThreadPool::LocalQueue);
+                    this->num_queues_ = std::max(this->num_queues_.load(), pool_size);
+                }
+                this->pool_size_ = pool_size;
+                for (int i = old_size; i < pool_size; ++i)
+                    this->startWorker(i);
+            }
+            else if (pool_size < old_size)
+            {
+                {
+                    std::lock_guard<std::mutex> lk(this->task_mtx_);
+                    this->pool_size_ = pool_size;
+                }
+                this->cond_var_.notify_all();
+                for (int i = pool_size; i < old_size; ++i)
+                    this->work_thds_[i].join();
+                this->work_thds_.resize(pool_size);
+            }
+        }
+
+        inline int ThreadPool::getPoolSize() const
+        {
+            return this->pool_size_.load();
+        }
+
+        inline bool ThreadPool::setWorkerAffinity(int worker_idx, const std::vector<int>& cpu_ids)
+        {
+            if (worker_idx < 0 || worker_idx >= this->max_size_)
+            {
+                mprintfW("Invalid param value worker_idx:%d.\n", worker_idx);
+                return false;
+            }
+            std::lock_guard<std::mutex> resize_lk(this->resize_mtx_);
+            this->worker_cpus_[worker_idx] = cpu_ids;
+            if (worker_idx >= static_cast<int>(this->work_thds_.size()))
+                return true;
+            return mthread::_setThreadAffinity(this->work_thds_[worker_idx], cpu_ids);
+        }
+
+        inline void ThreadPool::setIdleSpinTime(long long spin_us)
+        {
+            this->idle_spin_us_.store(spin_us, std::memory_order_relaxed);
+        }
+
+
+        class TaskGraph::Node
+        {
+        public:
+            std::function<void()> func;
+            std::vector<int> successors;
+            int num_predecessors = 0;
+            std::atomic<int> num_waiting{ 0 };
+        };
+
+        //线程池中储存的节点任务，未执行即被销毁(线程池已停止)时取消该节点，保证本次运行能够结束
+        class TaskGraph::NodeTask
+        {
+        public:
+            NodeTask(TaskGraph* graph, int node_id) :graph_(graph), node_id_(node_id) {}
+
+            NodeTask(NodeTask&& tmp) noexcept :graph_(tmp.graph_), node_id_(tmp.node_id_)
+            {
+                tmp.graph_ = nullptr;
+            }
+
+            ~NodeTask()
+            {
+                if (this->graph_)
+                    this->graph_->cancelNode(this->node_id_);
+            }
+
+            void operator()()
+            {
+                TaskGraph* graph = this->graph_;
+                this->graph_ = nullptr;
+                graph->runNode(this->node_id_);
+            }
+
+            NodeTask(const NodeTask& tmp) = delete;
+            NodeTask& operator=(const NodeTask& tmp) = delete;
+            NodeTask& operator=(NodeTask&& tmp) = delete;
+
+        private:
+            TaskGraph* graph_;
+            int node_id_;
+        };
+
+        template<class Fn>
+        inline int TaskGraph::addNode(Fn&& func, const std::vector<int>& predecessors)
+        {
+            int node_id = static_cast<int>(this->nodes_.size());
+            for (int pred_id : predecessors)
+            {
+                if (pred_id < 0 || pred_id >= node_id)
+                {
+                    mprintfW("Invalid predecessor id:%d, which should be the id of an added node.\n", pred_id);
+                    return -1;
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lk(this->mtx_);
+                if (this->running_)
+                {
+                    mprintfW("TaskGraph is running, so the node can not be added!\n");
+                    return -1;
+                }
+            }
+
+            std::unique_ptr<TaskGraph::Node> node(new TaskGraph::Node);
+            node->func = std::forward<Fn>(func);
+            node->num_predecessors = static_cast<int>(predecessors.size());
+            for (int pred_id : predecessors)
+                this->nodes_[pred_id]->successors.push_back(node_id);
+            if (predecessors.empty())
+                this->roots_.push_back(node_id);
+            this->nodes_.push_back(std::move(node));
+            return node_id;
+        }
+
+        inline bool TaskGraph::run(mthread::ThreadPool& thd_pool)
+        {
+            {
+                std::lock_guard<std::mutex> lk(this->mtx_);
+                if (this->running_)
+                {
+                    mprintfW("The last run of TaskGraph has not finished yet!\n");
+                    return false;
+                }
+                this->exception_ = nullptr;
+                if (this->nodes_.empty())
+                    return true;
+                this->running_ = true;
+            }
+            this->thd_pool_ = &thd_pool;
+            this->failed_.store(false, std::memory_order_relaxed);
+            for (auto& node : this->nodes_)
+                node->num_waiting.store(node->num_predecessors, std::memory_order_relaxed);
+            this->num_unfinished_.store(static_cast<int>(this->nodes_.size()));
+            for (int root_id : this->roots_)
+                this->postNode(root_id);
+            return true;
+        }
+
+        inline void TaskGraph::wait()
+        {
+            std::unique_lock<std::mutex> lk(this->mtx_);
+            while (this->running_)
+            {
+                this->cond_.wait(lk);
+            }
+            if (this->exception_)
+                std::rethrow_exception(this->exception_);
+        }
+
+        inline bool TaskGraph::finished()
+        {
+            std::lock_guard<std::mutex> lk(this->mtx_);
+            return !this->running_;
+        }
+
+        inline int TaskGraph::size()
+        {
+            return static_cast<int>(this->nodes_.size());
+        }
+
+        inline TaskGraph::~TaskGraph()
+        {
+            std::unique_lock<std::mutex> lk(this->mtx_);
+            while (this->running_)
+            {
+                this->cond_.wait(lk);
+            }
+        }
+
+        inline void TaskGraph::postNode(int node_id)
+        {
+            this->thd_pool_->pushTask(mthread::_InlineTask(TaskGraph::NodeTask(this, node_id)));
+        }
+
+        inline void TaskGraph::cancelNode(int node_id)
+        {
+            {
+                std::lock_guard<std::mutex> lk(this->mtx_);
+                if (!this->exception_)
+                    this->exception_ = std::make_exception_ptr(mthread::TaskCancelledError());
+                this->failed_.store(true, std::memory_order_relaxed);
+            }
+            //failed_已置位，节点函数不会执行，只推进依赖计数；后继节点同样会因线程池已停止而被取消
+            this->runNode(node_id);
+        }
+
+        inline void TaskGraph::runNode(int node_id)
+        {
+            while (node_id >= 0)
+            {
+                TaskGraph::Node& node = *this->nodes_[node_id];
+                //已有节点失败时跳过后续节点的函数，但仍然推进依赖计数以结束本次运行
+                if (!this->failed_.load(std::memory_order_relaxed))
+                {
+                    try
+                    {
+                        node.func();
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lk(this->mtx_);
+                        if (!this->exception_)
+                            this->exception_ = std::current_exception();
+                        this->failed_.store(true, std::memory_order_relaxed);
+                    }
+                }
+
+                //第一个就绪的后继节点直接在当前线程继续执行，其余的提交到线程池
+                int next_id = -1;
+                for (int succ_id : node.successors)
+                {
+                    if (this->nodes_[succ_id]->num_waiting.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    {
+                        if (next_id < 0)
+                            next_id = succ_id;
+                        else this->postNode(succ_id);
+                    }
+                }
+                if (this->num_unfinished_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    //在锁内通知，避免等待者被唤醒后立即析构TaskGraph
+                    std::lock_guard<std::mutex> lk(this->mtx_);
+                    this->running_ = false;
+                    this->cond_.notify_all();
+                    return;
+                }
+                node_id = next_id;
+            }
+        }
+
+
+        inline ThreadPauser::ThreadPauser()
+        {
+            this->need_pause_.store(false);
+        }
+
+        inline ThreadPauser::~ThreadPauser()
+        {
+            this->resume();
+        }
+
+        inline void ThreadPauser::setPausePoint()
+        {
+            if (this->need_pause_.load(std::memory_order_acquire))
+            {
+                std::unique_lock<std::mutex> lk(this->mtx_);
+                while (this->need_pause_.load(std::memory_order_acquire))
+                {
+                    this->cond_.wait(lk);
+                }
+            }
+        }
+
+        inline void ThreadPauser::setPausePoint(std::atomic<bool>& pause_point_state)
+        {          
+            if (this->need_pause_.load(std::memory_order_acquire))
+            {
+                std::unique_lock<std::mutex> lk(this->mtx_);
+                while (this->need_pause_.load(std::memory_order_acquire))
+                {
+                    pause_point_state.store(true);
+                    this->cond_.wait(lk);  //据说wait内部，先加锁cond_var内部锁，再解锁lk
+                }
+            }
+            if (pause_point_state.load(std::memory_order_relaxed))
+                pause_point_state.store(false);
+        }
+
+        inline void ThreadPauser::pause()
+        {
+            this->need_pause_.store(true, std::memory_order_release);
+        }
+
+        inline void ThreadPauser::resume()
+        {
+            {
+                std::lock_guard<std::mutex> lk(this->mtx_);
+                this->need_pause_.store(false, std::memory_order_release);
+            }
+            this->cond_.notify_all();  //据说notify内部，先加锁cond_var内部锁，再通知，因此不用担心cond_var在lk解锁后进入wait前，notify触发而导致错过
+        }
+
+        inline bool ThreadPauser::isPaused()
+        {
+            return this->need_pause_.load(std::memory_order_acquire);
+        }
+
+
+        inline ParkingThreadPauser::ParkingThreadPauser()
+        {
+            this->epoch_.store(0);
+            this->num_parked_[0].store(0);
+            this->num_parked_[1].store(0);
+            this->park_seq_.store(0);
+            this->num_waiting_controllers_.store(0);
+        }
+
+        inline ParkingThreadPauser::~ParkingThreadPauser()
+        {
+            this->resume();
+        }
+
+        inline void ParkingThreadPauser::setPausePoint()
+        {
+            int epoch = this->epoch_.load(std::memory_order_acquire);
+            if (epoch & 1)
+                this->park(epoch);
+        }
+
+        inline void ParkingThreadPauser::setPausePoint(std::atomic<bool>& pause_point_state)
+        {
+            int epoch = this->epoch_.load(std::memory_order_acquire);
+            if (epoch & 1)
+            {
+                pause_point_state.store(true);
+                this->park(epoch);
+                pause_point_state.store(false);
+            }
+            else if (pause_point_state.load(std::memory_order_relaxed))
+                pause_point_state.store(false);
+        }
+
+        inline void ParkingThreadPauser::pause()
+        {
+            int epoch = this->epoch_.load();
+            while (!(epoch & 1) && !this->epoch_.compare_exchange_weak(epoch, epoch + 1));
+        }
+
+        inline bool ParkingThreadPauser::pauseAndWaitAllParked(int num_pause_points)
+        {
+            this->pause();
+            return this->waitAllParked(num_pause_points, nullptr);
+        }
+
+        inline bool ParkingThreadPauser::pauseAndWaitAllParked(int num_pause_points, const mtime::Duration& timeout)
+        {
+            mtime::TimePoint deadline = mtime::now() + timeout;
+            this->pause();
+            return this->waitAllParked(num_pause_points, &deadline);
+        }
+
+        inline void ParkingThreadPauser::resume()
+        {
+            int epoch = this->epoch_.load();
+            while (true)
+            {
+                if (!(epoch & 1))
+                    return;
+                if (this->epoch_.compare_exchange_weak(epoch, epoch + 1))
+                    break;
+            }
+            //停靠线程先增加计数再检查纪元，此处先修改纪元再检查计数，两者至少有一方能看到对方的修改
+            if (this->num_parked_[(epoch >> 1) & 1].load() > 0)
+                mthread::_futexWake(this->epoch_, std::numeric_limits<int>::max());
+            this->park_seq_.fetch_add(1);
+            if (this->num_waiting_controllers_.load() > 0)
+                mthread::_futexWake(this->park_seq_, std::numeric_limits<int>::max());
+        }
+
+        inline bool ParkingThreadPauser::isPaused()
+        {
+            return (this->epoch_.load(std::memory_order_acquire) & 1) != 0;
+        }
+
+        inline int ParkingThreadPauser::getNumParked()
+        {
+            return this->num_parked_[0].load() + this->num_parked_[1].load();
+        }
+
+        inline void ParkingThreadPauser::park(int epoch)
+        {
+            std::atomic<int>& num_parked = this->num_parked_[(epoch >> 1) & 1];
+            num_parked.fetch_add(1);
+            this->park_seq_.fetch_add(1);
+            if (this->num_waiting_controllers_.load() > 0)
+                mthread::_futexWake(this->park_seq_, std::numeric_limits<int>::max());
+            while (this->epoch_.load() == epoch)
+                mthread::_futexWait(this->epoch_, epoch);
+            num_parked.fetch_sub(1);
+        }
+
+        inline bool ParkingThreadPauser::waitAllParked(int num_pause_points, const mtime::TimePoint* deadline)
+        {
+            int epoch = this->epoch_.load();
+            if (!(epoch & 1))
+                return false;
+            std::atomic<int>& num_parked = this->num_parked_[(epoch >> 1) & 1];
+            this->num_waiting_controllers_.fetch_add(1);
+            bool all_parked = false;
+            while (true)
+            {
+                //先读park_seq_再检查条件，之后的停靠或resume都会改变park_seq_，使休眠立即返回
+                int seq = this->park_seq_.load();
+                if (num_parked.load() >= num_pause_points)
+                {
+                    all_parked = true;
+                    break;
+                }
+                if (this->epoch_.load() != epoch)
+                    break;
+                if (deadline)
+                {
+                    if (mtime::now() >= *deadline)
+                        break;
+                    mthread::_futexWaitUntil(this->park_seq_, seq, *deadline);
+                }
+                else mthread::_futexWait(this->park_seq_, seq);
+            }
+            this->num_waiting_controllers_.fetch_sub(1);
+            return all_parked;
+        }
+
+
+        inline long long PipelineStageStats::meanNs() const
+        {
+            return this->num_processed > 0 ? this->busy_ns / this->num_processed : 0;
+        }
+
+        inline double PipelineStageStats::throughput() const
+        {
+            return this->elapsed_ns > 0 ? this->num_processed * 1e9 / this->elapsed_ns : 0;
+        }
+
+        //Pipeline各阶段之间的有界阻塞队列，元素附带输入序号；关闭后仍可取出剩余元素，中止后立即丢弃
+        template<class T>
+        class _PipelineQueue
+        {
+        public:
+            explicit _PipelineQueue(size_t capacity)
+            {
+                this->capacity_ = capacity >= 1 ? capacity : 1;
+            }
+
+            //队列已满时阻塞等待，已关闭或中止时返回false
+            bool push(unsigned long long seq, T&& value)
+            {
+                std::unique_lock<std::mutex> lk(this->mtx_);
+                while (this->items_.size() >= this->capacity_ && !this->closed_ && !this->aborted_)
+                    this->not_full_cond_.wait(lk);
+                if (this->closed_ || this->aborted_)
+                    return false;
+                this->items_.emplace_back(seq, std::move(value));
+                lk.unlock();
+                this->not_empty_cond_.notify_one();
+                return true;
+            }
+
+            bool tryPush(unsigned long long seq, T&& value)
+            {
+                {
+                    std::lock_guard<std::mutex> lk(this->mtx_);
+                    if (this->items_.size() >= this->capacity_ || this->closed_ || this->aborted_)
+                        return false;
+                    this->items_.emplace_back(seq, std::move(value));
+                }
+                this->not_empty_cond_.notify_one();
+                return true;
+            }
+
+            //队列为空时阻塞等待，已关闭且取空、或已中止时返回false
+            bool pop(unsigned long long& seq, T& value)
+            {
+                std::unique_lock<std::mutex> lk(this->mtx_);
+                while (this->items_.empty() && !this->closed_ && !this->aborted_)
+                    this->not_empty_cond_.wait(lk);
+                if (this->items_.empty() || this->aborted_)
+                    return false;
+                seq = this->items_.front().first;
+                value = std::move(this->items_.front().second);
+                this->items_.pop_front();
+                lk.unlock();
+                this->not_full_cond_.notify_one();
+                return true;
+            }
+
+            bool tryPop(unsigned long long& seq, T& value)
+            {
+                {
+                    std::lock_guard<std::mutex> lk(this->mtx_);
+                    if (this->items_.empty() || this->aborted_)
+                        return false;
+                    seq = this->items_.front().first;
+                    value = std::move(this->items_.front().second);
+                    this->items_.pop_front();
+                }
+                this->not_full_cond_.notify_one();
+                return true;
+            }
+
+            void close()
+            {
+                {
+                    std::lock_guard<std::mutex> lk(this->mtx_);
+                    this->closed_ = true;
+                }
+                this->not_empty_cond_.notify_all();
+                this->not_full_cond_.notify_all();
+            }
+
+            void abort()
+            {
+                {
+                    std::lock_guard<std::mutex> lk(this->mtx_);
+                    this->aborted_ = true;
+                    this->items_.clear();
+                }
+                this->not_empty_cond_.notify_all();
+                this->not_full_cond_.notify_all();
+            }
+
+            size_t size()
+            {
+                std::lock_guard<std::mutex> lk(this->mtx_);
+                return this->items_.size();
+            }
+
+            size_t capacity()
+            {
+                return this->capacity_;
+            }
+
+        private:
+            std::mutex mtx_;
+            std::condition_variable not_empty_cond_;
+            std::condition_variable not_full_cond_;
+            std::deque<std::pair<unsigned long long, T>> items_;
+            size_t capacity_ = 1;
+            bool closed_ = false;
+            bool aborted_ = false;
+        };
+
+        //Pipeline阶段中与元素类型无关的部分：工作线程、暂停和统计
+        class _PipelineStageBase
+        {
+        public:
+            _PipelineStageBase(const std::string& stage_name, int num_workers, size_t capacity)
+            {
+                this->name = stage_name;
+                this->parallelism = num_workers;
+                this->queue_capacity = capacity;
+                this->num_alive_workers.store(0);
+                this->num_processed.store(0);
+                this->num_failed.store(0);
+                this->busy_ns.store(0);
+                this->aborted.store(false);
+            }
+
+            virtual ~_PipelineStageBase() {}
+
+            void start()
+            {
+                this->start_t = mtime::now();
+                this->num_alive_workers.store(this->parallelism);
+                for (int i = 0; i < this->parallelism; i++)
+                    this->workers.emplace_back(&_PipelineStageBase::workerLoop, this);
+            }
+
+            void join()
+            {
+                for (auto& worker : this->workers)
+                {
+                    if (worker.joinable())
+                        worker.join();
+                }
+            }
+
+            void abort()
+            {
+                this->aborted.store(true);
+                this->abortQueue();
+                this->pauser.resume();
+            }
+
+            mthread::PipelineStageStats getStats()
+            {
+                mthread::PipelineStageStats stats;
+                stats.name = this->name;
+                stats.parallelism = this->parallelism;
+                stats.queue_capacity = this->queue_capacity;
+                stats.queue_size = this->queueSize();
+                stats.num_processed = this->num_processed.load();
+                stats.num_failed = this->num_failed.load();
+                stats.busy_ns = this->busy_ns.load();
+                if (!this->workers.empty())
+                    stats.elapsed_ns = mtime::ns(mtime::now() - this->start_t);
+                stats.paused = this->pauser.isPaused();
+                return stats;
+            }
+
+            virtual void closeQueue() = 0;
+            virtual size_t queueSize() = 0;
+
+            std::string name;
+            int parallelism = 1;
+            size_t queue_capacity = 1;
+            mthread::ParkingThreadPauser pauser;
+            std::function<void(unsigned long long)> on_drop;   //元素被丢弃时通知Pipeline，使有序输出跳过该序号
+            std::function<void()> on_finish;   //所有工作线程退出后关闭下游队列
+            std::vector<std::thread> workers;
+            std::atomic<int> num_alive_workers;
+            std::atomic<long long> num_processed;
+            std::atomic<long long> num_failed;
+            std::atomic<long long> busy_ns;
+            std::atomic<bool> aborted;
+            mtime::TimePoint start_t;
+
+        protected:
+            virtual void abortQueue() = 0;
+
+            //处理输入队列中的元素直到队列关闭并取空或被中止
+            virtual void processAll() = 0;
+
+        private:
+            void workerLoop()
+            {
+                this->processAll();
+                if (this->num_alive_workers.fetch_sub(1) == 1)
+                    this->on_finish();
+            }
+        };
+
+        //按输出类型区分的阶段，用于在添加下一阶段时检查类型是否衔接
+        template<class Out>
+        class _PipelineSource :public _PipelineStageBase
+        {
+        public:
+            _PipelineSource(const std::string& stage_name, int num_workers, size_t capacity) :_PipelineStageBase(stage_name, num_workers, capacity) {}
+
+            std::function<void(unsigned long long, Out&&)> emit;   //把处理结果交给下游阶段或输出队列
+        };
+
+        template<class In, class Out>
+        class _PipelineStage :public _PipelineSource<Out>
+        {
+        public:
+            template<class Fn>
+            _PipelineStage(const std::string& stage_name, Fn&& stage_func, int num_workers, size_t capacity) :
+                _PipelineSource<Out>(stage_name, num_workers, capacity), input_queue(capacity), func(std::forward<Fn>(stage_func)) {}
+
+            void closeQueue() override
+            {
+                this->input_queue.close();
+            }
+
+            size_t queueSize() override
+            {
+                return this->input_queue.size();
+            }
+
+            mthread::_PipelineQueue<In> input_queue;
+            std::function<Out(In)> func;
+
+        protected:
+            void abortQueue() override
+            {
+                this->input_queue.abort();
+            }
+
+            void processAll() override
+            {
+                unsigned long long seq = 0;
+                In item;
+                while (this->input_queue.pop(seq, item))
+                {
+                    this->pauser.setPausePoint();
+                    if (this->aborted.load(std::memory_order_relaxed))
+                        break;
+                    try
+                    {
+                        mtime::TimePoint start_t = mtime::now();
+                        Out result = this->func(std::move(item));
+                        this->busy_ns.fetch_add(mtime::ns(mtime::now() - start_t), std::memory_order_relaxed);
+                        this->num_processed.fetch_add(1, std::memory_order_relaxed);
+                        this->emit(seq, std::move(result));
+                    }
+                    //只在首次丢弃时输出警告，之后的丢弃只计入统计
+                    catch (std::exception& e)
+                    {
+                        if (this->num_failed.fetch_add(1, std::memory_order_relaxed) == 0)
+                            mprintfW("Pipeline stage \"%s\" dropped an item: %s\n", this->name.c_str(), e.what());
+                        this->on_drop(seq);
+                    }
+                    catch (...)
+                    {
+                        if (this->num_failed.fetch_add(1, std::memory_order_relaxed) == 0)
+                            mprintfW("Pipeline stage \"%s\" dropped an item because of an unknown exception!\n", this->name.c_str());
+                        this->on_drop(seq);
+                    }
+                }
+            }
+        };
+
+        template<class In, class Out>
+        inline Pipeline<In, Out>::Pipeline(mthread::PipelineOrder order, size_t output_capacity) :output_queue_(output_capacity)
+        {
+            if (output_capacity < 1)
+                mprintfW("Invalid param value output_capacity:%llu, which will be set to 1.\n", static_cast<unsigned long long>(output_capacity));
+            this->order_ = order;
+            this->next_seq_.store(0);
+        }
+
+        template<class In, class Out>
+        inline Pipeline<In, Out>::~Pipeline()
+        {
+            this->abort();
+            for (auto& stage : this->stages_)
+                stage->join();
+        }
+
+        template<class In, class Out>
+        template<class StageIn, class StageOut, class Fn>
+        inline Pipeline<In, Out>& Pipeline<In, Out>::addStage(const std::string& name, Fn&& func, int parallelism, size_t queue_capacity)
+        {
+            if (this->started_)
+                throw std::runtime_error("Error: Pipeline::addStage can only be called before start!");
+            if (parallelism < 1)
+            {
+                mprintfW("Invalid param value parallelism:%d, which will be set to 1.\n", parallelism);
+                parallelism = 1;
+            }
+            if (queue_capacity < 1)
+            {
+                mprintfW("Invalid param value queue_capacity:%llu, which will be set to 1.\n", static_cast<unsigned long long>(queue_capacity));
+                queue_capacity = 1;
+            }
+            std::unique_ptr<_PipelineStage<StageIn, StageOut>> stage(new _PipelineStage<StageIn, StageOut>(name, std::forward<Fn>(func), parallelism, queue_capacity));
+            _PipelineStage<StageIn, StageOut>* next = stage.get();
+            if (this->stages_.empty())
+            {
+                _PipelineStage<In, StageOut>* first = dynamic_cast<_PipelineStage<In, StageOut>*>(static_cast<_PipelineStageBase*>(next));
+                if (!first)
+                    throw std::runtime_error("Error: The input type of the first pipeline stage must be the input type of Pipeline!");
+                this->input_queue_ = &first->input_queue;
+            }
+            else
+            {
+                _PipelineSource<StageIn>* prev = dynamic_cast<_PipelineSource<StageIn>*>(this->stages_.back().get());
+                if (!prev)
+                    throw std::runtime_error("Error: The input type of a pipeline stage must be the output type of the previous stage!");
+                prev->emit = [next](unsigned long long seq, StageIn&& value)
+                {
+                    if (!next->input_queue.push(seq, std::move(value)))
+                        next->on_drop(seq);
+                };
+                prev->on_finish = [next]() { next->closeQueue(); };
+            }
+            stage->on_drop = [this](unsigned long long seq) { this->skip(seq); };
+            this->stages_.push_back(std::move(stage));
+            return *this;
+        }
+
+        template<class In, class Out>
+        inline void Pipeline<In, Out>::start()
+        {
+            if (this->started_)
+                throw std::runtime_error("Error: Pipeline has already been started!");
+            if (this->stages_.empty())
+                throw std::runtime_error("Error: Pipeline has no stage!");
+            _PipelineSource<Out>* last = dynamic_cast<_PipelineSource<Out>*>(this->stages_.back().get());
+            if (!last)
+                throw std::runtime_error("Error: The output type of the last pipeline stage must be the output type of Pipeline!");
+            last->emit = [this](unsigned long long seq, Out&& value) { this->deliver(seq, std::move(value)); };
+            last->on_finish = [this]() { this->output_queue_.close(); };
+            if (this->order_ == mthread::PipelineOrder::Ordered)
+            {
+                //初始容量覆盖流水线中能同时容纳的元素数，一般不需要扩容
+                size_t num_in_flight = 1;
+                for (auto& stage : this->stages_)
+                    num_in_flight += stage->queue_capacity + static_cast<size_t>(stage->parallelism);
+                size_t capacity = 16;
+                while (capacity < num_in_flight)
+                    capacity <<= 1;
+                this->reorder_items_.resize(capacity);
+                this->reorder_states_.assign(capacity, Pipeline::REORDER_EMPTY);
+            }
+            this->started_ = true;
+            for (auto& stage : this->stages_)
+                stage->start();
+        }
+
+        template<class In, class Out>
+        inline bool Pipeline<In, Out>::push(In value)
+        {
+            if (!this->started_)
+                throw std::runtime_error("Error: Pipeline::push can only be called after start!");
+            unsigned long long seq = this->next_seq_.fetch_add(1);
+            if (this->input_queue_->push(seq, std::move(value)))
+                return true;
+            this->skip(seq);
+            return false;
+        }
+
+        template<class In, class Out>
+        inline bool Pipeline<In, Out>::tryPush(In value)
+        {
+            if (!this->started_)
+                throw std::runtime_error("Error: Pipeline::tryPush can only be called after start!");
+            unsigned long long seq = this->next_seq_.fetch_add(1);
+            if (this->input_queue_->tryPush(seq, std::move(value)))
+                return true;
+            this->skip(seq);
+            return false;
+        }
+
+        template<class In, class Out>
+        inline bool Pipeline<In, Out>::pop(Out& value)
+        {
+            unsigned long long seq;
+            return this->output_queue_.pop(seq, value);
+        }
+
+        template<class In, class Out>
+        inline bool Pipeline<In, Out>::tryPop(Out& value)
+        {
+            unsigned long long seq;
+            return this->output_queue_.tryPop(seq, value);
+        }
+
+        template<class In, class Out>
+        inline void Pipeline<In, Out>::close()
+        {
+            if (this->input_queue_)
+                this->input_queue_->close();
+            if (!this->started_)
+                this->output_queue_.close();
+        }
+
+        template<class In, class Out>
+        inline void Pipeline<In, Out>::abort()
+        {
+            for (auto& stage : this->stages_)
+                stage->abort();
+            this->output_queue_.abort();
+        }
+
+        template<class In, class Out>
+        inline void Pipeline<In, Out>::pauseStage(int stage_index)
+        {
+            this->getStage(stage_index)->pauser.pause();
+        }
+
+        template<class In, class Out>
+        inline void Pipeline<In, Out>::resumeStage(int stage_index)
+        {
+            this->getStage(stage_index)->pauser.resume();
+        }
+
+        template<class In, class Out>
+        inline bool Pipeline<In, Out>::isStagePaused(int stage_index)
+        {
+            return this->getStage(stage_index)->pauser.isPaused();
+        }
+
+        template<class In, class Out>
+        inline int Pipeline<In, Out>::getNumStages()
+        {
+            return static_cast<int>(this->stages_.size());
+        }
+
+        template<class In, class Out>
+        inline mthread::PipelineStageStats Pipeline<In, Out>::getStageStats(int stage_index)
+        {
+            return this->getStage(stage_index)->getStats();
+        }
+
+        template<class In, class Out>
+        inline void Pipeline<In, Out>::printStageStats(mtime::Unit time_unit)
+        {
+            const char* unit_name = "ms";
+            long long ns_per_unit = 1000000;
+            if (time_unit == mtime::Unit::s)
+            {
+                unit_name = "s";
+                ns_per_unit = 1000000000;
+            }
+            else if (time_unit == mtime::Unit::us)
+            {
+                unit_name = "us";
+                ns_per_unit = 1000;
+            }
+            else if (time_unit == mtime::Unit::ns)
+            {
+                unit_name = "ns";
+                ns_per_unit = 1;
+            }
+            for (auto& stage : this->stages_)
+            {
+                mthread::PipelineStageStats stats = stage->getStats();
+                printf("%s mean cost time %lld%s in %lld counts, %.1f items/s, queue %llu/%llu%s\n", stats.name.c_str(), stats.meanNs() / ns_per_unit, unit_name,
+                    stats.num_processed, stats.throughput(), static_cast<unsigned long long>(stats.queue_size), static_cast<unsigned long long>(stats.queue_capacity),
+                    stats.paused ? ", paused" : "");
+            }
+        }
+
+        template<class In, class Out>
+        inline _PipelineStageBase* Pipeline<In, Out>::getStage(int stage_index)
+        {
+            if (stage_index < 0 || stage_index >= static_cast<int>(this->stages_.size()))
+                throw std::runtime_error("Error: Pipeline stage index out of range!");
+            return this->stages_[stage_index].get();
+        }
+
+        template<class In, class Out>
+        inline void Pipeline<In, Out>::deliver(unsigned long long seq, Out&& value)
+        {
+            if (this->order_ == mthread::PipelineOrder::Unordered)
+            {
+                this->output_queue_.push(seq, std::move(value));
+                return;
+            }
+            std::unique_lock<std::mutex> lk(this->reorder_mtx_);
+            //输出队列已满时写入线程阻塞，其他完成的元素在此等待，背压由此传递到最后一个阶段
+            while (this->reorder_flushing_)
+                this->reorder_cond_.wait(lk);
+            size_t slot = this->reserveReorderSlot(seq);
+            this->reorder_items_[slot] = std::move(value);
+            this->reorder_states_[slot] = Pipeline::REORDER_READY;
+            if (seq == this->next_output_seq_)
+                this->flushReorderBuffer(lk);
+        }
+
+        template<class In, class Out>
+        inline void Pipeline<In, Out>::skip(unsigned long long seq)
+        {
+            if (this->order_ == mthread::PipelineOrder::Unordered)
+                return;
+            std::unique_lock<std::mutex> lk(this->reorder_mtx_);
+            size_t slot = this->reserveReorderSlot(seq);
+            this->reorder_states_[slot] = Pipeline::REORDER_SKIPPED;
+            //正在写入的线程会在下一轮跳过该序号，这里不需要等待
+            if (seq == this->next_output_seq_ && !this->reorder_flushing_)
+                this->flushReorderBuffer(lk);
+        }
+
+        //调用前需持有reorder_mtx_；序号超出缓冲区范围时扩容，已有元素按新容量重新放置
+        template<class In, class Out>
+        inline size_t Pipeline<In, Out>::reserveReorderSlot(unsigned long long seq)
+        {
+            size_t capacity = this->reorder_items_.size();
+            if (seq - this->next_output_seq_ >= capacity)
+            {
+                size_t new_capacity = capacity;
+                while (seq - this->next_output_seq_ >= new_capacity)
+                    new_capacity <<= 1;
+                std::vector<Out> new_items(new_capacity);
+                std::vector<unsigned char> new_states(new_capacity, Pipeline::REORDER_EMPTY);
+                for (size_t i = 0; i < capacity; i++)
+                {
+                    unsigned long long old_seq = this->next_output_seq_ + i;
+                    size_t old_slot = static_cast<size_t>(old_seq & (capacity - 1));
+                    size_t new_slot = static_cast<size_t>(old_seq & (new_capacity - 1));
+                    new_items[new_slot] = std::move(this->reorder_items_[old_slot]);
+                    new_states[new_slot] = this->reorder_states_[old_slot];
+                }
+                this->reorder_items_.swap(new_items);
+                this->reorder_states_.swap(new_states);
+                capacity = new_capacity;
+            }
+            return static_cast<size_t>(seq & (capacity - 1));
+        }
+
+        //调用前需持有reorder_mtx_且没有其他线程在写入；每轮在锁内取出从next_output_seq_开始连续就绪的元素，解锁后写入输出队列
+        template<class In, class Out>
+        inline void Pipeline<In, Out>::flushReorderBuffer(std::unique_lock<std::mutex>& lk)
+        {
+            this->reorder_flushing_ = true;
+            while (true)
+            {
+                size_t mask = this->reorder_items_.size() - 1;
+                while (true)
+                {
+                    size_t slot = static_cast<size_t>(this->next_output_seq_ & mask);
+                    unsigned char state = this->reorder_states_[slot];
+                    if (state == Pipeline::REORDER_EMPTY)
+                        break;
+                    if (state == Pipeline::REORDER_READY)
+                        this->reorder_batch_.emplace_back(this->next_output_seq_, std::move(this->reorder_items_[slot]));
+                    this->reorder_states_[slot] = Pipeline::REORDER_EMPTY;
+                    ++this->next_output_seq_;
+                }
+                if (this->reorder_batch_.empty())
+                    break;
+                lk.unlock();
+                for (auto& item : this->reorder_batch_)
+                    this->output_queue_.push(item.first, std::move(item.second));
+                this->reorder_batch_.clear();
+                lk.lock();
+            }
+            this->reorder_flushing_ = false;
+            lk.unlock();
+            this->reorder_cond_.notify_all();
+        }
+
+
+        //已废弃
+        inline ThreadPool::ThreadPool(int pool_size, long long wakeup_period_ms) :ThreadPool(pool_size, mthread::SchedulePolicy::SharedQueue) {}
+    }
+
+
+
+#ifdef MINEUTILS_TEST_MODULES
+    namespace _mthreadcheck
+    {
+        template<class LockT>
+        inline bool _checkLockExclusion()
+        {
+            LockT splk;
+            char strs[] = "Hello World";
+
+            bool func1_check_ret = true;
+            auto func1 = [&strs, &splk, &func1_check_ret]()
+            {
+                for (int i = 0; i < 10000; i++)
+                {
+                    auto guard = splk.lockGuard();
+                    strs[0] = 'W';
+                    strs[1] = 'o';
+                    strs[2] = 'r';
+                    strs[3] = 'l';
+                    strs[4] = 'd';
+                    func1_check_ret = func1_check_ret && (std::string("World World") == strs);
+                }
+            };
+
+            bool func2_check_ret = true;
+            auto func2 = [&strs, &splk, &func2_check_ret]()
+            {
+                for (int i = 0; i < 10000; i++)
+                {
+                    auto guard = splk.lockGuard();
+                    strs[0] = 'H';
+                    strs[1] = 'e';
+                    strs[2] = 'l';
+                    strs[3] = 'l';
+                    strs[4] = 'o';
+                    func2_check_ret = func2_check_ret && (std::string("Hello World") == strs);
+                }
+            };
+
+            std::atomic<int> counter(0);
+            auto func3 = [&splk, &counter]()
+            {
+                for (int i = 0; i < 10000; i++)
+                {
+                    while (!splk.tryLock()) {}
+                    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    splk.unlock();
+                }
+            };
+            std::thread thd1(func1);
+            std::thread thd2(func2);
+            std::thread thd3(func3);
+            thd1.join();
+            thd2.join();
+            thd3.join();
+
+            bool try_ret = splk.tryLock() && !splk.tryLock();
+            splk.unlock();
+            return func1_check_ret && func2_check_ret && counter.load() == 10000 && try_ret;
+        }
+
+        inline void SpinLockTest()
+        {
+            printf("%s SpinLock check.\n", _checkLockExclusion<mthread::SpinLock>() ? "Passed." : "Failed!");
+            printf("%s TicketSpinLock check.\n", _checkLockExclusion<mthread::TicketSpinLock>() ? "Passed." : "Failed!");
+            printf("%s HybridMutex check.\n", _checkLockExclusion<mthread::HybridMutex>() ? "Passed." : "Failed!");
+            printf("\n");
+        }
+
+        template<class RWLockT>
+        inline void _checkReadWriteMutex(RWLockT& rwlk, const char* lock_name)
+        {
+            char strs[] = "Hello World";
+
+            bool func1_check_ret = true;
+            auto func1 = [&strs, &rwlk, &func1_check_ret]()
+            {
+                for (int i = 0; i < 10000; i++)
+                {
+                    auto guard = rwlk.lockReadGuard();
+                    strs[0] = 'W';
+                    strs[1] = 'o';
+                    strs[2] = 'r';
+                    strs[3] = 'l';
+                    strs[4] = 'd';
+                    func1_check_ret = func1_check_ret && (std::string("World World") == strs);
+                }
+            };
+
+            bool func2_check_ret = true;
+            auto func2 = [&strs, &rwlk, &func2_check_ret]()
+            {
+                for (int i = 0; i < 10000; i++)
+                {
+                    auto guard = rwlk.lockReadGuard();
+                    strs[0] = 'H';
+                    strs[1] = 'e';
+                    strs[2] = 'l';
+                    strs[3] = 'l';
+                    strs[4] = 'o';
+                    func2_check_ret = func2_check_ret && (std::string("Hello World") == strs);
+                }
+            };
+            {
+                std::thread thd1(func1);
+                std::thread thd2(func2);
+                thd1.join();
+                thd2.join();
+                printf("%s %s Read-Read Lock check.\n", !(func1_check_ret && func2_check_ret) ? "Passed." : "Maybe failed! Try again!", lock_name);
+            }
+
+            memcpy(strs, "Hello World", 11);
+            bool func3_check_ret = true;
+            auto func3 = [&strs, &rwlk, &func3_check_ret]()
+            {
+                for (int i = 0; i < 10000; i++)
+                {
+                    auto guard = rwlk.lockWriteGuard();
+                    strs[0] = 'W';
+                    strs[1] = 'o';
+                    strs[2] = 'r';
+                    strs[3] = 'l';
+                    strs[4] = 'd';
+                    func3_check_ret = func3_check_ret && (std::string("World World") == strs);
+                }
+            };
+
+            bool func4_check_ret = true;
+            auto func4 = [&strs, &rwlk, &func4_check_ret]()
+            {
+                for (int i = 0; i < 10000; i++)
+                {
+                    auto guard = rwlk.lockWriteGuard();
+                    strs[0] = 'H';
+                    strs[1] = 'e';
+                    strs[2] = 'l';
+                    strs[3] = 'l';
+                    strs[4] = 'o';
+                    func4_check_ret = func4_check_ret && (std::string("Hello World") == strs);
+                }
+            };
+
+            {
+                func1_check_ret = true;
+                func4_check_ret = true;
+                std::thread thd1(func1);
+                std::thread thd4(func4);
+                thd1.join();
+                thd4.join();
+                printf("%s %s Read-Write Lock check.\n", func1_check_ret && func4_check_ret ? "Passed." : "Failed!", lock_name);
+            }
+
+            {
+                func3_check_ret = true;
+                func4_check_ret = true;
+                std::thread thd3(func3);
+                std::thread thd4(func4);
+                thd3.join();
+                thd4.join();
+                printf("%s %s Write-Write Lock check.\n", func3_check_ret && func4_check_ret ? "Passed." : "Failed!", lock_name);
+            }
+
+            bool try_ret = rwlk.tryLockWrite() && !rwlk.tryLockWrite() && !rwlk.tryLockRead();
+            auto start_t = mtime::now();
+            try_ret = try_ret && !rwlk.tryLockReadFor(std::chrono::milliseconds(5)) && mtime::us(mtime::now() - start_t) >= 5000;
+            rwlk.unlockWrite();
+            try_ret = try_ret && rwlk.tryLockRead() && rwlk.tryLockRead() && !rwlk.tryLockWrite();
+            start_t = mtime::now();
+            try_ret = try_ret && !rwlk.tryLockWriteFor(std::chrono::milliseconds(5)) && mtime::us(mtime::now() - start_t) >= 5000;
+            rwlk.unlockRead();
+            rwlk.unlockRead();
+            try_ret = try_ret && rwlk.tryLockWriteFor(std::chrono::milliseconds(5));
+            rwlk.unlockWrite();
+            printf("%s %s try lock check.\n", try_ret ? "Passed." : "Failed!", lock_name);
+        }
+
+        //有读者持锁且写者等待时，新的读者能否加锁
+        template<class RWLockT>
+        inline bool _canReadWhileWriterWaiting(RWLockT& rwlk, bool& writer_blocked)
+        {
+            rwlk.lockRead();
+            std::atomic<bool> writer_done(false);
+            std::thread writer([&rwlk, &writer_done]()
+                {
+                    rwlk.lockWrite();
+                    writer_done = true;
+                    rwlk.unlockWrite();
+                });
+            mtime::msleep(20);
+            bool reader_entered = false;
+            std::thread reader([&rwlk, &reader_entered]()
+                {
+                    reader_entered = rwlk.tryLockRead();
+                    if (reader_entered)
+                        rwlk.unlockRead();
+                });
+            reader.join();
+            writer_blocked = !writer_done.load();
+            rwlk.unlockRead();
+            writer.join();
+            return reader_entered;
+        }
+
+        inline void ReadWriteMutexTest()
+        {
+            {
+                mthread::ReadWriteMutex rwlk;
+                _checkReadWriteMutex(rwlk, "ReadWriteMutex");
+                bool writer_blocked = false;
+                bool ret = _canReadWhileWriterWaiting(rwlk, writer_blocked) && writer_blocked;
+                printf("%s ReadWriteMutex(PreferReader) preference check.\n", ret ? "Passed." : "Failed!");
+            }
+            {
+                mthread::ReadWriteMutex rwlk(mthread::LockPreference::PreferWriter);
+                _checkReadWriteMutex(rwlk, "ReadWriteMutex(PreferWriter)");
+                bool writer_blocked = false;
+                bool ret = !_canReadWhileWriterWaiting(rwlk, writer_blocked) && writer_blocked;
+                printf("%s ReadWriteMutex(PreferWriter) preference check.\n", ret ? "Passed." : "Failed!");
+            }
+            {
+                mthread::ScalableReadWriteMutex rwlk;
+                _checkReadWriteMutex(rwlk, "ScalableReadWriteMutex");
+                bool writer_blocked = false;
+                bool ret = !_canReadWhileWriterWaiting(rwlk, writer_blocked) && writer_blocked;
+                printf("%s ScalableReadWriteMutex preference check.\n", ret ? "Passed." : "Failed!");
+
+                //RGuard移动到其他线程析构，新线程与当前线程的计数槽不同，写者仍能加锁
+                ret = true;
+                for (int i = 0; i < 2; ++i)
+                {
+                    auto guard = rwlk.lockReadGuard();
+                    std::thread releaser([&guard]()
+                        {
+                            auto moved_guard = std::move(guard);
+                        });
+                    releaser.join();
+                    bool locked = rwlk.tryLockWriteFor(std::chrono::milliseconds(500));
+                    if (locked)
+                        rwlk.unlockWrite();
+                    ret = ret && locked;
+                }
+                printf("%s ScalableReadWriteMutex RGuard moved to other thread check.\n", ret ? "Passed." : "Failed!");
+            }
+            printf("\n");
+        }
+
+        inline void SnapshotTest()
+        {
+            {
+                mthread::Snapshot<std::vector<int>> snapshot(std::vector<int>{ 1, 2, 3 });
+                bool ret;
+                {
+                    auto view = snapshot.read();
+                    ret = view->size() == 3 && (*view)[2] == 3 && view.getVersion() == 0;
+                    auto view2 = std::move(view);
+                    ret = ret && view2->size() == 3;
+                }
+                snapshot.update([](std::vector<int>& data) { data.push_back(4); });
+                snapshot.store(std::vector<int>{ 5 });
+                ret = ret && snapshot.getVersion() == 2 && snapshot.load() == std::vector<int>{ 5 };
+                printf("%s Snapshot read/store/update check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //每个版本的所有元素都等于版本号，读者看到不一致的数据或版本号回退即说明读到了被释放或未发布完的版本
+                mthread::Snapshot<std::vector<unsigned long long>> snapshot(std::vector<unsigned long long>(64, 0));
+                std::atomic<bool> stop(false);
+                std::atomic<bool> reader_ret(true);
+                std::vector<std::thread> readers;
+                for (int i = 0; i < 4; i++)
+                {
+                    readers.emplace_back([&snapshot, &stop, &reader_ret]()
+                        {
+                            unsigned long long last_version = 0;
+                            while (!stop.load())
+                            {
+                                auto view = snapshot.read();
+                                unsigned long long version = view.getVersion();
+                                bool ret = version >= last_version && view->size() == 64;
+                                for (unsigned long long value : *view)
+                                    ret = ret && value == version;
+                                if (!ret)
+                                    reader_ret = false;
+                                last_version = version;
+                            }
+                        });
+                }
+                std::thread writer([&snapshot]()
+                    {
+                        for (unsigned long long version = 1; version <= 200; ++version)
+                        {
+                            if (version % 2)
+                                snapshot.store(std::vector<unsigned long long>(64, version));
+                            else snapshot.update([version](std::vector<unsigned long long>& data) { std::fill(data.begin(), data.end(), version); });
+                        }
+                    });
+                writer.join();
+                stop = true;
+                for (auto& reader : readers)
+                    reader.join();
+                bool ret = reader_ret.load() && snapshot.getVersion() == 200 && snapshot.load()[63] == 200;
+                printf("%s Snapshot concurrent read and publish check.\n", ret ? "Passed." : "Failed!");
+            }
+            printf("\n");
+        }
+
+        inline void ObjectPoolTest()
+        {
+            {
+                int num_recycled = 0;
+                mthread::ObjectPool<std::vector<int>> pool([]()
+                    {
+                        std::vector<int> data;
+                        data.reserve(100);
+                        return data;
+                    }, [&num_recycled](std::vector<int>& data)
+                    {
+                        data.clear();
+                        num_recycled++;
+                    });
+                pool.prewarm(4);
+                bool ret = pool.getNumCreated() == 4;
+                const int* first_buffer;
+                {
+                    auto handle = pool.acquire();
+                    ret = ret && handle && handle->capacity() == 100;
+                    handle->push_back(1);
+                    first_buffer = handle->data();
+                    auto moved_handle = std::move(handle);
+                    ret = ret && !handle && moved_handle->size() == 1;
+                }
+                auto handle = pool.acquire();
+                ret = ret && handle->empty() && handle->data() == first_buffer && num_recycled == 1;
+                std::vector<mthread::ObjectPool<std::vector<int>>::Handle> handles;
+                for (int i = 0; i < 10; i++)
+                    handles.emplace_back(pool.acquire());
+                ret = ret && pool.getNumCreated() == 11;
+                handles.clear();
+                handle.reset();
+                for (int i = 0; i < 11; i++)
+                    handles.emplace_back(pool.acquire());
+                ret = ret && pool.getNumCreated() == 11 && num_recycled == 12;
+                printf("%s ObjectPool acquire/release check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //一个线程取出对象，另一个线程归还，对象数不应随循环次数增长
+                mthread::ObjectPool<std::vector<int>> pool;
+                mthread::MPMCQueue<mthread::ObjectPool<std::vector<int>>::Handle> queue(8);
+                const int num_items = 20000;
+                std::atomic<bool> ret(true);
+                std::thread producer([&pool, &queue, num_items]()
+                    {
+                        for (int i = 0; i < num_items; i++)
+                        {
+                            auto handle = pool.acquire();
+                            handle->assign(4, i);
+                            queue.push(std::move(handle));
+                        }
+                    });
+                std::vector<std::thread> workers;
+                for (int t = 0; t < 2; t++)
+                {
+                    workers.emplace_back([&pool, &ret]()
+                        {
+                            for (int i = 0; i < num_items / 2; i++)
+                            {
+                                auto handle = pool.acquire();
+                                handle->assign(4, i);
+                                for (int value : *handle)
+                                    if (value != i)
+                                        ret = false;
+                                handle->clear();
+                            }
+                        });
+                }
+                mthread::ObjectPool<std::vector<int>>::Handle handle;
+                for (int i = 0; i < num_items; i++)
+                {
+                    queue.pop(handle);
+                    if (handle->size() != 4 || (*handle)[3] != i)
+                        ret = false;
+                    handle.reset();
+                }
+                producer.join();
+                for (auto& worker : workers)
+                    worker.join();
+                printf("%s ObjectPool multi-thread check.\n", ret && pool.getNumCreated() <= 32 ? "Passed." : "Failed!");
+            }
+            printf("\n");
+        }
+
+        inline void ShardedCounterTest()
+        {
+            {
+                //线程数多于分片数时多个线程共用分片，总和仍需准确
+                const int thread_counts[] = { 4, MINE_RWLOCK_READER_SLOTS + 4 };
+                const int num_adds = 20000;
+                bool ret = true;
+                for (int num_thds : thread_counts)
+                {
+                    mthread::ShardedCounter counter;
+                    std::vector<std::thread> thds;
+                    for (int i = 0; i < num_thds; i++)
+                    {
+                        thds.emplace_back([&counter, i]()
+                            {
+                                for (int j = 0; j < num_adds; j++)
+                                    counter.add(i % 2 == 0 ? 1 : 2);
+                            });
+                    }
+                    for (auto& thd : thds)
+                        thd.join();
+                    long long expected = static_cast<long long>(num_adds) * ((num_thds + 1) / 2 + num_thds / 2 * 2);
+                    ret = ret && counter.get() == expected && counter.reset() == expected && counter.get() == 0;
+                }
+                printf("%s ShardedCounter add/get/reset check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                const int num_thds = 4;
+                const int num_records = 10000;
+                mthread::ShardedHistogram hist;
+                std::vector<std::thread> thds;
+                for (int i = 0; i < num_thds; i++)
+                {
+                    thds.emplace_back([&hist, i]()
+                        {
+                            //每个线程记录1~num_records各一次，线程0额外记录一个最大值
+                            for (int j = 1; j <= num_records; j++)
+                                hist.record(j);
+                            if (i == 0)
+                                hist.record(1000000);
+                        });
+                }
+                for (auto& thd : thds)
+                    thd.join();
+                mthread::LatencyHistogram snapshot = hist.snapshot();
+                long long expected_total = static_cast<long long>(num_records) * (num_records + 1) / 2 * num_thds + 1000000;
+                //[512, 1024)中的样本数为512*num_thds
+                bool ret = snapshot.count == num_records * num_thds + 1 && snapshot.total_ns == expected_total && snapshot.max_ns == 1000000;
+                ret = ret && snapshot.buckets[10] == 512 * num_thds && snapshot.buckets[0] == 0;
+                ret = ret && snapshot.percentileNs(50) == 8192 && snapshot.percentileNs(100) == 1000000;
+                hist.reset();
+                ret = ret && hist.snapshot().count == 0 && hist.snapshot().max_ns == 0;
+                printf("%s ShardedHistogram record/snapshot check.\n", ret ? "Passed." : "Failed!");
+            }
+            printf("\n");
+        }
+
+        inline void SPSCChannelTest()
+        {
+            {
+                mthread::SPSCChannel<std::unique_ptr<int>> channel(3);
+                bool ret = channel.capacity() == 3;
+                for (int i = 0; i < 3; i++)
+                    ret = ret && channel.tryPush(std::unique_ptr<int>(new int(i)));
+                std::unique_ptr<int> extra(new int(3));
+                ret = ret && !channel.tryPush(std::move(extra)) && extra && channel.size() == 3;
+                std::unique_ptr<int> values[4];
+                ret = ret && channel.popN(values, 4) == 3 && *values[0] == 0 && *values[2] == 2 && channel.empty();
+                for (int i = 0; i < 4; i++)
+                    values[i].reset(new int(i + 10));
+                ret = ret && channel.pushN(values, 4) == 3 && values[3] && !values[0];
+                ret = ret && channel.tryPop(values[0]) && *values[0] == 10 && channel.size() == 2;
+                printf("%s SPSCChannel(Reject) check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                mthread::SPSCChannel<int> channel(2, mthread::OverflowPolicy::OverwriteOldest);
+                bool ret = true;
+                for (int i = 1; i <= 5; i++)
+                    ret = ret && channel.tryPush(i);
+                int values[3] = { 0 };
+                ret = ret && channel.popN(values, 3) == 2 && values[0] == 4 && values[1] == 5 && channel.droppedCount() == 3;
+                printf("%s SPSCChannel(OverwriteOldest) check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                const int num_items = 100000;
+                mthread::SPSCChannel<int> channel(16);
+                std::thread producer([&channel, num_items]()
+                    {
+                        int values[4];
+                        for (int i = 0; i < num_items; )
+                        {
+                            int num = std::min(4, num_items - i);
+                            for (int j = 0; j < num; j++)
+                                values[j] = i + j;
+                            size_t num_push = channel.pushN(values, num);
+                            i += static_cast<int>(num_push);
+                            if (num_push == 0)
+                                std::this_thread::yield();
+                        }
+                    });
+                bool ret = true;
+                int values[8];
+                for (int expected = 0; expected < num_items; )
+                {
+                    size_t num_pop = channel.popN(values, 8);
+                    for (size_t j = 0; j < num_pop; j++)
+                        ret = ret && values[j] == expected++;
+                    if (num_pop == 0)
+                        std::this_thread::yield();
+                }
+                producer.join();
+                printf("%s SPSCChannel(Reject) producer-consumer check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //消费者取到的元素应严格递增，且取到的数量与丢弃的数量之和等于放入的数量
+                const int num_items = 100000;
+                mthread::SPSCChannel<std::unique_ptr<int>> channel(2, mthread::OverflowPolicy::OverwriteOldest);
+                std::thread producer([&channel, num_items]()
+                    {
+                        for (int i = 1; i <= num_items; i++)
+                            channel.tryPush(std::unique_ptr<int>(new int(i)));
+                    });
+                bool ret = true;
+                int last = 0;
+                long long num_popped = 0;
+                std::unique_ptr<int> value;
+                while (last < num_items)
+                {
+                    if (channel.tryPop(value))
+                    {
+                        ret = ret && *value > last;
+                        last = *value;
+                        num_popped++;
+                    }
+                    else std::this_thread::yield();
+                }
+                producer.join();
+                ret = ret && num_popped + static_cast<long long>(channel.droppedCount()) == num_items;
+                printf("%s SPSCChannel(OverwriteOldest) producer-consumer check.\n", ret ? "Passed." : "Failed!");
+            }
+            printf("\n");
+        }
+
+        inline void MPMCQueueTest()
+        {
+            {
+                mthread::MPMCQueue<int> queue(5);
+                bool ret = queue.capacity() == 8 && queue.empty();
+                for (int i = 0; i < 8; i++)
+                    ret = ret && queue.tryPush(i);
+                ret = ret && !queue.tryPush(8) && queue.size() == 8;
+                int value = -1;
+                for (int i = 0; i < 8; i++)
+                    ret = ret && queue.tryPop(value) && value == i;
+                ret = ret && !queue.tryPop(value) && queue.empty();
+                printf("%s MPMCQueue try push/pop check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                mthread::MPMCQueue<std::unique_ptr<int>> queue(4);
+                queue.push(std::unique_ptr<int>(new int(7)));
+                std::unique_ptr<int> value;
+                queue.pop(value);
+                //未取出的元素由队列析构时释放
+                queue.push(std::unique_ptr<int>(new int(8)));
+                printf("%s MPMCQueue move-only element check.\n", value && *value == 7 ? "Passed." : "Failed!");
+            }
+
+            {
+                //容量远小于元素数量，使push和pop都会进入休眠等待
+                mthread::MPMCQueue<long long> queue(8);
+                const int num_producers = 4;
+                const int num_items = 10000;
+                std::atomic<long long> sum(0);
+                std::vector<std::thread> thds;
+                for (int i = 0; i < num_producers; i++)
+                {
+                    thds.emplace_back([&queue, num_items]()
+                        {
+                            for (int j = 1; j <= num_items; j++)
+                                queue.push(j);
+                        });
+                    thds.emplace_back([&queue, &sum, num_items]()
+                        {
+                            long long value = 0;
+                            for (int j = 1; j <= num_items; j++)
+                            {
+                                queue.pop(value);
+                                sum.fetch_add(value);
+                            }
+                        });
+                }
+                for (auto& thd : thds)
+                    thd.join();
+                bool ret = sum.load() == static_cast<long long>(num_producers) * num_items * (num_items + 1) / 2 && queue.empty();
+                printf("%s MPMCQueue multi-producer multi-consumer check.\n", ret ? "Passed." : "Failed!");
+            }
+            printf("\n");
+        }
+
+        inline void ThreadPoolTest()
+        {
+            const mthread::SchedulePolicy policies[] = { mthread::SchedulePolicy::SharedQueue, mthread::SchedulePolicy::WorkStealing, mthread::SchedulePolicy::LockFreeQueue };
+            const char* policy_names[] = { "SharedQueue", "WorkStealing", "LockFreeQueue" };
+            for (int p = 0; p < 3; ++p)
+            {
+                mthread::ThreadPool thd_pool(4, policies[p]);
+                std::atomic<int> counter(0);
+                std::vector<mthread::TaskRetState<int>> states;
+                for (int i = 0; i < 100; i++)
+                {
+                    states.emplace_back(thd_pool.addTask([&thd_pool, &counter](int x)
+                        {
+                            //在工作线程内继续添加子任务
+                            thd_pool.addTask([&counter]() { counter++; });
+                            counter++;
+                            return x * 2;
+                        }, i));
+                }
+                bool ret = true;
+                for (int i = 0; i < 100; i++)
+                    ret = ret && (states[i].get() == i * 2);
+                while (counter.load() < 200)
+                    std::this_thread::yield();
+                printf("%s ThreadPool(%s) check.\n", ret ? "Passed." : "Failed!", policy_names[p]);
+            }
+            printf("\n");
+        }
+
+        inline int& _getTaskRefTarget()
+        {
+            static int target = 0;
+            return target;
+        }
+
+        inline void ThreadPoolTaskTest()
+        {
+            bool ret;
+            std::vector<mthread::TaskState> dropped_states;
+            {
+                mthread::ThreadPool thd_pool(1);
+
+                auto state1 = thd_pool.addTask(_getTaskRefTarget);
+                ret = (&state1.get() == &_getTaskRefTarget()) && (&state1.get() == &_getTaskRefTarget());
+                printf("%s ThreadPool::addTask return reference check.\n", ret ? "Passed." : "Failed!");
+
+                auto state2 = thd_pool.addTask([]() -> int { throw std::runtime_error("task error"); });
+                ret = false;
+                try { state2.get(); }
+                catch (std::runtime_error&) { ret = true; }
+                printf("%s ThreadPool::addTask exception check.\n", ret ? "Passed." : "Failed!");
+
+                //超过内联储存大小的任务退化为堆上储存
+                char big_buf[MINE_TASK_INLINE_SIZE * 2] = "big";
+                auto state3 = thd_pool.addTask([big_buf]() { return std::string(big_buf); });
+                ret = (state3.get() == "big");
+                printf("%s ThreadPool::addTask large task check.\n", ret ? "Passed." : "Failed!");
+
+                dropped_states.emplace_back(thd_pool.addTask([]() { mtime::msleep(20); }));
+                for (int i = 0; i < 3; i++)
+                    dropped_states.emplace_back(thd_pool.addTask([]() {}));
+                mtime::msleep(5);
+            }
+            int num_cancelled = 0;
+            for (auto& state : dropped_states)
+            {
+                try { state.get(); }
+                catch (mthread::TaskCancelledError&) { num_cancelled++; }
+            }
+            ret = (num_cancelled == 3);
+            printf("%s ThreadPool dropped task check.\n", ret ? "Passed." : "Failed!");
+            printf("\n");
+        }
+
+        inline void ParallelForTest()
+        {
+            const mthread::ChunkPolicy policies[] = { mthread::ChunkPolicy::Static, mthread::ChunkPolicy::Dynamic, mthread::ChunkPolicy::Guided };
+            const char* policy_names[] = { "Static", "Dynamic", "Guided" };
+            mthread::ThreadPool thd_pool(3, mthread::SchedulePolicy::WorkStealing);
+            for (int p = 0; p < 3; ++p)
+            {
+                std::vector<int> marks(1000, 0);
+                thd_pool.parallelFor(0, 1000, 7, [&marks](int i)
+                    {
+                        if (i % 100 == 0)
+                            mtime::usleep(100);   //耗时不均的元素
+                        marks[i] += 1;
+                    }, policies[p]);
+                bool ret = (std::count(marks.begin(), marks.end(), 1) == 1000);
+                printf("%s ThreadPool::parallelFor(%s) check.\n", ret ? "Passed." : "Failed!", policy_names[p]);
+            }
+
+            std::vector<long long> values(500);
+            for (size_t i = 0; i < values.size(); i++)
+                values[i] = i;
+            thd_pool.parallelForEach(values, [](long long& v) { v = v * v; });
+            bool ret = true;
+            for (size_t i = 0; i < values.size(); i++)
+                ret = ret && (values[i] == (long long)(i * i));
+            printf("%s ThreadPool::parallelForEach check.\n", ret ? "Passed." : "Failed!");
+
+            ret = false;
+            try
+            {
+                thd_pool.parallelFor(0, 100, 1, [](int i)
+                    {
+                        if (i == 50)
+                            throw std::runtime_error("parallelFor error");
+                    });
+            }
+            catch (std::runtime_error&) { ret = true; }
+            printf("%s ThreadPool::parallelFor exception check.\n", ret ? "Passed." : "Failed!");
+            printf("\n");
+        }
+
+        inline void ContinuationTest()
+        {
+            mthread::ThreadPool thd_pool(2);
+
+            auto state1 = thd_pool.addTask([](int x) { return x + 1; }, 1);
+            auto state2 = state1.then([](int x) { return x * 10; }).then([](int x) { return std::to_string(x); });
+            bool ret = (state2.get() == "20") && (state1.get() == 2);
+            printf("%s TaskRetState::then check.\n", ret ? "Passed." : "Failed!");
+
+            auto state3 = thd_pool.addTask([]() -> int { throw std::runtime_error("then error"); });
+            bool then_called = false;
+            auto state4 = state3.then([&then_called](int x) { then_called = true; return x; });
+            ret = false;
+            try { state4.get(); }
+            catch (std::runtime_error&) { ret = !then_called; }
+            printf("%s TaskRetState::then exception check.\n", ret ? "Passed." : "Failed!");
+
+            std::atomic<int> sum(0);
+            std::vector<mthread::TaskState> states;
+            for (int i = 1; i <= 10; i++)
+                states.emplace_back(thd_pool.addTask([&sum](int x) { sum += x; }, i));
+            auto all_state = mthread::whenAll(states).then([&sum]() { return sum.load(); });
+            ret = (all_state.get() == 55);
+            printf("%s mthread::whenAll check.\n", ret ? "Passed." : "Failed!");
+
+            std::vector<mthread::TaskRetState<int>> int_states;
+            int_states.emplace_back(thd_pool.addTask([]() { mtime::msleep(50); return 0; }));
+            int_states.emplace_back(thd_pool.addTask([]() { return 1; }));
+            int any_idx = mthread::whenAny(int_states).get();
+            ret = (any_idx == 1 || any_idx == 0) && int_states[any_idx].finished();
+            printf("%s mthread::whenAny check.\n", ret ? "Passed." : "Failed!");
+
+            //空输入：whenAll立即结束，whenAny抛出异常；输入来自不同线程池时抛出异常
+            std::vector<mthread::TaskState> empty_states;
+            auto empty_all = mthread::whenAll(empty_states);
+            ret = empty_all.finished() && empty_all.then([]() { return 7; }).get() == 7;
+            std::vector<mthread::TaskRetState<int>> empty_int_states;
+            try
+            {
+                mthread::whenAny(empty_int_states);
+                ret = false;
+            }
+            catch (std::runtime_error&) {}
+            mthread::ThreadPool other_pool(1);
+            std::vector<mthread::TaskRetState<int>> mixed_states;
+            mixed_states.emplace_back(thd_pool.addTask([]() { return 0; }));
+            mixed_states.emplace_back(other_pool.addTask([]() { return 1; }));
+            try
+            {
+                mthread::whenAll(mixed_states);
+                ret = false;
+            }
+            catch (std::runtime_error&) {}
+            ret = ret && mixed_states[0].get() == 0 && mixed_states[1].get() == 1;
+            printf("%s mthread::whenAll and whenAny edge case check.\n", ret ? "Passed." : "Failed!");
+            printf("\n");
+        }
+
+        inline void TaskGraphTest()
+        {
+            mthread::ThreadPool thd_pool(3, mthread::SchedulePolicy::WorkStealing);
+            mthread::TaskGraph graph;
+            std::atomic<int> stamp(0);
+            int stamps[5] = { 0 };
+            int decode = graph.addNode([&]() { stamps[0] = ++stamp; });
+            int preprocess = graph.addNode([&]() { stamps[1] = ++stamp; }, { decode });
+            int infer = graph.addNode([&]() { mtime::usleep(200); stamps[2] = ++stamp; }, { preprocess });
+            int postprocess = graph.addNode([&]() { stamps[3] = ++stamp; }, { preprocess });
+            graph.addNode([&]() { stamps[4] = ++stamp; }, { infer, postprocess });
+
+            bool ret = true;
+            for (int frame = 0; frame < 3; frame++)
+            {
+                stamp = 0;
+                ret = ret && graph.run(thd_pool);
+                graph.wait();
+                ret = ret && stamps[0] < stamps[1] && stamps[1] < stamps[2] && stamps[1] < stamps[3] && stamps[2] < stamps[4] && stamps[3] < stamps[4] && stamp == 5;
+            }
+            printf("%s TaskGraph check.\n", ret ? "Passed." : "Failed!");
+
+            mthread::TaskGraph graph2;
+            int node0 = graph2.addNode([]() { throw std::runtime_error("node error"); });
+            bool tail_ran = false;
+            graph2.addNode([&tail_ran]() { tail_ran = true; }, { node0 });
+            ret = false;
+            graph2.run(thd_pool);
+            try { graph2.wait(); }
+            catch (std::runtime_error&) { ret = !tail_ran; }
+            printf("%s TaskGraph exception check.\n", ret ? "Passed." : "Failed!");
+
+            //线程池停止后运行或运行中线程池被停止，未执行的节点被取消，wait不会一直阻塞
+            mthread::ThreadPool stopped_pool(2);
+            stopped_pool.drain();
+            std::atomic<int> num_ran(0);
+            mthread::TaskGraph graph3;
+            int head = graph3.addNode([&num_ran]() { num_ran++; });
+            graph3.addNode([&num_ran]() { num_ran++; }, { head });
+            graph3.addNode([&num_ran]() { num_ran++; }, { head });
+            ret = false;
+            graph3.run(stopped_pool);
+            try { graph3.wait(); }
+            catch (mthread::TaskCancelledError&) { ret = num_ran == 0 && graph3.finished(); }
+
+            mthread::ThreadPool aborted_pool(1);
+            std::atomic<bool> head_started(false);
+            mthread::TaskGraph graph4;
+            head = graph4.addNode([&head_started]() { head_started = true; mtime::msleep(20); });
+            int mid0 = graph4.addNode([&num_ran]() { num_ran++; }, { head });
+            int mid1 = graph4.addNode([&num_ran]() { num_ran++; }, { head });
+            graph4.addNode([&num_ran]() { num_ran++; }, { mid0, mid1 });
+            bool cancelled = false;
+            graph4.run(aborted_pool);
+            while (!head_started.load())
+                std::this_thread::yield();
+            aborted_pool.abort();
+            try { graph4.wait(); }
+            catch (mthread::TaskCancelledError&) { cancelled = true; }
+            ret = ret && cancelled && graph4.finished() && num_ran <= 1;
+            printf("%s TaskGraph on stopped ThreadPool check.\n", ret ? "Passed." : "Failed!");
+            printf("\n");
+        }
+
+        inline void TaskPriorityTest()
+        {
+            const mthread::SchedulePolicy policies[] = { mthread::SchedulePolicy::SharedQueue, mthread::SchedulePolicy::WorkStealing, mthread::SchedulePolicy::LockFreeQueue };
+            const char* policy_names[] = { "SharedQueue", "WorkStealing", "LockFreeQueue" };
+            for (int p = 0; p < 3; ++p)
+            {
+                mthread::ThreadPool thd_pool(1, policies[p]);
+                std::atomic<bool> gate_open(false);
+                std::string order;
+                std::mutex order_mtx;
+                auto record = [&order, &order_mtx](char name)
+                {
+                    std::lock_guard<std::mutex> lk(order_mtx);
+                    order.push_back(name);
+                };
+                //先占住唯一的工作线程，使后续任务全部排队
+                auto gate_state = thd_pool.addTask([&gate_open]()
+                    {
+                        while (!gate_open.load())
+                            std::this_thread::yield();
+                    });
+                mtime::msleep(10);
+                auto now_t = mtime::now();
+                thd_pool.addTask(mthread::TaskPriority::Low, record, 'F');
+                thd_pool.addTask(record, 'E');
+                thd_pool.addTask(mthread::TaskPriority::Normal, record, 'D');
+                thd_pool.addTask(mthread::TaskPriority::High, record, 'C');
+                thd_pool.addTask(now_t + std::chrono::seconds(1), record, 'B');
+                auto last_state = thd_pool.addTask(now_t + std::chrono::milliseconds(10), record, 'A');
+                bool ret = thd_pool.getQueueStats(mthread::TaskPriority::High).num_pending == 1;
+                gate_open = true;
+                while (true)
+                {
+                    {
+                        std::lock_guard<std::mutex> lk(order_mtx);
+                        if (order.size() == 6)
+                            break;
+                    }
+                    std::this_thread::yield();
+                }
+                mthread::TaskQueueStats high_stats = thd_pool.getQueueStats(mthread::TaskPriority::High);
+                mthread::TaskQueueStats deadline_stats = thd_pool.getDeadlineQueueStats();
+                ret = ret && order == "ABCDEF" && high_stats.num_pending == 0 && high_stats.num_started == 1 && deadline_stats.num_started == 2 && deadline_stats.max_wait_us >= 0;
+                printf("%s ThreadPool(%s) task priority check.\n", ret ? "Passed." : "Failed!", policy_names[p]);
+            }
+            printf("\n");
+        }
+
+        inline void CancellationTest()
+        {
+            {
+                mthread::ThreadPool thd_pool(1);
+                std::atomic<bool> gate_open(false);
+                std::atomic<int> counter(0);
+                auto gate_state = thd_pool.addTask([&gate_open]()
+                    {
+                        while (!gate_open.load())
+                            std::this_thread::yield();
+                    });
+                mthread::CancellationToken token;
+                std::vector<mthread::TaskState> token_states;
+                std::vector<mthread::TaskState> plain_states;
+                for (int i = 0; i < 5; i++)
+                {
+                    token_states.emplace_back(thd_pool.addTask(token, [&counter]() { counter++; }));
+                    plain_states.emplace_back(thd_pool.addTask([&counter]() { counter++; }));
+                }
+                bool ret = plain_states[0].cancel() && !plain_states[0].cancel();
+                auto then_state = plain_states[0].then([]() { return 1; });
+                token.cancel();
+                gate_open = true;
+                int num_cancelled = 0;
+                for (auto& state : token_states)
+                {
+                    try { state.get(); }
+                    catch (mthread::TaskCancelledError&) { num_cancelled++; }
+                }
+                for (auto& state : plain_states)
+                {
+                    try { state.get(); }
+                    catch (mthread::TaskCancelledError&) { num_cancelled++; }
+                }
+                try { then_state.get(); }
+                catch (mthread::TaskCancelledError&) { num_cancelled++; }
+                ret = ret && num_cancelled == 7 && counter.load() == 4 && token.isCancelled() && !gate_state.cancel();
+                printf("%s ThreadPool task cancellation check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                mthread::ThreadPool thd_pool(2, mthread::SchedulePolicy::WorkStealing);
+                std::atomic<int> counter(0);
+                for (int i = 0; i < 50; i++)
+                {
+                    thd_pool.addTask([&thd_pool, &counter]()
+                        {
+                            mtime::usleep(200);
+                            thd_pool.addTask([&counter]() { counter++; });
+                            counter++;
+                        });
+                }
+                thd_pool.drain();
+                bool ret = counter.load() == 100;
+                auto late_state = thd_pool.addTask([]() { return 1; });
+                try { late_state.get(); ret = false; }
+                catch (mthread::TaskCancelledError&) {}
+                printf("%s ThreadPool::drain check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                mthread::ThreadPool thd_pool(1);
+                std::atomic<int> counter(0);
+                std::vector<mthread::TaskState> states;
+                states.emplace_back(thd_pool.addTask([&counter]() { mtime::msleep(20); counter++; }));
+                for (int i = 0; i < 10; i++)
+                    states.emplace_back(thd_pool.addTask([&counter]() { counter++; }));
+                mtime::msleep(5);
+                thd_pool.abort();
+                int num_cancelled = 0;
+                for (auto& state : states)
+                {
+                    try { state.get(); }
+                    catch (mthread::TaskCancelledError&) { num_cancelled++; }
+                }
+                bool ret = counter.load() == 1 && num_cancelled == 10;
+                printf("%s ThreadPool::abort check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //工作线程中调用abort被拒绝，线程池继续运行；其他线程调用abort则正常停止，不依赖thread_local判断
+                mthread::ThreadPool thd_pool(2);
+                thd_pool.addTask([&thd_pool]() { thd_pool.abort(); }).get();
+                bool ret = thd_pool.addTask([]() { return 1; }).get() == 1;
+                std::thread aborter([&thd_pool]() { thd_pool.abort(); });
+                aborter.join();
+                auto late_state = thd_pool.addTask([]() { return 1; });
+                try { late_state.get(); ret = false; }
+                catch (mthread::TaskCancelledError&) {}
+                printf("%s ThreadPool::abort from worker and non-worker thread check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //abort期间其他线程继续添加任务，停止后每个任务都已执行或已被取消，不会有任务遗留在队列中
+                bool ret = true;
+                for (mthread::SchedulePolicy policy : { mthread::SchedulePolicy::SharedQueue, mthread::SchedulePolicy::WorkStealing, mthread::SchedulePolicy::LockFreeQueue })
+                {
+                    mthread::ThreadPool thd_pool(2, policy);
+                    std::vector<mthread::TaskState> states;
+                    std::atomic<bool> started(false);
+                    std::thread producer([&thd_pool, &states, &started]()
+                        {
+                            for (int i = 0; i < 2000; i++)
+                            {
+                                if (i % 2 == 0)
+                                    states.emplace_back(thd_pool.addTask([]() {}));
+                                else states.emplace_back(thd_pool.addTask(mthread::TaskPriority::High, []() {}));
+                                started.store(true);
+                            }
+                        });
+                    while (!started.load())
+                        std::this_thread::yield();
+                    thd_pool.abort();
+                    producer.join();
+                    for (auto& state : states)
+                        ret = ret && state.finished();
+                }
+                printf("%s ThreadPool::abort with concurrent addTask check.\n", ret ? "Passed." : "Failed!");
+            }
+            printf("\n");
+        }
+
+        inline void TimerTaskTest()
+        {
+            {
+                mthread::ThreadPool thd_pool(2);
+                auto start_t = mtime::now();
+                std::vector<int> order;
+                std::mutex order_mtx;
+                auto late_state = thd_pool.addDelayedTask(std::chrono::milliseconds(40), [&order, &order_mtx]()
+                    {
+                        std::lock_guard<std::mutex> lk(order_mtx);
+                        order.push_back(2);
+                        return mtime::now();
+                    });
+                auto early_state = thd_pool.addDelayedTask(std::chrono::milliseconds(20), [&order, &order_mtx]()
+                    {
+                        std::lock_guard<std::mutex> lk(order_mtx);
+                        order.push_back(1);
+                        return mtime::now();
+                    });
+                bool ret = mtime::ms(early_state.get() - start_t) >= 20 && mtime::ms(late_state.get() - start_t) >= 40;
+                ret = ret && order == std::vector<int>{ 1, 2 };
+                printf("%s ThreadPool::addDelayedTask check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //执行耗时超过周期时跳过错过的周期，不会并发执行；每次执行时间都应落在添加时间的周期网格附近
+                mthread::ThreadPool thd_pool(2);
+                const long long period_us = 20000;
+                std::atomic<int> num_running(0);
+                std::atomic<bool> overlapped(false);
+                std::mutex offsets_mtx;
+                std::vector<long long> run_offsets;
+                auto start_t = mtime::now();
+                auto token = thd_pool.addPeriodicTask(std::chrono::microseconds(period_us), [&]()
+                    {
+                        if (num_running.fetch_add(1) != 0)
+                            overlapped = true;
+                        size_t num_runs;
+                        {
+                            std::lock_guard<std::mutex> lk(offsets_mtx);
+                            run_offsets.push_back(mtime::us(mtime::now() - start_t));
+                            num_runs = run_offsets.size();
+                        }
+                        if (num_runs % 3 == 0)
+                            mtime::msleep(30);
+                        num_running.fetch_sub(1);
+                    });
+                mtime::msleep(250);
+                token.cancel();
+                mtime::msleep(50);
+                std::lock_guard<std::mutex> lk(offsets_mtx);
+                size_t num_runs = run_offsets.size();
+                long long total_lag_us = 0;
+                for (long long offset : run_offsets)
+                    total_lag_us += offset % period_us;
+                bool ret = !overlapped && num_runs >= 6 && num_runs <= 12;
+                ret = ret && total_lag_us / static_cast<long long>(num_runs) < period_us / 4;
+                printf("%s ThreadPool::addPeriodicTask check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                mthread::ThreadPool thd_pool(1);
+                std::atomic<int> counter(0);
+                auto token = thd_pool.addPeriodicTask(std::chrono::milliseconds(5), [&counter]() { counter += 100; });
+                thd_pool.addDelayedTask(std::chrono::milliseconds(30), [&counter]() { counter++; });
+                auto cancelled_state = thd_pool.addDelayedTask(std::chrono::seconds(10), []() {});
+                thd_pool.addDelayedTask(std::chrono::milliseconds(20), [&counter]() { counter++; });
+                auto start_t = mtime::now();
+                mtime::msleep(10);
+                thd_pool.abort();
+                bool ret = false;
+                try { cancelled_state.get(); }
+                catch (mthread::TaskCancelledError&) { ret = mtime::ms(mtime::now() - start_t) < 1000; }
+                int num_runs = counter.load();
+                mtime::msleep(40);
+                ret = ret && counter.load() == num_runs && num_runs % 100 == 0;
+                printf("%s ThreadPool::abort with timer tasks check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                mthread::ThreadPool thd_pool(1);
+                std::atomic<int> counter(0);
+                thd_pool.addPeriodicTask(std::chrono::milliseconds(5), []() {});
+                thd_pool.addDelayedTask(std::chrono::milliseconds(30), [&thd_pool, &counter]()
+                    {
+                        thd_pool.addTask([&counter]() { counter++; });
+                        counter++;
+                    });
+                thd_pool.drain();
+                bool ret = counter.load() == 2;
+                printf("%s ThreadPool::drain with timer tasks check.\n", ret ? "Passed." : "Failed!");
+            }
+            printf("\n");
+        }
+
+        //暂停后各线程计数不再增长，恢复后继续增长；通过状态量确认所有暂停点已停下
+        template<class PauserT>
+        inline bool _checkPauserPauseResume()
+        {
+            const int num_thds = 4;
+            PauserT pauser;
+            std::atomic<bool> stop(false);
+            std::atomic<bool> states[num_thds];
+            std::atomic<long long> counters[num_thds];
+            std::vector<std::thread> thds;
+            for (int i = 0; i < num_thds; i++)
+            {
+                states[i].store(false);
+                counters[i].store(0);
+                thds.emplace_back([&pauser, &stop, &states, &counters, i]()
+                    {
+                        while (!stop.load())
+                        {
+                            pauser.setPausePoint(states[i]);
+                            counters[i]++;
+                        }
+                    });
+            }
+            bool ret = true;
+            for (int round = 0; round < 3; round++)
+            {
+                mtime::msleep(5);
+                pauser.pause();
+                ret = ret && pauser.isPaused();
+                for (int i = 0; i < num_thds; i++)
+                {
+                    while (!states[i].load())
+                        std::this_thread::yield();
+                }
+                long long sum_before = 0, sum_after = 0;
+                for (int i = 0; i < num_thds; i++)
+                    sum_before += counters[i].load();
+                mtime::msleep(10);
+                for (int i = 0; i < num_thds; i++)
+                    sum_after += counters[i].load();
+                ret = ret && sum_before == sum_after;
+                pauser.resume();
+                ret = ret && !pauser.isPaused();
+                auto deadline = mtime::now() + std::chrono::seconds(5);
+                for (int i = 0; i < num_thds; i++)
+                {
+                    long long last_count = counters[i].load();
+                    while (counters[i].load() == last_count && mtime::now() < deadline)
+                        std::this_thread::yield();
+                    ret = ret && counters[i].load() != last_count;
+                }
+            }
+            stop = true;
+            pauser.resume();
+            for (auto& thd : thds)
+                thd.join();
+            return ret;
+        }
+
+        inline void ThreadPauserTest()
+        {
+            {
+                bool ret = _checkPauserPauseResume<mthread::ThreadPauser>();
+                printf("%s ThreadPauser pause/resume check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                bool ret = _checkPauserPauseResume<mthread::ParkingThreadPauser>();
+                printf("%s ParkingThreadPauser pause/resume check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                const int num_thds = 4;
+                mthread::ParkingThreadPauser pauser;
+                std::atomic<bool> stop(false);
+                std::atomic<long long> counter(0);
+                std::vector<std::thread> thds;
+                for (int i = 0; i < num_thds; i++)
+                {
+                    thds.emplace_back([&pauser, &stop, &counter]()
+                        {
+                            while (!stop.load())
+                            {
+                                pauser.setPausePoint();
+                                counter++;
+                            }
+                        });
+                }
+                bool ret = true;
+                for (int round = 0; round < 20; round++)
+                {
+                    //返回true时所有暂停点必须已经停下，计数不能再变化
+                    ret = ret && pauser.pauseAndWaitAllParked(num_thds);
+                    ret = ret && pauser.getNumParked() == num_thds;
+                    long long count = counter.load();
+                    if (round % 5 == 0)
+                        mtime::msleep(5);
+                    ret = ret && counter.load() == count;
+                    pauser.resume();
+                }
+                //等待的暂停点数多于实际线程数时应超时返回，且仍保持暂停
+                auto start_t = mtime::now();
+                ret = ret && !pauser.pauseAndWaitAllParked(num_thds + 1, std::chrono::milliseconds(20));
+                ret = ret && mtime::now() - start_t >= std::chrono::milliseconds(20) && pauser.isPaused();
+                //等待期间被resume应返回false
+                std::thread resumer([&pauser]()
+                    {
+                        mtime::msleep(20);
+                        pauser.resume();
+                    });
+                ret = ret && !pauser.pauseAndWaitAllParked(num_thds + 1);
+                resumer.join();
+                stop = true;
+                pauser.resume();
+                for (auto& thd : thds)
+                    thd.join();
+                ret = ret && pauser.getNumParked() == 0;
+                printf("%s ParkingThreadPauser::pauseAndWaitAllParked check.\n", ret ? "Passed." : "Failed!");
+            }
+            printf("\n");
+        }
+
+        inline void PipelineTest()
+        {
+            {
+                //中间阶段并行且处理时间不均，元素乱序完成，有序模式下输出仍需保持输入顺序
+                const int num_items = 200;
+                mthread::Pipeline<int, std::string> pipeline(mthread::PipelineOrder::Ordered, 4);
+                pipeline.addStage<int, long long>("square", [](int x) { return static_cast<long long>(x) * x; }, 1, 8)
+                    .addStage<long long, long long>("jitter", [](long long x)
+                        {
+                            if (x % 7 == 0)
+                                mtime::usleep(500);
+                            return x + 1;
+                        }, 3, 8)
+                    .addStage<long long, std::string>("format", [](long long x) { return std::to_string(x); }, 1, 8);
+                pipeline.start();
+                std::thread producer([&pipeline]()
+                    {
+                        for (int i = 0; i < num_items; i++)
+                            pipeline.push(i);
+                        pipeline.close();
+                    });
+                bool ret = true;
+                int num_outputs = 0;
+                std::string value;
+                while (pipeline.pop(value))
+                {
+                    ret = ret && value == std::to_string(static_cast<long long>(num_outputs) * num_outputs + 1);
+                    ++num_outputs;
+                }
+                producer.join();
+                ret = ret && num_outputs == num_items && !pipeline.push(0);
+                for (int i = 0; i < pipeline.getNumStages(); i++)
+                    ret = ret && pipeline.getStageStats(i).num_processed == num_items;
+                printf("%s Pipeline ordered output check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //首个元素处理很慢时，后续元素的乱序跨度远超有序缓冲区的初始容量，缓冲区扩容后输出仍保持输入顺序
+                const int num_items = 300;
+                mthread::Pipeline<int, int> pipeline(mthread::PipelineOrder::Ordered, 2);
+                pipeline.addStage<int, int>("slow head", [](int x)
+                    {
+                        if (x == 0)
+                            mtime::msleep(50);
+                        return x;
+                    }, 4, 2);
+                pipeline.start();
+                std::thread producer([&pipeline]()
+                    {
+                        for (int i = 0; i < num_items; i++)
+                            pipeline.push(i);
+                        pipeline.close();
+                    });
+                std::vector<int> outputs;
+                int value;
+                while (pipeline.pop(value))
+                    outputs.push_back(value);
+                producer.join();
+                bool ret = static_cast<int>(outputs.size()) == num_items;
+                for (int i = 0; ret && i < num_items; i++)
+                    ret = outputs[i] == i;
+                printf("%s Pipeline reorder buffer growth check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //处理函数抛出异常时丢弃该元素，有序模式跳过该序号，无序模式不受影响
+                const mthread::PipelineOrder orders[] = { mthread::PipelineOrder::Ordered, mthread::PipelineOrder::Unordered };
+                bool ret = true;
+                for (mthread::PipelineOrder order : orders)
+                {
+                    const int num_items = 100;
+                    mthread::Pipeline<int, int> pipeline(order);
+                    pipeline.addStage<int, int>("filter", [](int x)
+                        {
+                            if (x % 10 == 3)
+                                throw std::runtime_error("Error: Drop this item!");
+                            return x;
+                        }, 2, 4);
+                    pipeline.start();
+                    std::thread producer([&pipeline]()
+                        {
+                            for (int i = 0; i < num_items; i++)
+                                pipeline.push(i);
+                            pipeline.close();
+                        });
+                    std::vector<int> outputs;
+                    int value;
+                    while (pipeline.pop(value))
+                        outputs.push_back(value);
+                    producer.join();
+                    if (order == mthread::PipelineOrder::Unordered)
+                        std::sort(outputs.begin(), outputs.end());
+                    std::vector<int> expected;
+                    for (int i = 0; i < num_items; i++)
+                    {
+                        if (i % 10 != 3)
+                            expected.push_back(i);
+                    }
+                    mthread::PipelineStageStats stats = pipeline.getStageStats(0);
+                    ret = ret && outputs == expected && stats.num_failed == num_items / 10 && stats.num_processed == num_items - num_items / 10;
+                }
+                printf("%s Pipeline drop on exception check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //阶段暂停后取到的元素停在暂停点，输入队列满后tryPush失败，恢复后所有元素正常输出
+                const size_t queue_capacity = 2;
+                mthread::Pipeline<int, int> pipeline(mthread::PipelineOrder::Ordered, 8);
+                pipeline.addStage<int, int>("hold", [](int x) { return x; }, 1, queue_capacity);
+                pipeline.start();
+                pipeline.pauseStage(0);
+                bool ret = pipeline.isStagePaused(0) && pipeline.push(0);
+                auto deadline = mtime::now() + std::chrono::seconds(5);
+                while (pipeline.getStageStats(0).queue_size != 0 && mtime::now() < deadline)
+                    mtime::msleep(1);
+                for (int i = 1; i <= static_cast<int>(queue_capacity); i++)
+                    ret = ret && pipeline.tryPush(i);
+                ret = ret && !pipeline.tryPush(100);
+                int value;
+                ret = ret && !pipeline.tryPop(value) && pipeline.getStageStats(0).num_processed == 0;
+                pipeline.resumeStage(0);
+                pipeline.close();
+                std::vector<int> outputs;
+                while (pipeline.pop(value))
+                    outputs.push_back(value);
+                ret = ret && outputs == std::vector<int>{ 0, 1, 2 } && !pipeline.isStagePaused(0);
+                printf("%s Pipeline backpressure and pauseStage check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                bool ret = false;
+                try
+                {
+                    mthread::Pipeline<int, int> pipeline;
+                    pipeline.addStage<std::string, int>("bad", [](std::string s) { return static_cast<int>(s.size()); });
+                }
+                catch (std::runtime_error&) { ret = true; }
+                try
+                {
+                    mthread::Pipeline<int, int> pipeline;
+                    pipeline.addStage<int, std::string>("to_string", [](int x) { return std::to_string(x); });
+                    ret = false;
+                    pipeline.start();
+                }
+                catch (std::runtime_error&) { ret = true; }
+                try
+                {
+                    mthread::Pipeline<int, int> pipeline;
+                    pipeline.addStage<int, std::string>("to_string", [](int x) { return std::to_string(x); });
+                    ret = false;
+                    pipeline.addStage<int, int>("bad", [](int x) { return x; });
+                }
+                catch (std::runtime_error&) { ret = true; }
+                printf("%s Pipeline stage type check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //中止时阻塞在push、pop和暂停点的线程都应退出
+                std::atomic<bool> popped(false);
+                bool ret;
+                {
+                    mthread::Pipeline<int, int> pipeline(mthread::PipelineOrder::Ordered, 1);
+                    pipeline.addStage<int, int>("slow", [](int x) { return x; }, 1, 1);
+                    pipeline.start();
+                    pipeline.pauseStage(0);
+                    std::thread producer([&pipeline]()
+                        {
+                            for (int i = 0; i < 10; i++)
+                                pipeline.push(i);
+                        });
+                    std::thread consumer([&pipeline, &popped]()
+                        {
+                            int value;
+                            popped = pipeline.pop(value);
+                        });
+                    mtime::msleep(20);
+                    pipeline.abort();
+                    producer.join();
+                    consumer.join();
+                    int value;
+                    ret = !popped && !pipeline.push(0) && !pipeline.pop(value);
+                }
+                printf("%s Pipeline abort check.\n", ret ? "Passed." : "Failed!");
+            }
+            printf("\n");
+        }
+
+        inline void ThreadPoolStatsTest()
+        {
+            const mthread::SchedulePolicy policies[] = { mthread::SchedulePolicy::SharedQueue, mthread::SchedulePolicy::WorkStealing, mthread::SchedulePolicy::LockFreeQueue };
+            const char* policy_names[] = { "SharedQueue", "WorkStealing", "LockFreeQueue" };
+            for (int p = 0; p < 3; ++p)
+            {
+                mthread::ThreadPool thd_pool(2, policies[p]);
+                //任务结果先于完成计数写入，等待计数追上
+                auto wait_completed = [&thd_pool](long long num_completed)
+                    {
+                        mthread::ThreadPoolStats stats = thd_pool.snapshot();
+                        for (int i = 0; i < 1000 && stats.num_completed < num_completed; ++i)
+                        {
+                            mtime::msleep(1);
+                            stats = thd_pool.snapshot();
+                        }
+                        return stats;
+                    };
+                thd_pool.addTask([]() {});
+                mthread::ThreadPoolStats before = wait_completed(1);
+                bool ret = before.num_completed == 1 && before.num_submitted == 1 && before.run_time.count == 0 && before.elapsed_ns == 0;
+
+                thd_pool.setStatsEnabled(true);
+                for (int i = 0; i < 20; i++)
+                    thd_pool.addTask([]() { mtime::usleep(500); });
+                mthread::ThreadPoolStats after = wait_completed(21);
+                ret = ret && after.num_completed == 21 && after.num_submitted == 21 && after.num_running == 0 && after.num_pending == 0;
+                ret = ret && after.run_time.count == 20 && after.queue_wait.count == 20;
+                ret = ret && after.run_time.meanNs() >= 500000 && after.run_time.percentileNs(50) >= 500000;
+                ret = ret && after.run_time.percentileNs(100) == after.run_time.max_ns && after.run_time.percentileNs(50) <= after.run_time.max_ns;
+                long long busy_ns = 0;
+                for (long long worker_busy_ns : after.worker_busy_ns)
+                    busy_ns += worker_busy_ns;
+                ret = ret && after.pool_size == 2 && after.worker_busy_ratios.size() == 2 && busy_ns == after.run_time.total_ns && after.elapsed_ns > 0;
+                for (double ratio : after.worker_busy_ratios)
+                    ret = ret && ratio >= 0 && ratio <= 1;
+
+                thd_pool.setStatsEnabled(false);
+                thd_pool.addTask([]() {});
+                mthread::ThreadPoolStats disabled = wait_completed(22);
+                ret = ret && disabled.num_completed == 22 && disabled.run_time.count == 20;
+                printf("%s ThreadPool::snapshot check with %s.\n", ret ? "Passed." : "Failed!", policy_names[p]);
+            }
+
+            {
+                //无锁队列已满时工作线程直接执行的任务同样计入完成数和耗时统计，drain会等待它们结束
+                const int num_tasks = MINE_LOCKFREE_TASK_QUEUE_CAPACITY + 100;
+                mthread::ThreadPool thd_pool(1, mthread::SchedulePolicy::LockFreeQueue);
+                thd_pool.setStatsEnabled(true);
+                std::atomic<int> counter(0);
+                thd_pool.addTask([&thd_pool, &counter, num_tasks]()
+                    {
+                        for (int i = 0; i < num_tasks; i++)
+                            thd_pool.addTask([&counter]() { counter++; });
+                    });
+                thd_pool.drain();
+                mthread::ThreadPoolStats stats = thd_pool.snapshot();
+                bool ret = counter.load() == num_tasks && stats.num_completed == num_tasks + 1 && stats.run_time.count == num_tasks + 1;
+
+                //队列已满时其他线程等待空位而不是自己执行任务，线程池停止后放弃等待并取消任务
+                mthread::ThreadPool blocked_pool(1, mthread::SchedulePolicy::LockFreeQueue);
+                std::atomic<bool> ran_on_producer(false);
+                std::atomic<bool> gate(false);
+                blocked_pool.addTask([&gate]()
+                    {
+                        while (!gate.load())
+                            mtime::msleep(1);
+                    });
+                std::vector<mthread::TaskState> states;
+                std::thread producer([&blocked_pool, &states, &ran_on_producer]()
+                    {
+                        std::thread::id producer_id = std::this_thread::get_id();
+                        for (int i = 0; i < MINE_LOCKFREE_TASK_QUEUE_CAPACITY + 10; i++)
+                        {
+                            states.emplace_back(blocked_pool.addTask([&ran_on_producer, producer_id]()
+                                {
+                                    if (std::this_thread::get_id() == producer_id)
+                                        ran_on_producer = true;
+                                }));
+                        }
+                    });
+                mtime::msleep(20);
+                std::thread opener([&gate]()
+                    {
+                        mtime::msleep(20);
+                        gate.store(true);
+                    });
+                blocked_pool.abort();
+                producer.join();
+                opener.join();
+                for (auto& state : states)
+                    ret = ret && state.finished();
+                ret = ret && !ran_on_producer.load();
+                printf("%s ThreadPool LockFreeQueue full queue check.\n", ret ? "Passed." : "Failed!");
+            }
+            printf("\n");
+        }
+
+        inline void ThreadPoolResizeTest()
+        {
+            const mthread::SchedulePolicy policies[] = { mthread::SchedulePolicy::SharedQueue, mthread::SchedulePolicy::WorkStealing, mthread::SchedulePolicy::LockFreeQueue };
+            const char* policy_names[] = { "SharedQueue", "WorkStealing", "LockFreeQueue" };
+            for (int p = 0; p < 3; ++p)
+            {
+                mthread::ThreadPool thd_pool(2, policies[p]);
+                thd_pool.setIdleSpinTime(100);
+                std::atomic<int> counter(0);
+                auto add_tasks = [&thd_pool, &counter](int num_tasks)
+                {
+                    for (int i = 0; i < num_tasks; i++)
+                        thd_pool.addTask([&counter]() { mtime::usleep(100); counter++; });
+                };
+                auto wait_counter = [&counter](int target)
+                {
+                    while (counter.load() < target)
+                        std::this_thread::yield();
+                };
+                add_tasks(100);
+                thd_pool.resize(4);
+                bool ret = thd_pool.getPoolSize() == 4;
+                add_tasks(100);
+                //缩减时仍有任务在排队，被移除线程的任务应由剩余线程执行
+                thd_pool.resize(1);
+                ret = ret && thd_pool.getPoolSize() == 1;
+                wait_counter(200);
+                thd_pool.resize(3);
+                add_tasks(100);
+                wait_counter(300);
+                ret = ret && thd_pool.getPoolSize() == 3;
+                printf("%s ThreadPool(%s)::resize check.\n", ret ? "Passed." : "Failed!", policy_names[p]);
+            }
+
+            {
+                mthread::ThreadPool thd_pool(2);
+                bool ret = thd_pool.setWorkerAffinity(0, { 0 }) && thd_pool.setWorkerAffinity(3, { 0 }) && thd_pool.setWorkerAffinity(0, {});
+                thd_pool.resize(4);
+                ret = ret && thd_pool.addTask([]() { return 1; }).get() == 1;
+#if defined(__linux__) && !defined(__ANDROID__)
+                printf("%s ThreadPool::setWorkerAffinity check.\n", ret ? "Passed." : "Failed!");
+#else
+                printf("%s ThreadPool::setWorkerAffinity check.\n", !ret ? "Passed." : "Failed!");
+#endif
+            }
+            printf("\n");
+        }
+
+        inline void IdleSpinBenchmark()
+        {
+            //线程池空闲时，比较直接休眠和先自旋两种方式下任务从添加到开始执行的延迟
+            const int num_tasks = 200;
+            const long long spin_times_us[] = { 0, 200 };
+            for (long long spin_us : spin_times_us)
+            {
+                mthread::ThreadPool thd_pool(2);
+                thd_pool.setIdleSpinTime(spin_us);
+                std::vector<long long> latencies_us;
+                for (int i = 0; i < num_tasks; i++)
+                {
+                    auto submit_t = mtime::now();
+                    latencies_us.push_back(thd_pool.addTask([submit_t]() { return mtime::us(mtime::now() - submit_t); }).get());
+                    //模拟突发任务之间的短暂空闲
+                    mtime::usleep(50);
+                }
+                std::sort(latencies_us.begin(), latencies_us.end());
+                long long total_us = 0;
+                for (long long latency_us : latencies_us)
+                    total_us += latency_us;
+                printf("Benchmark. ThreadPool wake-up latency with idle spin %lldus: mean %lldus, p99 %lldus.\n", spin_us, total_us / num_tasks, latencies_us[num_tasks * 99 / 100]);
+            }
+            printf("\n");
+        }
+
+        //未暂停时暂停点的开销，以及从发出暂停到所有暂停点停下、再全部恢复的往返耗时
+        template<class PauserT>
+        inline void _runPauserBenchmark(const char* pauser_name)
+        {
+            const int num_calls = 10000000;
+            const int num_thds = 4;
+            const int num_rounds = 100;
+            PauserT pauser;
+            std::atomic<bool> point_state(false);
+            auto start_t = mtime::now();
+            for (int i = 0; i < num_calls; i++)
+                pauser.setPausePoint();
+            double plain_ns = mtime::ns(mtime::now() - start_t) * 1.0 / num_calls;
+            start_t = mtime::now();
+            for (int i = 0; i < num_calls; i++)
+                pauser.setPausePoint(point_state);
+            double state_ns = mtime::ns(mtime::now() - start_t) * 1.0 / num_calls;
+            printf("Benchmark. %s::setPausePoint unpaused: %.2fns/call, with state: %.2fns/call.\n", pauser_name, plain_ns, state_ns);
+
+            std::atomic<bool> stop(false);
+            std::atomic<bool> states[num_thds];
+            std::vector<std::thread> thds;
+            for (int i = 0; i < num_thds; i++)
+            {
+                states[i].store(false);
+                thds.emplace_back([&pauser, &stop, &states, i]()
+                    {
+                        while (!stop.load())
+                            pauser.setPausePoint(states[i]);
+                    });
+            }
+            start_t = mtime::now();
+            for (int round = 0; round < num_rounds; round++)
+            {
+                pauser.pause();
+                for (int i = 0; i < num_thds; i++)
+                {
+                    while (!states[i].load())
+                        std::this_thread::yield();
+                }
+                pauser.resume();
+            }
+            long long cost_us = mtime::us(mtime::now() - start_t);
+            stop = true;
+            pauser.resume();
+            for (auto& thd : thds)
+                thd.join();
+            printf("Benchmark. %s pause/resume round trip with %d threads by polling states: %lldus.\n", pauser_name, num_thds, cost_us / num_rounds);
+        }
+
+        inline void ThreadPauserBenchmark()
+        {
+            _runPauserBenchmark<mthread::ThreadPauser>("ThreadPauser");
+            _runPauserBenchmark<mthread::ParkingThreadPauser>("ParkingThreadPauser");
+
+            const int num_thds = 4;
+            const int num_rounds = 200;
+            mthread::ParkingThreadPauser pauser;
+            std::atomic<bool> stop(false);
+            std::vector<std::thread> thds;
+            for (int i = 0; i < num_thds; i++)
+            {
+                thds.emplace_back([&pauser, &stop]()
+                    {
+                        while (!stop.load())
+                            pauser.setPausePoint();
+                    });
+            }
+            auto start_t = mtime::now();
+            for (int round = 0; round < num_rounds; round++)
+            {
+                pauser.pauseAndWaitAllParked(num_thds);
+                pauser.resume();
+            }
+            long long cost_us = mtime::us(mtime::now() - start_t);
+            stop = true;
+            pauser.resume();
+            for (auto& thd : thds)
+                thd.join();
+            printf("Benchmark. ParkingThreadPauser pause/resume round trip with %d threads by pauseAndWaitAllParked: %lldus.\n", num_thds, cost_us / num_rounds);
+            printf("\n");
         }
 
-        template<class Fn, class... Args, class Ret, typename std::enable_if<std::is_same<Ret, typename mtype::StdBindChecker<Fn, Args...>::ReturnType>::value && (std::is_void<Ret>::value || std::is_move_assignable<typename std::remove_reference<Ret>::type>::value), int>::type>
-        inline TaskRetState<Ret> ThreadPool::addTask(Fn&& func, Args&&... args)
+        inline void PipelineBenchmark()
         {
-            auto task = std::make_shared<std::packaged_task<Ret()>>(std::bind(std::forward<Fn>(func), std::forward<Args>(args)...));
-            TaskRetState<Ret> state(task->get_future());
+            //三个空阶段时每个元素在流水线中的调度开销，以及各阶段的统计输出
+            const int num_items = 100000;
+            const mthread::PipelineOrder orders[] = { mthread::PipelineOrder::Ordered, mthread::PipelineOrder::Unordered };
+            const char* order_names[] = { "ordered", "unordered" };
+            for (int mode = 0; mode < 2; mode++)
             {
-                std::lock_guard<std::mutex> lk(this->task_mtx_);
-                this->task_queue_.emplace([task]() {(*task)(); });
+                mthread::Pipeline<int, int> pipeline(orders[mode], 64);
+                pipeline.addStage<int, int>("stage0", [](int x) { return x + 1; }, 1, 64)
+                    .addStage<int, int>("stage1", [](int x) { return x * 2; }, 2, 64)
+                    .addStage<int, int>("stage2", [](int x) { return x - 1; }, 1, 64);
+                pipeline.start();
+                auto start_t = mtime::now();
+                std::thread producer([&pipeline]()
+                    {
+                        for (int i = 0; i < num_items; i++)
+                            pipeline.push(i);
+                        pipeline.close();
+                    });
+                int value;
+                int num_outputs = 0;
+                while (pipeline.pop(value))
+                    ++num_outputs;
+                producer.join();
+                long long cost_ns = mtime::ns(mtime::now() - start_t);
+                printf("Benchmark. Pipeline with 3 empty stages, %s: %.0f items/s, %lldns/item.\n", order_names[mode],
+                    num_outputs * 1e9 / (cost_ns > 0 ? cost_ns : 1), cost_ns / (num_outputs > 0 ? num_outputs : 1));
+                if (mode == 1)
+                    pipeline.printStageStats(mtime::Unit::ns);
             }
-            this->cond_var_.notify_one();
-            return state;
+            printf("\n");
         }
 
-        inline void ThreadPool::worker()
+        inline void TaskPriorityBenchmark()
         {
-            std::function<void()> task;
-            while (!this->need_abort_)
+            //线程池被后台任务占满时，比较时延敏感任务以普通方式和以High优先级添加时的等待时间
+            const int pool_size = 2;
+            const int num_bulk = 400;
+            const int num_critical = 40;
+            const char* mode_names[] = { "FIFO", "High priority" };
+            for (int mode = 0; mode < 2; ++mode)
             {
+                mthread::ThreadPool thd_pool(pool_size);
+                std::vector<long long> waits_us(num_critical, 0);
+                std::vector<mthread::TaskState> states;
+                for (int i = 0; i < num_bulk; i++)
                 {
-                    std::unique_lock<std::mutex> lk(this->task_mtx_);
-                    while (!this->need_abort_ && this->task_queue_.empty())
-                    {
-                        this->cond_var_.wait(lk);
-                    }
-                    if (this->need_abort_)
-                        break;
-                    task = this->task_queue_.front();
-                    this->task_queue_.pop();
+                    auto bulk_func = []() { mtime::usleep(200); };
+                    if (mode == 0)
+                        thd_pool.addTask(bulk_func);
+                    else thd_pool.addTask(mthread::TaskPriority::Low, bulk_func);
                 }
-                task();
+                for (int i = 0; i < num_critical; i++)
+                {
+                    auto critical_func = [&waits_us, i](mtime::TimePoint submit_t) { waits_us[i] = mtime::us(mtime::now() - submit_t); };
+                    if (mode == 0)
+                        states.emplace_back(thd_pool.addTask(critical_func, mtime::now()));
+                    else states.emplace_back(thd_pool.addTask(mthread::TaskPriority::High, critical_func, mtime::now()));
+                    mtime::usleep(500);
+                }
+                for (auto& state : states)
+                    state.wait();
+                std::sort(waits_us.begin(), waits_us.end());
+                long long total_us = 0;
+                for (long long wait_us : waits_us)
+                    total_us += wait_us;
+                printf("Benchmark. ThreadPool %s critical task wait under load: mean %lldus, p99 %lldus.\n", mode_names[mode], total_us / num_critical, waits_us[num_critical * 99 / 100]);
             }
+            printf("\n");
         }
 
-
-        inline ThreadPauser::ThreadPauser()
+        inline void ThreadPoolBenchmark()
         {
-            this->need_pause_.store(false);
+            const int pool_size = std::thread::hardware_concurrency() > 2 ? std::thread::hardware_concurrency() : 2;
+            const int num_roots = 1000;
+            const int num_children = 100;
+            const mthread::SchedulePolicy policies[] = { mthread::SchedulePolicy::SharedQueue, mthread::SchedulePolicy::WorkStealing, mthread::SchedulePolicy::LockFreeQueue };
+            const char* policy_names[] = { "SharedQueue", "WorkStealing", "LockFreeQueue" };
+            for (int p = 0; p < 3; ++p)
+            {
+                mthread::ThreadPool thd_pool(pool_size, policies[p]);
+                std::atomic<int> counter(0);
+                auto start_t = mtime::now();
+                for (int i = 0; i < num_roots; i++)
+                {
+                    //每个根任务在工作线程内再派生若干短任务，模拟分治场景
+                    thd_pool.addTask([&thd_pool, &counter, num_children]()
+                        {
+                            for (int j = 0; j < num_children; j++)
+                                thd_pool.addTask([&counter]() { counter.fetch_add(1, std::memory_order_relaxed); });
+                            counter.fetch_add(1, std::memory_order_relaxed);
+                        });
+                }
+                while (counter.load() < num_roots * (num_children + 1))
+                    std::this_thread::yield();
+                long long cost_us = mtime::us(mtime::now() - start_t);
+                printf("Benchmark. ThreadPool(%s) with %d threads: %d tasks cost %lldus.\n", policy_names[p], pool_size, num_roots * (num_children + 1), cost_us);
+            }
+            printf("\n");
         }
 
-        inline ThreadPauser::~ThreadPauser()
+        //互斥锁加条件变量实现的有界队列，作为MPMCQueue的对照
+        template<class T>
+        class _MutexQueue
         {
-            this->resume();
-        }
+        public:
+            explicit _MutexQueue(size_t capacity) :capacity_(capacity) {}
 
-        inline void ThreadPauser::setPausePoint()
-        {
-            if (this->need_pause_.load(std::memory_order_acquire))
+            void push(T&& value)
             {
-                std::unique_lock<std::mutex> lk(this->mtx_);
-                while (this->need_pause_.load(std::memory_order_acquire))
                 {
-                    this->cond_.wait(lk);
+                    std::unique_lock<std::mutex> lk(this->mtx_);
+                    while (this->items_.size() >= this->capacity_)
+                        this->not_full_cond_.wait(lk);
+                    this->items_.push_back(std::move(value));
                 }
+                this->not_empty_cond_.notify_one();
             }
-        }
 
-        inline void ThreadPauser::setPausePoint(std::atomic<bool>& pause_point_state)
-        {          
-            if (this->need_pause_.load(std::memory_order_acquire))
+            void pop(T& value)
             {
-                std::unique_lock<std::mutex> lk(this->mtx_);
-                while (this->need_pause_.load(std::memory_order_acquire))
                 {
-                    pause_point_state.store(true);
-                    this->cond_.wait(lk);  //据说wait内部，先加锁cond_var内部锁，再解锁lk
+                    std::unique_lock<std::mutex> lk(this->mtx_);
+                    while (this->items_.empty())
+                        this->not_empty_cond_.wait(lk);
+                    value = std::move(this->items_.front());
+                    this->items_.pop_front();
                 }
+                this->not_full_cond_.notify_one();
             }
-            pause_point_state.store(false);
-        }
 
-        inline void ThreadPauser::pause()
+        private:
+            size_t capacity_;
+            std::deque<T> items_;
+            std::mutex mtx_;
+            std::condition_variable not_empty_cond_;
+            std::condition_variable not_full_cond_;
+        };
+
+        template<class Queue>
+        inline void _runQueueBenchmark(const char* queue_name, int num_producers, int num_items)
         {
-            this->need_pause_.store(true, std::memory_order_release);
+            Queue queue(1024);
+            std::vector<std::vector<long long>> latencies(num_producers);
+            std::vector<std::thread> thds;
+            auto start_t = mtime::now();
+            for (int i = 0; i < num_producers; i++)
+            {
+                thds.emplace_back([&queue, num_items]()
+                    {
+                        for (int j = 0; j < num_items; j++)
+                            queue.push(mtime::now());
+                    });
+                thds.emplace_back([&queue, &latencies, i, num_items]()
+                    {
+                        mtime::TimePoint push_t;
+                        latencies[i].reserve(num_items);
+                        for (int j = 0; j < num_items; j++)
+                        {
+                            queue.pop(push_t);
+                            latencies[i].push_back(mtime::ns(mtime::now() - push_t));
+                        }
+                    });
+            }
+            for (auto& thd : thds)
+                thd.join();
+            long long cost_us = mtime::us(mtime::now() - start_t);
+
+            std::vector<long long> all_latencies;
+            for (auto& consumer_latencies : latencies)
+                all_latencies.insert(all_latencies.end(), consumer_latencies.begin(), consumer_latencies.end());
+            std::sort(all_latencies.begin(), all_latencies.end());
+            long long total_ns = 0;
+            for (long long latency : all_latencies)
+                total_ns += latency;
+            long long total_items = static_cast<long long>(num_producers) * num_items;
+            printf("Benchmark. %s with %d producers and %d consumers: %.0f items/s, latency mean %lldns, p99 %lldns.\n",
+                queue_name, num_producers, num_producers, total_items * 1e6 / (cost_us > 0 ? cost_us : 1),
+                total_ns / total_items, all_latencies[static_cast<size_t>(total_items * 99 / 100)]);
         }
 
-        inline void ThreadPauser::resume()
+        inline void MPMCQueueBenchmark()
         {
+            const int num_items = 20000;
+            const int producer_counts[] = { 1, 2, 4, 8 };
+            for (int num_producers : producer_counts)
             {
-                std::lock_guard<std::mutex> lk(this->mtx_);
-                this->need_pause_.store(false, std::memory_order_release);
+                _runQueueBenchmark<mthread::MPMCQueue<mtime::TimePoint>>("MPMCQueue", num_producers, num_items);
+                _runQueueBenchmark<_MutexQueue<mtime::TimePoint>>("MutexQueue", num_producers, num_items);
             }
-            this->cond_.notify_all();  //据说notify内部，先加锁cond_var内部锁，再通知，因此不用担心cond_var在lk解锁后进入wait前，notify触发而导致错过
+            printf("\n");
         }
 
-        inline bool ThreadPauser::isPaused()
+        //std::mutex的加解锁接口与其他锁不同名，包装后用于对比
+        class _StdMutexLock
         {
-            return this->need_pause_.load(std::memory_order_acquire);
-        }
+        public:
+            void lock() { this->mtx_.lock(); }
+            void unlock() { this->mtx_.unlock(); }
 
+        private:
+            std::mutex mtx_;
+        };
 
-        //已废弃
-        inline ThreadPool::ThreadPool(int pool_size, long long wakeup_period_ms)
+        template<class LockT>
+        inline void _runLockBenchmark(const char* lock_name, int num_thds, int num_ops)
         {
-            if (pool_size <= 0)
+            LockT lock;
+            long long shared_data[8] = {};
+            std::vector<long long> max_waits(num_thds, 0);
+            std::vector<std::thread> thds;
+            auto start_t = mtime::now();
+            for (int i = 0; i < num_thds; i++)
             {
-                mprintfW("Invalid param value pool_size:%d, which will be set to 1.\n", pool_size);
-                pool_size = 1;
+                thds.emplace_back([&lock, &shared_data, &max_waits, i, num_thds, num_ops]()
+                    {
+                        for (int j = 0; j < num_ops / num_thds; j++)
+                        {
+                            auto wait_start_t = mtime::now();
+                            lock.lock();
+                            long long wait_ns = mtime::ns(mtime::now() - wait_start_t);
+                            for (long long& data : shared_data)
+                                ++data;
+                            lock.unlock();
+                            max_waits[i] = std::max(max_waits[i], wait_ns);
+                        }
+                    });
             }
-            this->pool_size_ = pool_size;
-            std::queue<std::function<void()>> empty_queue;
-            this->task_queue_.swap(empty_queue);
-            this->need_abort_ = false;
+            for (auto& thd : thds)
+                thd.join();
+            long long cost_us = mtime::us(mtime::now() - start_t);
+            long long total_ops = static_cast<long long>(num_ops / num_thds) * num_thds;
+            printf("Benchmark. %s with %d threads: %.0f ops/s, max wait %lldus%s.\n", lock_name, num_thds,
+                total_ops * 1e6 / (cost_us > 0 ? cost_us : 1), *std::max_element(max_waits.begin(), max_waits.end()) / 1000,
+                shared_data[0] == total_ops ? "" : ", data corrupted");
+        }
 
-            this->work_thds_.resize(pool_size);
-            for (int i = 0; i < pool_size; ++i)
+        inline void SpinLockBenchmark()
+        {
+            const int num_ops = 200000;
+            const int thread_counts[] = { 1, 2, 4, 8 };
+            for (int num_thds : thread_counts)
             {
-                this->work_thds_[i] = std::thread(&ThreadPool::worker, this);
+                _runLockBenchmark<_StdMutexLock>("std::mutex", num_thds, num_ops);
+                _runLockBenchmark<mthread::SpinLock>("SpinLock", num_thds, num_ops);
+                _runLockBenchmark<mthread::TicketSpinLock>("TicketSpinLock", num_thds, num_ops);
+                _runLockBenchmark<mthread::HybridMutex>("HybridMutex", num_thds, num_ops);
             }
+            printf("\n");
         }
-    }
-
 
+        //按write_percent的比例混合读写操作，返回每秒完成的操作数
+        template<class RWLockT, class... Args>
+        inline double _measureRWLockOps(int num_thds, int write_percent, int num_ops, Args... args)
+        {
+            RWLockT rwlk(args...);
+            long long shared_data[8] = {};
+            std::atomic<long long> read_sum(0);
+            std::vector<std::thread> thds;
+            auto start_t = mtime::now();
+            for (int i = 0; i < num_thds; i++)
+            {
+                thds.emplace_back([&rwlk, &shared_data, &read_sum, i, num_thds, write_percent, num_ops]()
+                    {
+                        long long local_sum = 0;
+                        for (int j = 0; j < num_ops / num_thds; j++)
+                        {
+                            if ((j * 7 + i) % 100 < write_percent)
+                            {
+                                rwlk.lockWrite();
+                                for (long long& data : shared_data)
+                                    ++data;
+                                rwlk.unlockWrite();
+                            }
+                            else
+                            {
+                                rwlk.lockRead();
+                                for (long long data : shared_data)
+                                    local_sum += data;
+                                rwlk.unlockRead();
+                            }
+                        }
+                        read_sum += local_sum;
+                    });
+            }
+            for (auto& thd : thds)
+                thd.join();
+            long long cost_us = mtime::us(mtime::now() - start_t);
+            long long total_ops = static_cast<long long>(num_ops / num_thds) * num_thds;
+            return total_ops * 1e6 / (cost_us > 0 ? cost_us : 1);
+        }
 
-#ifdef MINEUTILS_TEST_MODULES
-    namespace _mthreadcheck
-    {
-        inline void SpinLockTest()
+        template<class RWLockT, class... Args>
+        inline void _runRWLockBenchmark(const char* lock_name, int num_thds, int write_percent, int num_ops, Args... args)
         {
-            mthread::SpinLock splk;
-            char strs[] = "Hello World";
+            printf("Benchmark. %s with %d threads and %d%% writes: %.0f ops/s.\n", lock_name, num_thds, write_percent,
+                _measureRWLockOps<RWLockT>(num_thds, write_percent, num_ops, args...));
+        }
 
-            bool func1_check_ret = true;
-            auto func1 = [&strs, &splk, &func1_check_ret]()
+        inline void ReadWriteMutexBenchmark()
+        {
+            const int num_ops = 200000;
+            const int thread_counts[] = { 2, 8 };
+            const int write_percents[] = { 0, 1, 10 };
+            for (int num_thds : thread_counts)
             {
-                for (int i = 0; i < 10000; i++)
+                for (int write_percent : write_percents)
                 {
-                    auto guard = splk.lockGuard();
-                    strs[0] = 'W';
-                    strs[1] = 'o';
-                    strs[2] = 'r';
-                    strs[3] = 'l';
-                    strs[4] = 'd';
-                    func1_check_ret = func1_check_ret && (std::string("World World") == strs);
+                    _runRWLockBenchmark<mthread::ReadWriteMutex>("ReadWriteMutex(PreferReader)", num_thds, write_percent, num_ops, mthread::LockPreference::PreferReader);
+                    _runRWLockBenchmark<mthread::ReadWriteMutex>("ReadWriteMutex(PreferWriter)", num_thds, write_percent, num_ops, mthread::LockPreference::PreferWriter);
+                    _runRWLockBenchmark<mthread::ScalableReadWriteMutex>("ScalableReadWriteMutex", num_thds, write_percent, num_ops);
                 }
-            };
+            }
+            printf("\n");
+        }
 
-            bool func2_check_ret = true;
-            auto func2 = [&strs, &splk, &func2_check_ret]()
+        struct _BenchmarkConfig
+        {
+            float thresholds[4];
+            std::vector<std::string> class_names;
+        };
+
+        //按读取方式读取配置并累加结果，避免读取被优化掉
+        template<class ReadFn>
+        inline void _runConfigReadBenchmark(const char* method_name, int num_thds, int num_reads, ReadFn read_func)
+        {
+            std::vector<std::thread> thds;
+            std::atomic<long long> checksum(0);
+            auto start_t = mtime::now();
+            for (int i = 0; i < num_thds; i++)
             {
-                for (int i = 0; i < 10000; i++)
-                {
-                    auto guard = splk.lockGuard();
-                    strs[0] = 'H';
-                    strs[1] = 'e';
-                    strs[2] = 'l';
-                    strs[3] = 'l';
-                    strs[4] = 'o';
-                    func2_check_ret = func2_check_ret && (std::string("Hello World") == strs);
-                }
-            };
-            std::thread thd1(func1);
-            std::thread thd2(func2);
-            thd1.join();
-            thd2.join();
+                thds.emplace_back([&read_func, &checksum, num_thds, num_reads]()
+                    {
+                        long long local_sum = 0;
+                        for (int j = 0; j < num_reads / num_thds; j++)
+                            local_sum += read_func();
+                        checksum += local_sum;
+                    });
+            }
+            for (auto& thd : thds)
+                thd.join();
+            long long cost_us = mtime::us(mtime::now() - start_t);
+            long long total_reads = static_cast<long long>(num_reads / num_thds) * num_thds;
+            printf("Benchmark. Config read through %s with %d threads: %.0f reads/s.\n", method_name, num_thds, total_reads * 1e6 / (cost_us > 0 ? cost_us : 1));
+        }
 
-            printf("%s SpinLock check.\n", func1_check_ret && func2_check_ret ? "Passed." : "Failed!");
+        inline void SnapshotBenchmark()
+        {
+            const int num_reads = 1000000;
+            _BenchmarkConfig config = { { 0.25f, 0.45f, 0.5f, 0.7f }, { "person", "car", "bicycle" } };
+            mthread::Snapshot<_BenchmarkConfig> snapshot(config);
+            mthread::ReadWriteMutex rw_mtx;
+            mthread::ScalableReadWriteMutex scalable_rw_mtx;
+            const int thread_counts[] = { 1, 4, 8 };
+            for (int num_thds : thread_counts)
+            {
+                _runConfigReadBenchmark("Snapshot", num_thds, num_reads, [&snapshot]()
+                    {
+                        auto view = snapshot.read();
+                        return static_cast<long long>(view->thresholds[1] * 100) + static_cast<long long>(view->class_names.size());
+                    });
+                _runConfigReadBenchmark("ReadWriteMutex", num_thds, num_reads, [&rw_mtx, &config]()
+                    {
+                        auto guard = rw_mtx.lockReadGuard();
+                        return static_cast<long long>(config.thresholds[1] * 100) + static_cast<long long>(config.class_names.size());
+                    });
+                _runConfigReadBenchmark("ScalableReadWriteMutex", num_thds, num_reads, [&scalable_rw_mtx, &config]()
+                    {
+                        auto guard = scalable_rw_mtx.lockReadGuard();
+                        return static_cast<long long>(config.thresholds[1] * 100) + static_cast<long long>(config.class_names.size());
+                    });
+            }
             printf("\n");
         }
 
-        inline void ReadWriteMutexTest()
+        inline void ObjectPoolBenchmark()
         {
-            mthread::ReadWriteMutex rwlk;
-            char strs[] = "Hello World";
-
-            bool func1_check_ret = true;
-            auto func1 = [&strs, &rwlk, &func1_check_ret]()
+            const int num_ops = 200000;
+            const size_t buffer_size = 64 * 1024;
+            const int thread_counts[] = { 1, 4, 8 };
+            mthread::ObjectPool<std::vector<unsigned char>> pool([buffer_size]() { return std::vector<unsigned char>(buffer_size); });
+            pool.prewarm(16);
+            for (int num_thds : thread_counts)
             {
-                for (int i = 0; i < 10000; i++)
+                for (int use_pool = 1; use_pool >= 0; --use_pool)
                 {
-                    auto guard = rwlk.lockReadGuard();
-                    strs[0] = 'W';
-                    strs[1] = 'o';
-                    strs[2] = 'r';
-                    strs[3] = 'l';
-                    strs[4] = 'd';
-                    func1_check_ret = func1_check_ret && (std::string("World World") == strs);
+                    std::vector<std::thread> thds;
+                    std::atomic<long long> checksum(0);
+                    auto start_t = mtime::now();
+                    for (int i = 0; i < num_thds; i++)
+                    {
+                        thds.emplace_back([&pool, &checksum, use_pool, buffer_size, num_thds, num_ops]()
+                            {
+                                long long local_sum = 0;
+                                for (int j = 0; j < num_ops / num_thds; j++)
+                                {
+                                    if (use_pool)
+                                    {
+                                        auto handle = pool.acquire();
+                                        (*handle)[j % buffer_size] = static_cast<unsigned char>(j);
+                                        local_sum += (*handle)[j % buffer_size];
+                                    }
+                                    else
+                                    {
+                                        std::unique_ptr<std::vector<unsigned char>> buffer(new std::vector<unsigned char>(buffer_size));
+                                        (*buffer)[j % buffer_size] = static_cast<unsigned char>(j);
+                                        local_sum += (*buffer)[j % buffer_size];
+                                    }
+                                }
+                                checksum += local_sum;
+                            });
+                    }
+                    for (auto& thd : thds)
+                        thd.join();
+                    long long cost_us = mtime::us(mtime::now() - start_t);
+                    long long total_ops = static_cast<long long>(num_ops / num_thds) * num_thds;
+                    printf("Benchmark. 64KB buffer from %s with %d threads: %.0f ops/s.\n", use_pool ? "ObjectPool" : "new/delete", num_thds,
+                        total_ops * 1e6 / (cost_us > 0 ? cost_us : 1));
                 }
-            };
+            }
+            printf("\n");
+        }
 
-            bool func2_check_ret = true;
-            auto func2 = [&strs, &rwlk, &func2_check_ret]()
+        inline void ShardedCounterBenchmark()
+        {
+            //多个线程同时累加计数时，比较共用一个原子变量和按线程分片的吞吐量
+            const int num_ops = 2000000;
+            const int thread_counts[] = { 1, 2, 4, 8 };
+            for (int num_thds : thread_counts)
             {
-                for (int i = 0; i < 10000; i++)
+                std::atomic<long long> shared_counter(0);
+                mthread::ShardedCounter sharded_counter;
+                for (int mode = 0; mode < 2; mode++)
                 {
-                    auto guard = rwlk.lockReadGuard();
-                    strs[0] = 'H';
-                    strs[1] = 'e';
-                    strs[2] = 'l';
-                    strs[3] = 'l';
-                    strs[4] = 'o';
-                    func2_check_ret = func2_check_ret && (std::string("Hello World") == strs);
+                    std::vector<std::thread> thds;
+                    auto start_t = mtime::now();
+                    for (int i = 0; i < num_thds; i++)
+                    {
+                        thds.emplace_back([&shared_counter, &sharded_counter, mode, num_thds]()
+                            {
+                                for (int j = 0; j < num_ops / num_thds; j++)
+                                {
+                                    if (mode == 0)
+                                        shared_counter.fetch_add(1, std::memory_order_relaxed);
+                                    else sharded_counter.add(1);
+                                }
+                            });
+                    }
+                    for (auto& thd : thds)
+                        thd.join();
+                    long long cost_us = mtime::us(mtime::now() - start_t);
+                    long long total_ops = static_cast<long long>(num_ops / num_thds) * num_thds;
+                    printf("Benchmark. %s with %d threads: %.0f adds/s.\n", mode == 0 ? "std::atomic counter" : "ShardedCounter", num_thds,
+                        total_ops * 1e6 / (cost_us > 0 ? cost_us : 1));
                 }
-            };
-            {
-                std::thread thd1(func1);
-                std::thread thd2(func2);
-                thd1.join();
-                thd2.join();
-                printf("%s ReadWriteMutexTest Read-Read Lock check.\n", !(func1_check_ret && func2_check_ret) ? "Passed." : "Maybe failed! Try again!");
             }
+            printf("\n");
+        }
 
-            memcpy(strs, "Hello World", 11);
-            bool func3_check_ret = true;
-            auto func3 = [&strs, &rwlk, &func3_check_ret]()
-            {
-                for (int i = 0; i < 10000; i++)
-                {
-                    auto guard = rwlk.lockWriteGuard();
-                    strs[0] = 'W';
-                    strs[1] = 'o';
-                    strs[2] = 'r';
-                    strs[3] = 'l';
-                    strs[4] = 'd';
-                    func3_check_ret = func3_check_ret && (std::string("World World") == strs);
-                }
-            };
+        //输出一行机器可读的基准测试结果，格式为MINEBENCH,版本,测试项,参数,指标,数值,单位；参数内以分号分隔
+        inline void _printBenchmarkRecord(const std::string& item, const std::string& params, const char* metric, double value, const char* unit)
+        {
+            printf("MINEBENCH,%s.%s.%s,%s,%s,%s,%.1f,%s\n", MINEUTILS_MAJOR_VERSION, MINEUTILS_MINOR_VERSION, MINEUTILS_PATCH_VERSION,
+                item.c_str(), params.c_str(), metric, value, unit);
+        }
 
-            bool func4_check_ret = true;
-            auto func4 = [&strs, &rwlk, &func4_check_ret]()
+        //获取样本的百分位数，会对samples排序
+        inline long long _getSamplePercentile(std::vector<long long>& samples, double percent)
+        {
+            if (samples.empty())
+                return 0;
+            std::sort(samples.begin(), samples.end());
+            size_t idx = static_cast<size_t>(samples.size() * percent / 100.0);
+            return samples[std::min(idx, samples.size() - 1)];
+        }
+
+        //从1开始按2的幂增长到max_threads的线程数序列，最后一项为max_threads
+        inline std::vector<int> _getBenchmarkThreadCounts(int max_threads)
+        {
+            std::vector<int> thread_counts;
+            for (int num_thds = 1; num_thds < max_threads; num_thds *= 2)
+                thread_counts.push_back(num_thds);
+            thread_counts.push_back(max_threads);
+            return thread_counts;
+        }
+
+        //空闲线程池中逐个添加任务，记录addTask调用本身的耗时和任务从添加到开始执行的延迟
+        inline void _runSubmitLatencySuite(int pool_size)
+        {
+            const int num_tasks = 1000;
+            mthread::ThreadPool thd_pool(pool_size);
+            std::vector<long long> submit_ns, start_ns;
+            for (int i = 0; i < num_tasks; i++)
             {
-                for (int i = 0; i < 10000; i++)
+                auto submit_t = mtime::now();
+                auto ret_state = thd_pool.addTask([submit_t]() { return mtime::ns(mtime::now() - submit_t); });
+                submit_ns.push_back(mtime::ns(mtime::now() - submit_t));
+                start_ns.push_back(ret_state.get());
+            }
+            std::string params = "threads=" + std::to_string(pool_size);
+            _printBenchmarkRecord("ThreadPool.addTask.submit", params, "p50", static_cast<double>(_getSamplePercentile(submit_ns, 50)), "ns");
+            _printBenchmarkRecord("ThreadPool.addTask.submit", params, "p99", static_cast<double>(_getSamplePercentile(submit_ns, 99)), "ns");
+            _printBenchmarkRecord("ThreadPool.addTask.start", params, "p50", static_cast<double>(_getSamplePercentile(start_ns, 50)), "ns");
+            _printBenchmarkRecord("ThreadPool.addTask.start", params, "p99", static_cast<double>(_getSamplePercentile(start_ns, 99)), "ns");
+        }
+
+        //由外部线程连续添加空任务，统计线程池处理空任务的吞吐量
+        inline void _runEmptyTaskSuite(int pool_size, mthread::SchedulePolicy policy, const char* policy_name)
+        {
+            const int num_tasks = 50000;
+            mthread::ThreadPool thd_pool(pool_size, policy);
+            std::atomic<int> counter(0);
+            auto start_t = mtime::now();
+            for (int i = 0; i < num_tasks; i++)
+                thd_pool.addTask([&counter]() { counter.fetch_add(1, std::memory_order_relaxed); });
+            while (counter.load() < num_tasks)
+                std::this_thread::yield();
+            long long cost_ns = mtime::ns(mtime::now() - start_t);
+            _printBenchmarkRecord("ThreadPool.emptyTask", "threads=" + std::to_string(pool_size) + ";policy=" + policy_name, "throughput",
+                num_tasks * 1e9 / (cost_ns > 0 ? cost_ns : 1), "tasks/s");
+        }
+
+        //持锁线程在另一线程已阻塞等待时解锁，记录从解锁到另一线程获得锁的延迟
+        template<class LockT>
+        inline void _runLockHandoffSuite(const char* lock_name)
+        {
+            const int num_rounds = 500;
+            LockT lock;
+            std::atomic<int> stage(0);
+            std::atomic<long long> release_ns(0);
+            std::vector<long long> handoff_ns;
+            auto base_t = mtime::now();
+            std::thread waiter([&]()
                 {
-                    auto guard = rwlk.lockWriteGuard();
-                    strs[0] = 'H';
-                    strs[1] = 'e';
-                    strs[2] = 'l';
-                    strs[3] = 'l';
-                    strs[4] = 'o';
-                    func4_check_ret = func4_check_ret && (std::string("Hello World") == strs);
-                }
-            };
+                    for (int i = 0; i < num_rounds; i++)
+                    {
+                        while (stage.load() != 2 * i + 1)
+                            std::this_thread::yield();
+                        lock.lock();
+                        handoff_ns.push_back(mtime::ns(mtime::now() - base_t) - release_ns.load());
+                        lock.unlock();
+                        stage.store(2 * i + 2);
+                    }
+                });
+            for (int i = 0; i < num_rounds; i++)
+            {
+                lock.lock();
+                stage.store(2 * i + 1);
+                //持锁一小段时间，让等待线程进入阻塞
+                auto hold_t = mtime::now();
+                while (mtime::now() - hold_t < std::chrono::microseconds(50))
+                    std::this_thread::yield();
+                release_ns.store(mtime::ns(mtime::now() - base_t));
+                lock.unlock();
+                while (stage.load() != 2 * i + 2)
+                    std::this_thread::yield();
+            }
+            waiter.join();
+            _printBenchmarkRecord(std::string(lock_name) + ".handoff", "threads=2", "p50", static_cast<double>(_getSamplePercentile(handoff_ns, 50)), "ns");
+            _printBenchmarkRecord(std::string(lock_name) + ".handoff", "threads=2", "p99", static_cast<double>(_getSamplePercentile(handoff_ns, 99)), "ns");
+        }
+
+        template<class PauserT>
+        inline void _runPausePointSuite(const char* pauser_name)
+        {
+            const int num_calls = 10000000;
+            PauserT pauser;
+            auto start_t = mtime::now();
+            for (int i = 0; i < num_calls; i++)
+                pauser.setPausePoint();
+            _printBenchmarkRecord(std::string(pauser_name) + ".setPausePoint", "paused=0", "cost", mtime::ns(mtime::now() - start_t) * 1.0 / num_calls, "ns");
+        }
+
+        /*  机器可读的mthread基准测试套件，每项结果输出一行，便于在同一块板子上对比不同版本
+            - 用法：单独编译一个定义了MINEUTILS_TEST_MODULES的程序，调用mineutils::_mthreadcheck::benchmarkSuite()，用grep ^MINEBENCH筛选结果
+            - 包括：任务提交延迟p50/p99、1~N个线程的空任务吞吐量、各种锁的交接延迟、不同读写比例下读写锁的吞吐量、暂停点开销
+            @param max_threads: 最大测试线程数，小于1时使用CPU核数，且不小于2  */
+        inline void benchmarkSuite(int max_threads = 0)
+        {
+            if (max_threads < 1)
+                max_threads = std::max(static_cast<int>(std::thread::hardware_concurrency()), 2);
+            std::vector<int> thread_counts = _getBenchmarkThreadCounts(max_threads);
+            printf("MINEBENCH,version,item,params,metric,value,unit\n");
+
+            for (int num_thds : thread_counts)
+                _runSubmitLatencySuite(num_thds);
 
+            const mthread::SchedulePolicy policies[] = { mthread::SchedulePolicy::SharedQueue, mthread::SchedulePolicy::WorkStealing, mthread::SchedulePolicy::LockFreeQueue };
+            const char* policy_names[] = { "SharedQueue", "WorkStealing", "LockFreeQueue" };
+            for (int num_thds : thread_counts)
             {
-                func1_check_ret = true;
-                func4_check_ret = true;
-                std::thread thd1(func1);
-                std::thread thd4(func4);
-                thd1.join();
-                thd4.join();
-                printf("%s ReadWriteMutexTest Read-Write Lock check.\n", func1_check_ret && func4_check_ret ? "Passed." : "Failed!");
+                for (int p = 0; p < 3; ++p)
+                    _runEmptyTaskSuite(num_thds, policies[p], policy_names[p]);
             }
 
+            _runLockHandoffSuite<_StdMutexLock>("std::mutex");
+            _runLockHandoffSuite<mthread::SpinLock>("SpinLock");
+            _runLockHandoffSuite<mthread::TicketSpinLock>("TicketSpinLock");
+            _runLockHandoffSuite<mthread::HybridMutex>("HybridMutex");
+
+            const int num_rw_ops = 200000;
+            const int write_percents[] = { 0, 1, 10, 50 };
+            for (int num_thds : thread_counts)
             {
-                func3_check_ret = true;
-                func4_check_ret = true;
-                std::thread thd3(func3);
-                std::thread thd4(func4);
-                thd3.join();
-                thd4.join();
-                printf("%s ReadWriteMutexTest Write-Write Lock check.\n", func3_check_ret && func4_check_ret ? "Passed." : "Failed!");
+                for (int write_percent : write_percents)
+                {
+                    std::string params = "threads=" + std::to_string(num_thds) + ";write_percent=" + std::to_string(write_percent);
+                    _printBenchmarkRecord("ReadWriteMutex(PreferReader)", params, "throughput",
+                        _measureRWLockOps<mthread::ReadWriteMutex>(num_thds, write_percent, num_rw_ops, mthread::LockPreference::PreferReader), "ops/s");
+                    _printBenchmarkRecord("ReadWriteMutex(PreferWriter)", params, "throughput",
+                        _measureRWLockOps<mthread::ReadWriteMutex>(num_thds, write_percent, num_rw_ops, mthread::LockPreference::PreferWriter), "ops/s");
+                    _printBenchmarkRecord("ScalableReadWriteMutex", params, "throughput",
+                        _measureRWLockOps<mthread::ScalableReadWriteMutex>(num_thds, write_percent, num_rw_ops), "ops/s");
+                }
             }
-            printf("\n");
+
+            _runPausePointSuite<mthread::ThreadPauser>("ThreadPauser");
+            _runPausePointSuite<mthread::ParkingThreadPauser>("ParkingThreadPauser");
         }
 
         inline void check()
@@ -690,8 +8270,42 @@ namespace mineutils
             printf("\n--------------------check mthread start--------------------\n\n");
             SpinLockTest();
             ReadWriteMutexTest();
+            SnapshotTest();
+            ObjectPoolTest();
+            ShardedCounterTest();
+            SPSCChannelTest();
+            MPMCQueueTest();
+            ThreadPoolTest();
+            ThreadPoolTaskTest();
+            ParallelForTest();
+            TaskGraphTest();
+            ContinuationTest();
+            TaskPriorityTest();
+            ThreadPoolResizeTest();
+            CancellationTest();
+            ThreadPoolStatsTest();
+            TimerTaskTest();
+            ThreadPauserTest();
+            PipelineTest();
             printf("--------------------check mthread end--------------------\n\n");
         }
+
+        inline void benchmark()
+        {
+            printf("\n--------------------benchmark mthread start--------------------\n\n");
+            SpinLockBenchmark();
+            ReadWriteMutexBenchmark();
+            SnapshotBenchmark();
+            ObjectPoolBenchmark();
+            ShardedCounterBenchmark();
+            MPMCQueueBenchmark();
+            ThreadPoolBenchmark();
+            TaskPriorityBenchmark();
+            IdleSpinBenchmark();
+            ThreadPauserBenchmark();
+            PipelineBenchmark();
+            printf("--------------------benchmark mthread end--------------------\n\n");
+        }
     }
 #endif
 
@@ -4,15 +4,56 @@
 #ifndef TIME_HPP_MINEUTILS
 #define TIME_HPP_MINEUTILS
 
+#include<atomic>
 #include<chrono>
+#include<cmath>
+#include<condition_variable>
 #include<map>
+#include<memory>
+#include<mutex>
 #include<stdio.h>
 #include<string>
 #include<thread>
 #include<vector>
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include<intrin.h>
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include<cpuid.h>
+#endif
 
 #include"base.hpp"
 
+#ifndef MINE_TIMECOUNTER_MAX_TAGS
+#define MINE_TIMECOUNTER_MAX_TAGS 64   //ConcurrentMeanTimeCounter最多可注册的代码段数量
+#endif
+
+#ifndef MINE_PROFILER_RING_SIZE
+#define MINE_PROFILER_RING_SIZE 4096   //性能分析时每个线程环形缓冲区可暂存的区间数量，需为2的幂
+#endif
+
+#ifndef MINE_TIMEIT_TARGET_COUNT
+#define MINE_TIMEIT_TARGET_COUNT 100   //MINE_TIMEIT_SCOPE每轮统计次数
+#endif
+
+/*  代码段计时宏，耗时同时计入进程内共享的ConcurrentMeanTimeCounter和性能分析器(ProfileZone)
+    - tag需为字符串字面量，只在首次执行时注册一次，之后计时不构造字符串
+    - 同一行只能使用一次MINE_TIMEIT_SCOPE
+    - 编译时定义宏MINE_DISABLE_TIMEIT后这些宏展开为空，代码中保留的计时没有任何开销
+    - 用法：
+        MINE_TIMEIT_SCOPE("infer");   //统计到作用域结束
+        MINE_TIMEIT_PRINT_ALL(mineutils::mtime::Unit::ms);   //输出达到统计次数的代码段   */
+#ifdef MINE_DISABLE_TIMEIT
+#define MINE_TIMEIT_SCOPE(tag)
+#define MINE_TIMEIT_PRINT_ALL(time_unit) ((void)0)
+#else
+#define _MINE_TIMEIT_CONCAT_IMPL(a, b) a##b
+#define _MINE_TIMEIT_CONCAT(a, b) _MINE_TIMEIT_CONCAT_IMPL(a, b)
+#define MINE_TIMEIT_SCOPE(tag) \
+    static const int _MINE_TIMEIT_CONCAT(_mine_timeit_handle_, __LINE__) = mineutils::mtime::_getTimeitCounter().registerTag(tag); \
+    mineutils::mtime::_TimeitScope _MINE_TIMEIT_CONCAT(_mine_timeit_scope_, __LINE__)(_MINE_TIMEIT_CONCAT(_mine_timeit_handle_, __LINE__), tag)
+#define MINE_TIMEIT_PRINT_ALL(time_unit) mineutils::mtime::_getTimeitCounter().printAllMeanTimeCost(time_unit)
+#endif
+
 namespace mineutils
 {
     /*--------------------------------------------用户接口--------------------------------------------*/
@@ -32,9 +73,19 @@ namespace mineutils
             ns = 3
         };
 
-        //获取当前时间点
+        //获取当前时间点，总是使用steady_clock，可用于计算等待的截止时间
         TimePoint now();
 
+        /*  使用CPU周期计数器获取当前时间点，x86上为rdtsc，AArch64上为cntvct_el0
+            - 首次调用时与steady_clock校准(x86约10毫秒，AArch64直接读取计数器频率)，返回值与now()类型相同、时间基准一致
+            - 校准误差约为百万分之几，长时间运行后与steady_clock会有少量偏差，适合统计较短代码段的耗时，不能用于计算steady_clock等待的截止时间
+            - 编译时定义宏MINE_TIME_USE_FAST_CLOCK后，各计时类(MeanTimeCounter、TimeCounterGuard、ProfileZone等)改用fastNow，now()不受影响
+            - 其他平台或x86 CPU的TSC频率不恒定时退化为steady_clock::now()   */
+        TimePoint fastNow();
+
+        //fastNow是否在使用CPU周期计数器，首次调用时会触发校准
+        bool isFastClockAvailable();
+
         //将“时间段(mtime::Duration)”类型转化为以秒为单位的数字
         long long s(const mtime::Duration& t);
 
@@ -63,8 +114,23 @@ namespace mineutils
         void setGlobalTimeCounterOn(bool glob_timecounter_on);
 
 
+        //代码段耗时的统计结果，时间均以纳秒为单位；分位数来自对数线性分桶的直方图，相对误差约3%
+        struct TimeCostStats
+        {
+            long long count = 0;
+            double mean_ns = 0;
+            long long min_ns = 0;
+            long long max_ns = 0;
+            double stddev_ns = 0;   //总体标准差
+            long long p50_ns = 0;
+            long long p90_ns = 0;
+            long long p99_ns = 0;
+            long long p999_ns = 0;
+        };
+
         //用于统计各个代码段的在一定循环次数的平均消耗时间，非线程安全
-        //调用addStart和addEnd会带来少量时间损耗(在rv1126上约为12微秒)
+        //输出时同时给出本轮的最小、最大耗时、标准差和p50/p90/p99/p99.9分位数，每个代码段的统计内存固定
+        //调用addStart和addEnd会带来少量时间损耗(在rv1126上约为12微秒)，需要线程安全或更低开销时使用ConcurrentMeanTimeCounter
         class MeanTimeCounter
         {
         private:
@@ -113,6 +179,11 @@ namespace mineutils
                 @param time_unit: 输出信息中时间统计的单位，输入强枚举类型mtime::Unit的成员   */
             void printAllMeanTimeCost(const std::string& print_head, mtime::Unit time_unit = mtime::Unit::ms);
 
+            /*  获取codeblock_tag代码段本轮的耗时统计，不会重新开始统计
+                @param codeblock_tag: 被统计代码段的tag
+                @return 本轮的耗时统计，代码段不存在或本轮还没有数据时count为0   */
+            mtime::TimeCostStats getStats(const std::string& codeblock_tag) const;
+
         private:
             class SingleCounter;
 
@@ -125,6 +196,103 @@ namespace mineutils
             mdeprecated(R"(Deprecated. Please replace with function "MeanTimeCounter::addGuard"(in time.hpp) )") Guard addLocal(std::string codeblock_tag);
         };
 
+        /*  线程安全的低开销平均耗时统计，可在正式版本中常开
+            - 代码段tag只在registerTag时解析一次，之后用整数句柄计时，addStart和addEnd只有一次数组索引和一次取时间，不做字符串查找
+            - 每个线程写入自己的统计槽，打印时合并所有线程的数据，线程退出后其数据仍会被合并
+            - 输出内容与MeanTimeCounter相同，包括最值、标准差和分位数；每个线程的每个代码段在首次计时时分配一次固定大小的统计内存
+            - 最多注册MINE_TIMECOUNTER_MAX_TAGS个代码段；同一线程内不支持同一代码段的嵌套计时
+            - 用法：
+                static mtime::ConcurrentMeanTimeCounter time_counter(100);
+                static const int infer_tag = time_counter.registerTag("infer");
+                auto guard = time_counter.addGuard(infer_tag);   //任意线程中
+                time_counter.printAllMeanTimeCost();   //任意线程中  */
+        class ConcurrentMeanTimeCounter
+        {
+        private:
+            class Guard;
+
+        public:
+            /*  构造ConcurrentMeanTimeCounter类
+                @param target_count_times: 每轮统计次数，为所有线程合计的次数，小于1的值会被置为1
+                @param time_counter_on: 计时功能开关，为false会跳过计时功能   */
+            explicit ConcurrentMeanTimeCounter(int target_count_times = 1, bool time_counter_on = true);
+
+            /*  注册代码段tag，重复注册同一tag返回相同的句柄；线程安全
+                @param codeblock_tag: 要统计的代码段的tag
+                @return 代码段句柄；超过最大注册数量时返回-1，用-1计时和输出会被忽略   */
+            int registerTag(const std::string& codeblock_tag);
+
+            /*  本线程本轮统计开始，应在目标统计代码段前调用，与同一线程中段后的addEnd成对出现；线程安全
+                @param tag_handle: registerTag返回的代码段句柄   */
+            void addStart(int tag_handle);
+
+            /*  本线程本轮统计结束，应在目标统计代码段后调用，与同一线程中段前的addStart成对出现；线程安全
+                @param tag_handle: registerTag返回的代码段句柄   */
+            void addEnd(int tag_handle);
+
+            /*  使用RAII方式记录一段代码的耗时
+                - 用法：auto guard = time_counter.addGuard(tag_handle)
+                @param tag_handle: registerTag返回的代码段句柄
+                @return 一个私有类Guard对象，只能用auto推导；在返回时记录开始时间，在被析构时记录结束时间  */
+            ConcurrentMeanTimeCounter::Guard addGuard(int tag_handle);
+
+            /*  合并所有线程的数据，代码段达到目标统计次数后输出平均消耗时间，并重新开始统计此段代码；线程安全
+                @param tag_handle: registerTag返回的代码段句柄
+                @param time_unit: 输出信息中时间统计的单位，输入强枚举类型mtime::Unit的成员
+                @return 若达到目标统计次数，则按time_unit返回平均耗时；否则返回-1   */
+            long long printMeanTimeCost(int tag_handle, mtime::Unit time_unit = mtime::Unit::ms);
+
+            /*  合并所有线程的数据，代码段达到目标统计次数后输出平均消耗时间，并重新开始统计此段代码；线程安全
+                @param print_head: 输出信息的头部内容，推荐输入调用printMeanTimeCost的函数的名字
+                @param tag_handle: registerTag返回的代码段句柄
+                @param time_unit: 输出信息中时间统计的单位，输入强枚举类型mtime::Unit的成员
+                @return 若达到目标统计次数，则按time_unit返回平均耗时；否则返回-1   */
+            long long printMeanTimeCost(const std::string& print_head, int tag_handle, mtime::Unit time_unit = mtime::Unit::ms);
+
+            /*  对每个达到目标统计次数的代码段，输出其平均消耗时间并重新开始统计此段代码；线程安全
+                @param time_unit: 输出信息中时间统计的单位，输入强枚举类型mtime::Unit的成员   */
+            void printAllMeanTimeCost(mtime::Unit time_unit = mtime::Unit::ms);
+
+            /*  对每个达到目标统计次数的代码段，输出其平均消耗时间并重新开始统计此段代码；线程安全
+                @param print_head: 输出信息的头部内容，推荐输入调用printAllMeanTimeCost的函数的名字
+                @param time_unit: 输出信息中时间统计的单位，输入强枚举类型mtime::Unit的成员   */
+            void printAllMeanTimeCost(const std::string& print_head, mtime::Unit time_unit = mtime::Unit::ms);
+
+            /*  合并所有线程的数据，获取代码段本轮的耗时统计，不会重新开始统计；线程安全
+                @param tag_handle: registerTag返回的代码段句柄
+                @return 本轮的耗时统计，句柄无效或本轮还没有数据时count为0   */
+            mtime::TimeCostStats getStats(int tag_handle);
+
+            ConcurrentMeanTimeCounter(const ConcurrentMeanTimeCounter& _temp) = delete;
+            ConcurrentMeanTimeCounter(ConcurrentMeanTimeCounter&& _temp) = delete;
+            ConcurrentMeanTimeCounter& operator=(const ConcurrentMeanTimeCounter& _temp) = delete;
+            ConcurrentMeanTimeCounter& operator=(ConcurrentMeanTimeCounter&& _temp) = delete;
+
+        private:
+            struct TagSlot;
+            struct ThreadSlots;
+
+            ConcurrentMeanTimeCounter::ThreadSlots* getThreadSlots();
+            ConcurrentMeanTimeCounter::ThreadSlots* findThreadSlots();
+            static void lockSlot(TagSlot& slot);
+            static void unlockSlot(TagSlot& slot);
+            mtime::TimeCostStats mergeTag(int tag_handle, bool reset);
+            long long printTag(const std::string& codeblock_tag, int tag_handle, mtime::Unit time_unit);
+
+            unsigned long long id_ = 0;   //全局唯一且不会复用的编号，线程缓存以此识别计数器
+            int target_count_times_ = 1;
+            bool time_counter_on_ = true;
+            std::atomic<int> num_tags_;
+
+            //tags_mtx_保护代码段的注册信息，先于slots_mtx_加锁
+            std::mutex tags_mtx_;
+            std::vector<std::string> tags_;
+            std::map<std::string, int> tag_handles_;
+
+            std::mutex slots_mtx_;
+            std::vector<std::unique_ptr<ThreadSlots>> thread_slots_;
+        };
+
 
         //统计代码块的运行时间，在创建对象时开始计时，在析构时停止计时并打印耗时
         class TimeCounterGuard
@@ -175,6 +343,43 @@ namespace mineutils
             long long target_time_;
             mtime::Unit time_unit_;
         };
+
+        /*  启动层次化性能分析：之后各线程中ProfileZone区间的起止时间写入本线程的无锁环形缓冲区，后台线程定期将其写为Chrome trace JSON
+            - 输出文件可用chrome://tracing或https://ui.perfetto.dev打开，同一线程中嵌套的区间显示为层次结构
+            - 使用JSON Array格式，结尾的"]"在stopProfiler时才写出，该格式允许省略结尾，因此中途异常退出时的文件仍可被上述工具打开
+            - 某线程的环形缓冲区写满时新的区间会被丢弃，stopProfiler时输出丢弃的数量；缓冲区大小由宏MINE_PROFILER_RING_SIZE设置
+            - 不支持thread_local的编译器(如qnx660的gcc4.7.3)无法感知线程退出，已退出线程的缓冲区不会被移除
+            @param json_path: 输出的JSON文件路径，已存在时会被覆盖
+            @param flush_interval_ms: 后台写文件的间隔(毫秒)，小于1的值会被置为1
+            @return 启动成功返回true；已在运行或文件无法打开时返回false   */
+        bool startProfiler(const std::string& json_path, long long flush_interval_ms = 100);
+
+        //停止性能分析，写出剩余的区间并关闭文件；未在运行时什么也不做
+        void stopProfiler();
+
+        //性能分析是否正在运行
+        bool isProfilerRunning();
+
+        /*  使用RAII方式记录一个性能分析区间，构造时记录开始时间，析构时将区间写入本线程的环形缓冲区
+            - 性能分析未运行或setGlobalTimeCounterOn(false)时，构造和析构只各做一次开关判断
+            - 用法：mtime::ProfileZone zone("infer");   */
+        class ProfileZone
+        {
+        public:
+            /*  构造ProfileZone类
+                @param zone_name: 区间名，只保存指针，需为字符串字面量或在stopProfiler前一直有效的字符串   */
+            explicit ProfileZone(const char* zone_name);
+
+            ProfileZone(const ProfileZone& _temp) = delete;
+            ProfileZone(ProfileZone&& _temp) = delete;
+            ProfileZone& operator=(const ProfileZone& _temp) = delete;
+            ProfileZone& operator=(ProfileZone&& _temp) = delete;
+            ~ProfileZone();
+
+        private:
+            const char* zone_name_ = nullptr;   //为nullptr表示本区间不记录
+            long long start_ns_ = 0;
+        };
     }
 
 
@@ -188,12 +393,153 @@ namespace mineutils
 
     namespace mtime
     {
+        //快速时钟的校准结果：时间 = base_ns + (计数 - base_ticks) * ns_per_tick
+        struct _FastClock
+        {
+            bool available = false;
+            unsigned long long base_ticks = 0;
+            long long base_ns = 0;
+            double ns_per_tick = 0;
+        };
+
+        inline unsigned long long _readCycleCounter()
+        {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+            return __rdtsc();
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+            return __builtin_ia32_rdtsc();
+#elif defined(__GNUC__) && defined(__aarch64__)
+            //isb保证读取计数器不会被提前执行
+            unsigned long long ticks;
+            __asm__ __volatile__("isb\n\tmrs %0, cntvct_el0" : "=r"(ticks) :: "memory");
+            return ticks;
+#else
+            return 0;
+#endif
+        }
+
+        //计数器频率已知时返回每秒计数，需要与steady_clock校准时返回0
+        inline unsigned long long _getCycleCounterFrequency()
+        {
+#if defined(__GNUC__) && defined(__aarch64__)
+            unsigned long long freq;
+            __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(freq));
+            return freq;
+#else
+            return 0;
+#endif
+        }
+
+        //x86需要CPU支持恒定频率的TSC(invariant TSC)，否则变频时计数速度会改变
+        inline bool _hasStableCycleCounter()
+        {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+            int regs[4];
+            __cpuid(regs, 0x80000000);
+            if (static_cast<unsigned int>(regs[0]) < 0x80000007)
+                return false;
+            __cpuid(regs, 0x80000007);
+            return (regs[3] & (1 << 8)) != 0;
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+            unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+            if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007 || !__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+                return false;
+            return (edx & (1u << 8)) != 0;
+#elif defined(__GNUC__) && defined(__aarch64__)
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        //取一对尽量同时刻的计数和steady_clock时间，多次尝试取读数间隔最短的一次
+        inline void _sampleFastClockBase(unsigned long long& ticks, long long& ns)
+        {
+            unsigned long long best_gap = ~0ULL;
+            for (int i = 0; i < 5; i++)
+            {
+                unsigned long long ticks_before = mtime::_readCycleCounter();
+                long long steady_ns = mtime::ns(std::chrono::steady_clock::now().time_since_epoch());
+                unsigned long long ticks_after = mtime::_readCycleCounter();
+                if (ticks_after - ticks_before < best_gap)
+                {
+                    best_gap = ticks_after - ticks_before;
+                    ticks = ticks_before + (ticks_after - ticks_before) / 2;
+                    ns = steady_ns;
+                }
+            }
+        }
+
+        inline _FastClock _calibrateFastClock()
+        {
+            _FastClock clock;
+            if (!mtime::_hasStableCycleCounter())
+                return clock;
+            unsigned long long start_ticks = 0;
+            long long start_ns = 0;
+            mtime::_sampleFastClockBase(start_ticks, start_ns);
+            unsigned long long freq = mtime::_getCycleCounterFrequency();
+            if (freq > 0)
+                clock.ns_per_tick = 1e9 / freq;
+            else
+            {
+                mtime::msleep(10);
+                unsigned long long end_ticks = 0;
+                long long end_ns = 0;
+                mtime::_sampleFastClockBase(end_ticks, end_ns);
+                if (end_ticks <= start_ticks || end_ns <= start_ns)
+                    return clock;
+                clock.ns_per_tick = static_cast<double>(end_ns - start_ns) / (end_ticks - start_ticks);
+            }
+            clock.base_ticks = start_ticks;
+            clock.base_ns = start_ns;
+            clock.available = true;
+            return clock;
+        }
+
+        inline const _FastClock& _getFastClock()
+        {
+            static const _FastClock clock = mtime::_calibrateFastClock();
+            return clock;
+        }
+
+        inline TimePoint fastNow()
+        {
+            const _FastClock& clock = mtime::_getFastClock();
+            if (!clock.available)
+                return std::chrono::steady_clock::now();
+            //其他核心的计数器可能略小于校准时的读数，按有符号数计算
+            long long ticks = static_cast<long long>(mtime::_readCycleCounter() - clock.base_ticks);
+            long long ns = clock.base_ns + static_cast<long long>(ticks * clock.ns_per_tick);
+            return TimePoint(std::chrono::duration_cast<mtime::Duration>(std::chrono::nanoseconds(ns)));
+        }
+
+        inline bool isFastClockAvailable()
+        {
+            return mtime::_getFastClock().available;
+        }
+
+#ifdef MINE_TIME_USE_FAST_CLOCK
+        //在程序启动阶段完成校准，避免第一次计时包含校准时间
+        static const bool _fast_clock_calibrated = (mtime::_getFastClock(), true);
+#endif
+
         //获取当前时间点(mtime::time_point)
         inline TimePoint now()
         {
             return std::chrono::steady_clock::now();
         }
 
+        //计时类使用的时钟，定义宏MINE_TIME_USE_FAST_CLOCK后为fastNow；与steady_clock会逐渐产生偏差，只用于计算时间段
+        inline TimePoint _timingNow()
+        {
+#ifdef MINE_TIME_USE_FAST_CLOCK
+            return mtime::fastNow();
+#else
+            return std::chrono::steady_clock::now();
+#endif
+        }
+
         //inline long long _countTime(const mtime::Duration& t, mtime::Unit unit)
         //{
         //    if (unit == mtime::Unit::s)
@@ -259,20 +605,197 @@ namespace mineutils
         }
 
 
-        inline bool& _getTimeCounterOn()
+        //各线程的计时代码会读取全局开关，使用原子变量以便在运行时从其他线程设置
+        inline std::atomic<bool>& _getTimeCounterOn()
         {
-            static bool g_timecounter_on = true;
+            static std::atomic<bool> g_timecounter_on(true);
             return g_timecounter_on;
         }
 
-        //设置后所有TimeCounter系列类的功能将被跳过
+        //设置后所有TimeCounter系列类的功能将被跳过；线程安全
         inline void setGlobalTimeCounterOn(bool glob_timecounter_on)
         {
-            bool& timecounter_on = mtime::_getTimeCounterOn();
-            timecounter_on = glob_timecounter_on;
+            mtime::_getTimeCounterOn().store(glob_timecounter_on, std::memory_order_relaxed);
         }
 
 
+        /*  单个代码段的耗时统计：次数、总耗时、最值、标准差和HDR风格的对数线性直方图，内存固定，记录样本时不分配内存
+            - 小于16ns的样本各占一个桶，之后每个2的幂区间等分为16个子桶，相对误差不超过1/32
+            - 不小于2^40ns(约18分钟)的样本计入单独的溢出桶，其分位数按最大值计，最值和均值仍然精确   */
+        class _TimeCostRecorder
+        {
+        public:
+            static const int SUB_BITS = 4;
+            static const int SUB_COUNT = 1 << SUB_BITS;
+            static const int MAX_EXPONENT = 40;
+            static const int NUM_BUCKETS = SUB_COUNT + (MAX_EXPONENT - SUB_BITS) * SUB_COUNT;   //[0, 2^40)范围内的桶数
+            static const int OVERFLOW_BUCKET = NUM_BUCKETS;
+
+            void record(long long ns)
+            {
+                if (ns < 0)
+                    ns = 0;
+                if (this->count_ == 0 || ns < this->min_ns_)
+                    this->min_ns_ = ns;
+                if (this->count_ == 0 || ns > this->max_ns_)
+                    this->max_ns_ = ns;
+                this->count_ += 1;
+                this->total_ns_ += ns;
+                //Welford算法，避免平方和相减带来的精度损失
+                double delta = ns - this->mean_ns_;
+                this->mean_ns_ += delta / this->count_;
+                this->m2_ += delta * (ns - this->mean_ns_);
+                this->buckets_[_TimeCostRecorder::getBucketIndex(ns)] += 1;
+            }
+
+            void mergeFrom(const _TimeCostRecorder& other)
+            {
+                if (other.count_ == 0)
+                    return;
+                if (this->count_ == 0)
+                {
+                    *this = other;
+                    return;
+                }
+                long long count = this->count_ + other.count_;
+                double delta = other.mean_ns_ - this->mean_ns_;
+                this->m2_ += other.m2_ + delta * delta * this->count_ / count * other.count_;
+                this->mean_ns_ += delta * other.count_ / count;
+                this->count_ = count;
+                this->total_ns_ += other.total_ns_;
+                if (other.min_ns_ < this->min_ns_)
+                    this->min_ns_ = other.min_ns_;
+                if (other.max_ns_ > this->max_ns_)
+                    this->max_ns_ = other.max_ns_;
+                for (int i = 0; i <= OVERFLOW_BUCKET; i++)
+                    this->buckets_[i] += other.buckets_[i];
+            }
+
+            void reset()
+            {
+                *this = _TimeCostRecorder();
+            }
+
+            long long getCount() const
+            {
+                return this->count_;
+            }
+
+            mtime::TimeCostStats getStats() const
+            {
+                mtime::TimeCostStats stats;
+                if (this->count_ == 0)
+                    return stats;
+                stats.count = this->count_;
+                stats.mean_ns = static_cast<double>(this->total_ns_) / this->count_;
+                stats.min_ns = this->min_ns_;
+                stats.max_ns = this->max_ns_;
+                stats.stddev_ns = std::sqrt(this->m2_ / this->count_);
+                stats.p50_ns = this->getPercentile(50);
+                stats.p90_ns = this->getPercentile(90);
+                stats.p99_ns = this->getPercentile(99);
+                stats.p999_ns = this->getPercentile(99.9);
+                return stats;
+            }
+
+        private:
+            static int getBucketIndex(long long ns)
+            {
+                if (ns < SUB_COUNT)
+                    return static_cast<int>(ns);
+                int exponent = _TimeCostRecorder::getHighestBit(static_cast<unsigned long long>(ns));
+                if (exponent >= MAX_EXPONENT)
+                    return OVERFLOW_BUCKET;
+                int sub_index = static_cast<int>(ns >> (exponent - SUB_BITS)) - SUB_COUNT;
+                return SUB_COUNT + (exponent - SUB_BITS) * SUB_COUNT + sub_index;
+            }
+
+            //桶的中点，桶宽为1时即为桶的下界
+            static long long getBucketMidpoint(int index)
+            {
+                if (index < SUB_COUNT)
+                    return index;
+                int shift = (index - SUB_COUNT) / SUB_COUNT;
+                long long lower = static_cast<long long>(SUB_COUNT + index % SUB_COUNT) << shift;
+                return lower + ((1LL << shift) >> 1);
+            }
+
+            static int getHighestBit(unsigned long long x)
+            {
+#if defined(__GNUC__) || defined(__clang__)
+                return 63 - __builtin_clzll(x);
+#else
+                int bit = 0;
+                while (x >>= 1)
+                    bit++;
+                return bit;
+#endif
+            }
+
+            //排名为ceil(count*percent/100)的样本所在桶的中点，并限制在[min, max]内；减去一个小量以免99.9这类小数的舍入误差让排名多1
+            long long getPercentile(double percent) const
+            {
+                long long rank = static_cast<long long>(std::ceil(this->count_ * percent / 100 - 1e-6));
+                if (rank < 1)
+                    rank = 1;
+                long long seen = 0;
+                for (int i = 0; i <= OVERFLOW_BUCKET; i++)
+                {
+                    seen += this->buckets_[i];
+                    if (seen >= rank)
+                    {
+                        if (i == OVERFLOW_BUCKET)
+                            return this->max_ns_;
+                        long long value = _TimeCostRecorder::getBucketMidpoint(i);
+                        if (value < this->min_ns_)
+                            return this->min_ns_;
+                        if (value > this->max_ns_)
+                            return this->max_ns_;
+                        return value;
+                    }
+                }
+                return this->max_ns_;
+            }
+
+            long long count_ = 0;
+            long long total_ns_ = 0;
+            long long min_ns_ = 0;
+            long long max_ns_ = 0;
+            double mean_ns_ = 0;
+            double m2_ = 0;
+            long long buckets_[NUM_BUCKETS + 1] = {};
+        };
+
+        //按MeanTimeCounter的格式输出耗时统计，返回按time_unit截断的平均耗时
+        inline long long _printTimeCostStats(const std::string& codeblock_tag, const mtime::TimeCostStats& stats, mtime::Unit time_unit)
+        {
+            const char* unit_name = "ms";
+            long long unit_ns = 1000000;
+            if (time_unit == mtime::Unit::s)
+            {
+                unit_name = "s";
+                unit_ns = 1000000000;
+            }
+            else if (time_unit == mtime::Unit::us)
+            {
+                unit_name = "us";
+                unit_ns = 1000;
+            }
+            else if (time_unit == mtime::Unit::ns)
+            {
+                unit_name = "ns";
+                unit_ns = 1;
+            }
+            int precision = unit_ns == 1 ? 0 : 3;
+            double div = static_cast<double>(unit_ns);
+            printf("%s mean cost time %.*f%s in %lld counts (min %.*f%s, max %.*f%s, stddev %.*f%s, p50 %.*f%s, p90 %.*f%s, p99 %.*f%s, p99.9 %.*f%s)\n",
+                codeblock_tag.c_str(), precision, stats.mean_ns / div, unit_name, stats.count,
+                precision, stats.min_ns / div, unit_name, precision, stats.max_ns / div, unit_name, precision, stats.stddev_ns / div, unit_name,
+                precision, stats.p50_ns / div, unit_name, precision, stats.p90_ns / div, unit_name,
+                precision, stats.p99_ns / div, unit_name, precision, stats.p999_ns / div, unit_name);
+            return static_cast<long long>(stats.mean_ns) / unit_ns;
+        }
+
         class MeanTimeCounter::Guard
         {
         public:
@@ -318,14 +841,14 @@ namespace mineutils
 
             void addStart()
             {
-                this->start_t_ = mtime::now();
+                this->start_t_ = mtime::_timingNow();
                 this->addstart_times_ += 1;
             }
 
             void addEnd()
             {
-                this->end_t_ = mtime::now();
-                this->time_cost_ += (this->end_t_ - this->start_t_);
+                this->end_t_ = mtime::_timingNow();
+                this->recorder_.record(mtime::ns(this->end_t_ - this->start_t_));
                 this->addend_times_ += 1;
                 this->now_statistical_times_ += 1;                
             }
@@ -339,32 +862,7 @@ namespace mineutils
                 }
                 if (this->finish())
                 {
-                    long long mean_time_cost;
-                    if (time_unit == mtime::Unit::s)
-                    {
-                        mean_time_cost = mtime::s(this->time_cost_) / this->now_statistical_times_;
-                        printf("%s mean cost time %llds in %d counts\n", codeblock_tag.c_str(), mean_time_cost, this->now_statistical_times_);
-                    }
-                    else if (time_unit == mtime::Unit::ms)
-                    {
-                        mean_time_cost = mtime::ms(this->time_cost_) / this->now_statistical_times_;
-                        printf("%s mean cost time %lldms in %d counts\n", codeblock_tag.c_str(), mean_time_cost, this->now_statistical_times_);
-                    }
-                    else if (time_unit == mtime::Unit::us)
-                    {
-                        mean_time_cost = mtime::us(this->time_cost_) / this->now_statistical_times_;
-                        printf("%s mean cost time %lldus in %d counts\n", codeblock_tag.c_str(), mean_time_cost, this->now_statistical_times_);
-                    }
-                    else if (time_unit == mtime::Unit::ns)
-                    {
-                        mean_time_cost = mtime::ns(this->time_cost_) / this->now_statistical_times_;
-                        printf("%s mean cost time %lldns in %d counts\n", codeblock_tag.c_str(), mean_time_cost, this->now_statistical_times_);
-                    }
-                    else
-                    {
-                        mean_time_cost = mtime::ms(this->time_cost_) / this->now_statistical_times_;
-                        printf("%s mean cost time %lldms in %d counts\n", codeblock_tag.c_str(), mean_time_cost, this->now_statistical_times_);
-                    }
+                    long long mean_time_cost = mtime::_printTimeCostStats(codeblock_tag, this->recorder_.getStats(), time_unit);
                     this->restart();
                     return mean_time_cost;
                 }
@@ -376,6 +874,11 @@ namespace mineutils
                 return this->printMeanTimeCost("\"" + print_head + "\": " + codeblock_tag, time_unit);
             }
 
+            mtime::TimeCostStats getStats() const
+            {
+                return this->recorder_.getStats();
+            }
+
         private:
             bool finish()
             {
@@ -389,7 +892,7 @@ namespace mineutils
                 this->now_statistical_times_ = 0;
                 this->addstart_times_ = 0;
                 this->addend_times_ = 0;
-                this->time_cost_ = mtime::Duration(0);
+                this->recorder_.reset();
             }
 
             int now_statistical_times_ = 0;
@@ -397,7 +900,7 @@ namespace mineutils
             int addstart_times_ = 0;
             int addend_times_ = 0;
 
-            mtime::Duration time_cost_ = mtime::Duration(0);
+            mtime::_TimeCostRecorder recorder_;
             mtime::TimePoint start_t_;
             mtime::TimePoint end_t_;
         };
@@ -411,7 +914,7 @@ namespace mineutils
 
         inline void MeanTimeCounter::addStart(const std::string& codeblock_tag)
         {
-            if (mtime::_getTimeCounterOn() && this->time_counter_on_)
+            if (mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && this->time_counter_on_)
             {
                 if (this->time_counter_.end() == this->time_counter_.find(codeblock_tag))
                 {
@@ -424,7 +927,7 @@ namespace mineutils
 
         inline void MeanTimeCounter::addEnd(const std::string& codeblock_tag)
         {
-            if (mtime::_getTimeCounterOn() && this->time_counter_on_)
+            if (mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && this->time_counter_on_)
             {
                 if (this->time_counter_.end() == this->time_counter_.find(codeblock_tag))
                 {
@@ -442,21 +945,21 @@ namespace mineutils
 
         inline long long MeanTimeCounter::printMeanTimeCost(const std::string& codeblock_tag, mtime::Unit time_unit)
         {
-            if (mtime::_getTimeCounterOn() && this->time_counter_on_)
+            if (mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && this->time_counter_on_)
                 return this->time_counter_[codeblock_tag].printMeanTimeCost(codeblock_tag, time_unit);
             return -1;
         }
 
         inline long long MeanTimeCounter::printMeanTimeCost(const std::string& print_head, const std::string& codeblock_tag, mtime::Unit time_unit)
         {
-            if (mtime::_getTimeCounterOn() && this->time_counter_on_)
+            if (mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && this->time_counter_on_)
                 return this->time_counter_[codeblock_tag].printMeanTimeCost(print_head, codeblock_tag, time_unit);
             return -1;
         }
 
         inline void MeanTimeCounter::printAllMeanTimeCost(mtime::Unit time_unit)
         {
-            if (mtime::_getTimeCounterOn() && this->time_counter_on_)
+            if (mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && this->time_counter_on_)
             {
                 for (const std::string& codeblock_tag : this->keys_)
                 {
@@ -467,7 +970,7 @@ namespace mineutils
 
         inline void MeanTimeCounter::printAllMeanTimeCost(const std::string& print_head, mtime::Unit time_unit)
         {
-            if (mtime::_getTimeCounterOn() && this->time_counter_on_)
+            if (mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && this->time_counter_on_)
             {
                 for (const std::string& codeblock_tag : this->keys_)
                 {
@@ -476,106 +979,1197 @@ namespace mineutils
             }
         }
 
+        inline mtime::TimeCostStats MeanTimeCounter::getStats(const std::string& codeblock_tag) const
+        {
+            auto iter = this->time_counter_.find(codeblock_tag);
+            if (iter == this->time_counter_.end())
+                return mtime::TimeCostStats();
+            return iter->second.getStats();
+        }
+
         inline MeanTimeCounter::Guard MeanTimeCounter::addLocal(std::string codeblock_tag)
         {
             return this->addGuard(std::move(codeblock_tag));
         }
 
-        inline TimeCounterGuard::TimeCounterGuard(const std::string& codeblock_tag, mtime::Unit time_unit, bool time_counter_on)
+
+        inline unsigned long long _getNextTimeCounterId()
         {
-            this->start_t_ = mtime::now();
-            this->codeblock_tag_ = codeblock_tag;
-            this->time_unit_ = time_unit;
-            this->time_counter_on_ = time_counter_on;
+            static std::atomic<unsigned long long> next_id(1);
+            return next_id.fetch_add(1);
         }
 
-        inline TimeCounterGuard::TimeCounterGuard(const std::string& print_head, const std::string& codeblock_tag, mtime::Unit time_unit, bool time_counter_on)
+        //一个线程中一个代码段的统计数据；recorder由所属线程在首次计时时创建，所属线程写入和打印时合并都需持有locked
+        struct ConcurrentMeanTimeCounter::TagSlot
         {
-            this->start_t_ = mtime::now();
-            this->codeblock_tag_ = "\"" + print_head + "\": " + codeblock_tag;
-            this->time_unit_ = time_unit;
-            this->time_counter_on_ = time_counter_on;
-        }
+            std::atomic<bool> locked;
+            std::unique_ptr<mtime::_TimeCostRecorder> recorder;
+            mtime::TimePoint start_t;
+            bool started;
+        };
 
-        inline TimeCounterGuard::~TimeCounterGuard()
+        //一个线程的所有代码段的统计数据，前后填充以免与其他线程的数据共用缓存行
+        struct ConcurrentMeanTimeCounter::ThreadSlots
         {
-            if (mtime::_getTimeCounterOn() && this->time_counter_on_)
+            ThreadSlots()
             {
-                this->end_t_ = mtime::now();
-                if (this->time_unit_ == mtime::Unit::s)
-                    printf("%s cost time %llds\n", this->codeblock_tag_.c_str(), mtime::s(this->end_t_ - this->start_t_));
-                else if (this->time_unit_ == mtime::Unit::ms)
-                    printf("%s cost time %lldms\n", this->codeblock_tag_.c_str(), mtime::ms(this->end_t_ - this->start_t_));
-                else if (this->time_unit_ == mtime::Unit::us)
-                    printf("%s cost time %lldus\n", this->codeblock_tag_.c_str(), mtime::us(this->end_t_ - this->start_t_));
-                else if (this->time_unit_ == mtime::Unit::ns)
-                    printf("%s cost time %lldns\n", this->codeblock_tag_.c_str(), mtime::ns(this->end_t_ - this->start_t_));
-                else
-                    printf("%s cost time %lldms\n", this->codeblock_tag_.c_str(), mtime::ms(this->end_t_ - this->start_t_));
+                for (TagSlot& slot : this->slots)
+                {
+                    slot.locked.store(false, std::memory_order_relaxed);
+                    slot.started = false;
+                }
             }
-        }
 
-        inline TimeControllerGuard::TimeControllerGuard(long long target_time, mtime::Unit time_unit)
-        {
-            this->start_t_ = mtime::now();
-            this->target_time_ = target_time;
-            this->time_unit_ = time_unit;
-        }
+            char pad0_[64];
+            TagSlot slots[MINE_TIMECOUNTER_MAX_TAGS];
+            std::thread::id owner;
+            char pad1_[64];
+        };
 
-        inline TimeControllerGuard::~TimeControllerGuard()
+        class ConcurrentMeanTimeCounter::Guard
         {
-            this->end_t_ = mtime::now();
-            if (this->time_unit_ == mtime::Unit::s)
+        public:
+            Guard(Guard&& tmp) noexcept
             {
-                long long used_time = mtime::s(this->end_t_ - this->start_t_);
-                long long need_sleep = this->target_time_ - used_time;
-                mtime::sleep(need_sleep);
+                this->tag_handle_ = tmp.tag_handle_;
+                this->self_ = tmp.self_;
+                tmp.self_ = nullptr;
             }
-            else if (this->time_unit_ == mtime::Unit::ms)
+
+            ~Guard()
             {
-                long long used_time = mtime::ms(this->end_t_ - this->start_t_);
-                long long need_sleep = this->target_time_ - used_time;
-                mtime::msleep(need_sleep);
+                if (this->self_)
+                    this->self_->addEnd(this->tag_handle_);
             }
-            else if (this->time_unit_ == mtime::Unit::us)
+
+            Guard(const Guard& tmp) = delete;
+            Guard& operator=(const Guard& tmp) = delete;
+            Guard& operator=(Guard&& tmp) = delete;
+
+        private:
+            Guard(ConcurrentMeanTimeCounter* self, int tag_handle)
             {
-                long long used_time = mtime::us(this->end_t_ - this->start_t_);
-                long long need_sleep = this->target_time_ - used_time;
-                mtime::usleep(need_sleep);
+                self->addStart(tag_handle);
+                this->self_ = self;
+                this->tag_handle_ = tag_handle;
             }
-            else if (this->time_unit_ == mtime::Unit::ns)
+
+            ConcurrentMeanTimeCounter* self_ = nullptr;
+            int tag_handle_ = -1;
+            friend ConcurrentMeanTimeCounter;
+        };
+
+        inline ConcurrentMeanTimeCounter::ConcurrentMeanTimeCounter(int target_count_times, bool time_counter_on)
+        {
+            this->id_ = mtime::_getNextTimeCounterId();
+            this->target_count_times_ = target_count_times >= 1 ? target_count_times : 1;
+            this->time_counter_on_ = time_counter_on;
+            this->num_tags_.store(0);
+        }
+
+        inline int ConcurrentMeanTimeCounter::registerTag(const std::string& codeblock_tag)
+        {
+            std::lock_guard<std::mutex> lk(this->tags_mtx_);
+            auto iter = this->tag_handles_.find(codeblock_tag);
+            if (iter != this->tag_handles_.end())
+                return iter->second;
+            if (this->tags_.size() >= MINE_TIMECOUNTER_MAX_TAGS)
             {
-                long long used_time = mtime::ns(this->end_t_ - this->start_t_);
-                long long need_sleep = this->target_time_ - used_time;
-                mtime::nsleep(need_sleep);
+                printf("!Warning!: ConcurrentMeanTimeCounter::%s: Can not register more than %d tags, tag \'%s\' will be ignored!\n", __func__, MINE_TIMECOUNTER_MAX_TAGS, codeblock_tag.c_str());
+                return -1;
             }
+            int tag_handle = static_cast<int>(this->tags_.size());
+            this->tags_.push_back(codeblock_tag);
+            this->tag_handles_[codeblock_tag] = tag_handle;
+            this->num_tags_.store(tag_handle + 1, std::memory_order_release);
+            return tag_handle;
         }
 
+        inline void ConcurrentMeanTimeCounter::addStart(int tag_handle)
+        {
+            if (mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && this->time_counter_on_)
+            {
+                if (tag_handle < 0 || tag_handle >= this->num_tags_.load(std::memory_order_acquire))
+                    return;
+                TagSlot& slot = this->getThreadSlots()->slots[tag_handle];
+                slot.started = true;
+                slot.start_t = mtime::_timingNow();
+            }
+        }
 
-
-        //已废弃
-        class mdeprecated(R"(Deprecated. Please replace with class "MeanTimeCounter"(in time.hpp) )") MultiMeanTimeCounter :public MeanTimeCounter
+        inline void ConcurrentMeanTimeCounter::addEnd(int tag_handle)
         {
-        public:
-            MultiMeanTimeCounter() :MeanTimeCounter() {}
-            explicit MultiMeanTimeCounter(int target_count_times, bool time_counter_on = true) :MeanTimeCounter(target_count_times, time_counter_on) {}
-        };
+            if (mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && this->time_counter_on_)
+            {
+                mtime::TimePoint end_t = mtime::_timingNow();
+                if (tag_handle < 0 || tag_handle >= this->num_tags_.load(std::memory_order_acquire))
+                    return;
+                TagSlot& slot = this->getThreadSlots()->slots[tag_handle];
+                if (!slot.started)
+                {
+                    printf("!!!Error!!! ConcurrentMeanTimeCounter::%s: Please call \"addStart(%d)\" before \"addEnd(%d)\" in the same thread!\n", __func__, tag_handle, tag_handle);
+                    return;
+                }
+                slot.started = false;
+                //只有打印时才会与其他线程竞争，平时加解锁都不会冲突
+                ConcurrentMeanTimeCounter::lockSlot(slot);
+                if (!slot.recorder)
+                    slot.recorder.reset(new mtime::_TimeCostRecorder());
+                slot.recorder->record(mtime::ns(end_t - slot.start_t));
+                ConcurrentMeanTimeCounter::unlockSlot(slot);
+            }
+        }
 
-        //已废弃
-        class mdeprecated(R"(Deprecated. Please replace with class "TimeCounterGuard"(in time.hpp) )") LocalTimeCounter :public TimeCounterGuard
+        inline ConcurrentMeanTimeCounter::Guard ConcurrentMeanTimeCounter::addGuard(int tag_handle)
         {
-        public:
-            LocalTimeCounter(const std::string & codeblock_tag, mtime::Unit time_unit = mtime::Unit::ms, bool time_counter_on = true) :TimeCounterGuard(codeblock_tag, time_unit, time_counter_on) {}
-            LocalTimeCounter(const std::string & print_head, const std::string & codeblock_tag, mtime::Unit time_unit = mtime::Unit::ms, bool time_counter_on = true) :TimeCounterGuard(print_head, codeblock_tag, time_unit, time_counter_on) {}
-        };
+            return ConcurrentMeanTimeCounter::Guard(this, tag_handle);
+        }
 
-        //已废弃
-        class mdeprecated(R"(Deprecated. Please replace with class "TimeControllerGuard"(in time.hpp) )") LocalTimeController :public TimeControllerGuard
+        inline long long ConcurrentMeanTimeCounter::printMeanTimeCost(int tag_handle, mtime::Unit time_unit)
         {
-        public:
-            LocalTimeController(long long target_time, mtime::Unit time_unit = mtime::Unit::ms) :TimeControllerGuard(target_time, time_unit) {}
+            if (mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && this->time_counter_on_)
+            {
+                std::lock_guard<std::mutex> lk(this->tags_mtx_);
+                if (tag_handle >= 0 && tag_handle < static_cast<int>(this->tags_.size()))
+                    return this->printTag(this->tags_[tag_handle], tag_handle, time_unit);
+            }
+            return -1;
+        }
+
+        inline long long ConcurrentMeanTimeCounter::printMeanTimeCost(const std::string& print_head, int tag_handle, mtime::Unit time_unit)
+        {
+            if (mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && this->time_counter_on_)
+            {
+                std::lock_guard<std::mutex> lk(this->tags_mtx_);
+                if (tag_handle >= 0 && tag_handle < static_cast<int>(this->tags_.size()))
+                    return this->printTag("\"" + print_head + "\": " + this->tags_[tag_handle], tag_handle, time_unit);
+            }
+            return -1;
+        }
+
+        inline void ConcurrentMeanTimeCounter::printAllMeanTimeCost(mtime::Unit time_unit)
+        {
+            if (mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && this->time_counter_on_)
+            {
+                std::lock_guard<std::mutex> lk(this->tags_mtx_);
+                for (size_t i = 0; i < this->tags_.size(); i++)
+                    this->printTag(this->tags_[i], static_cast<int>(i), time_unit);
+            }
+        }
+
+        inline void ConcurrentMeanTimeCounter::printAllMeanTimeCost(const std::string& print_head, mtime::Unit time_unit)
+        {
+            if (mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && this->time_counter_on_)
+            {
+                std::lock_guard<std::mutex> lk(this->tags_mtx_);
+                for (size_t i = 0; i < this->tags_.size(); i++)
+                    this->printTag("\"" + print_head + "\": " + this->tags_[i], static_cast<int>(i), time_unit);
+            }
+        }
+
+        inline mtime::TimeCostStats ConcurrentMeanTimeCounter::getStats(int tag_handle)
+        {
+            std::lock_guard<std::mutex> lk(this->tags_mtx_);
+            if (tag_handle >= 0 && tag_handle < static_cast<int>(this->tags_.size()))
+                return this->mergeTag(tag_handle, false);
+            return mtime::TimeCostStats();
+        }
+
+        inline void ConcurrentMeanTimeCounter::lockSlot(TagSlot& slot)
+        {
+            while (slot.locked.exchange(true, std::memory_order_acquire))
+                std::this_thread::yield();
+        }
+
+        inline void ConcurrentMeanTimeCounter::unlockSlot(TagSlot& slot)
+        {
+            slot.locked.store(false, std::memory_order_release);
+        }
+
+        //调用前需持有tags_mtx_；reset为true时只有合计次数达到目标统计次数才合并并清空各线程的数据，否则返回的count为0
+        inline mtime::TimeCostStats ConcurrentMeanTimeCounter::mergeTag(int tag_handle, bool reset)
+        {
+            std::lock_guard<std::mutex> lk(this->slots_mtx_);
+            if (reset)
+            {
+                long long count = 0;
+                for (auto& thread_slots : this->thread_slots_)
+                {
+                    TagSlot& slot = thread_slots->slots[tag_handle];
+                    ConcurrentMeanTimeCounter::lockSlot(slot);
+                    if (slot.recorder)
+                        count += slot.recorder->getCount();
+                    ConcurrentMeanTimeCounter::unlockSlot(slot);
+                }
+                if (count < this->target_count_times_)
+                    return mtime::TimeCostStats();
+            }
+            mtime::_TimeCostRecorder merged;
+            for (auto& thread_slots : this->thread_slots_)
+            {
+                TagSlot& slot = thread_slots->slots[tag_handle];
+                ConcurrentMeanTimeCounter::lockSlot(slot);
+                if (slot.recorder)
+                {
+                    merged.mergeFrom(*slot.recorder);
+                    if (reset)
+                        slot.recorder->reset();
+                }
+                ConcurrentMeanTimeCounter::unlockSlot(slot);
+            }
+            return merged.getStats();
+        }
+
+        //调用前需持有tags_mtx_
+        inline long long ConcurrentMeanTimeCounter::printTag(const std::string& codeblock_tag, int tag_handle, mtime::Unit time_unit)
+        {
+            mtime::TimeCostStats stats = this->mergeTag(tag_handle, true);
+            if (stats.count == 0)
+                return -1;
+            return mtime::_printTimeCostStats(codeblock_tag, stats, time_unit);
+        }
+
+        inline ConcurrentMeanTimeCounter::ThreadSlots* ConcurrentMeanTimeCounter::getThreadSlots()
+        {
+#if MINE_HAVE_THREAD_LOCAL
+            //线程内缓存最近使用的计数器；计数器编号不会复用，已析构的计数器的缓存项不会被误用
+            struct Cache
+            {
+                unsigned long long last_id = 0;
+                ThreadSlots* last_slots = nullptr;
+                std::vector<std::pair<unsigned long long, ThreadSlots*>> entries;
+            };
+            static thread_local Cache cache;
+            if (cache.last_id == this->id_)
+                return cache.last_slots;
+            ThreadSlots* thread_slots = nullptr;
+            for (auto& entry : cache.entries)
+            {
+                if (entry.first == this->id_)
+                {
+                    thread_slots = entry.second;
+                    break;
+                }
+            }
+            if (!thread_slots)
+            {
+                thread_slots = this->findThreadSlots();
+                //缓存项过多时直接清空，之后再使用的计数器按线程id找回本线程原有的统计槽，不会重复分配
+                if (cache.entries.size() >= 16)
+                    cache.entries.clear();
+                cache.entries.emplace_back(this->id_, thread_slots);
+            }
+            cache.last_id = this->id_;
+            cache.last_slots = thread_slots;
+            return thread_slots;
+#else
+            //不支持thread_local时每次都按线程id查找，需要加锁，开销较大但仍然正确
+            return this->findThreadSlots();
+#endif
+        }
+
+        //按线程id查找本线程的统计槽，不存在时新建；已退出线程的统计槽会被复用同一id的新线程继续使用
+        inline ConcurrentMeanTimeCounter::ThreadSlots* ConcurrentMeanTimeCounter::findThreadSlots()
+        {
+            std::thread::id thread_id = std::this_thread::get_id();
+            std::lock_guard<std::mutex> lk(this->slots_mtx_);
+            for (auto& thread_slots : this->thread_slots_)
+            {
+                if (thread_slots->owner == thread_id)
+                    return thread_slots.get();
+            }
+            ThreadSlots* thread_slots = new ThreadSlots();
+            thread_slots->owner = thread_id;
+            this->thread_slots_.emplace_back(thread_slots);
+            return thread_slots;
+        }
+
+        //关闭时不取时间也不拷贝tag；构造时关闭的对象在析构时也不输出
+        inline TimeCounterGuard::TimeCounterGuard(const std::string& codeblock_tag, mtime::Unit time_unit, bool time_counter_on)
+        {
+            this->time_counter_on_ = mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && time_counter_on;
+            this->time_unit_ = time_unit;
+            if (this->time_counter_on_)
+            {
+                this->codeblock_tag_ = codeblock_tag;
+                this->start_t_ = mtime::_timingNow();
+            }
+        }
+
+        inline TimeCounterGuard::TimeCounterGuard(const std::string& print_head, const std::string& codeblock_tag, mtime::Unit time_unit, bool time_counter_on)
+        {
+            this->time_counter_on_ = mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && time_counter_on;
+            this->time_unit_ = time_unit;
+            if (this->time_counter_on_)
+            {
+                this->codeblock_tag_ = "\"" + print_head + "\": " + codeblock_tag;
+                this->start_t_ = mtime::_timingNow();
+            }
+        }
+
+        inline TimeCounterGuard::~TimeCounterGuard()
+        {
+            if (mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && this->time_counter_on_)
+            {
+                this->end_t_ = mtime::_timingNow();
+                if (this->time_unit_ == mtime::Unit::s)
+                    printf("%s cost time %llds\n", this->codeblock_tag_.c_str(), mtime::s(this->end_t_ - this->start_t_));
+                else if (this->time_unit_ == mtime::Unit::ms)
+                    printf("%s cost time %lldms\n", this->codeblock_tag_.c_str(), mtime::ms(this->end_t_ - this->start_t_));
+                else if (this->time_unit_ == mtime::Unit::us)
+                    printf("%s cost time %lldus\n", this->codeblock_tag_.c_str(), mtime::us(this->end_t_ - this->start_t_));
+                else if (this->time_unit_ == mtime::Unit::ns)
+                    printf("%s cost time %lldns\n", this->codeblock_tag_.c_str(), mtime::ns(this->end_t_ - this->start_t_));
+                else
+                    printf("%s cost time %lldms\n", this->codeblock_tag_.c_str(), mtime::ms(this->end_t_ - this->start_t_));
+            }
+        }
+
+        inline TimeControllerGuard::TimeControllerGuard(long long target_time, mtime::Unit time_unit)
+        {
+            this->start_t_ = mtime::_timingNow();
+            this->target_time_ = target_time;
+            this->time_unit_ = time_unit;
+        }
+
+        inline TimeControllerGuard::~TimeControllerGuard()
+        {
+            this->end_t_ = mtime::_timingNow();
+            if (this->time_unit_ == mtime::Unit::s)
+            {
+                long long used_time = mtime::s(this->end_t_ - this->start_t_);
+                long long need_sleep = this->target_time_ - used_time;
+                mtime::sleep(need_sleep);
+            }
+            else if (this->time_unit_ == mtime::Unit::ms)
+            {
+                long long used_time = mtime::ms(this->end_t_ - this->start_t_);
+                long long need_sleep = this->target_time_ - used_time;
+                mtime::msleep(need_sleep);
+            }
+            else if (this->time_unit_ == mtime::Unit::us)
+            {
+                long long used_time = mtime::us(this->end_t_ - this->start_t_);
+                long long need_sleep = this->target_time_ - used_time;
+                mtime::usleep(need_sleep);
+            }
+            else if (this->time_unit_ == mtime::Unit::ns)
+            {
+                long long used_time = mtime::ns(this->end_t_ - this->start_t_);
+                long long need_sleep = this->target_time_ - used_time;
+                mtime::nsleep(need_sleep);
+            }
+        }
+
+        //一个性能分析区间，对应Chrome trace中的一个"X"事件
+        struct _ProfileEvent
+        {
+            const char* name;
+            long long start_ns;
+            long long dur_ns;
+        };
+
+        //单生产者单消费者的环形缓冲区：只有所属线程push，只有持有_ProfilerState::mtx的线程drain
+        class _ProfileRing
+        {
+        public:
+            static const size_t CAPACITY = MINE_PROFILER_RING_SIZE;
+
+            explicit _ProfileRing(int tid)
+            {
+                this->tid = tid;
+                this->events_.resize(MINE_PROFILER_RING_SIZE);
+                this->head_.store(0);
+                this->tail_.store(0);
+                this->num_dropped_.store(0);
+                this->retired.store(false);
+            }
+
+            void push(const _ProfileEvent& event)
+            {
+                size_t head = this->head_.load(std::memory_order_relaxed);
+                if (head - this->tail_.load(std::memory_order_acquire) >= CAPACITY)
+                {
+                    this->num_dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                this->events_[head & (CAPACITY - 1)] = event;
+                this->head_.store(head + 1, std::memory_order_release);
+            }
+
+            template<class Fn>
+            void drain(Fn&& fn)
+            {
+                size_t tail = this->tail_.load(std::memory_order_relaxed);
+                size_t head = this->head_.load(std::memory_order_acquire);
+                for (; tail != head; tail++)
+                    fn(this->events_[tail & (CAPACITY - 1)]);
+                this->tail_.store(tail, std::memory_order_release);
+            }
+
+            bool empty() const
+            {
+                return this->head_.load(std::memory_order_acquire) == this->tail_.load(std::memory_order_relaxed);
+            }
+
+            long long takeNumDropped()
+            {
+                return this->num_dropped_.exchange(0, std::memory_order_relaxed);
+            }
+
+            int tid = 0;
+            bool named = false;   //是否已写出线程名
+            std::atomic<bool> retired;   //所属线程已退出，缓冲区取空后可移除
+            std::thread::id owner;
+
+        private:
+            static_assert((MINE_PROFILER_RING_SIZE & (MINE_PROFILER_RING_SIZE - 1)) == 0 && MINE_PROFILER_RING_SIZE > 0, "MINE_PROFILER_RING_SIZE must be a power of 2!");
+
+            std::vector<_ProfileEvent> events_;
+            char pad0_[64];
+            std::atomic<size_t> head_;
+            char pad1_[64];
+            std::atomic<size_t> tail_;
+            std::atomic<long long> num_dropped_;
+        };
+
+        /*  性能分析的全局状态，mtx保护除on、file、first_event、write_batch和owner_rings以外的所有成员
+            写文件只在后台线程和stop中进行，这两处不会同时运行，file、first_event和write_batch只由写文件的线程访问；owner_rings由owner_mtx保护  */
+        struct _ProfilerState
+        {
+            _ProfilerState()
+            {
+                this->on.store(false);
+            }
+
+            ~_ProfilerState()
+            {
+                this->stop();
+            }
+
+            bool start(const std::string& json_path, long long flush_interval_ms)
+            {
+                std::lock_guard<std::mutex> lk(this->mtx);
+                if (this->file)
+                    return false;
+                this->file = fopen(json_path.c_str(), "w");
+                if (!this->file)
+                {
+                    printf("!Warning!: mtime::startProfiler: Can not open file \'%s\'!\n", json_path.c_str());
+                    return false;
+                }
+                fprintf(this->file, "[");
+                this->first_event = true;
+                this->stopping = false;
+                this->num_dropped = 0;
+                this->base_ns = mtime::ns(mtime::_timingNow().time_since_epoch());
+                //丢弃上次运行时残留的区间，并重新写出线程名
+                for (auto& ring : this->rings)
+                {
+                    ring->drain([](const _ProfileEvent&) {});
+                    ring->takeNumDropped();
+                    ring->named = false;
+                }
+                this->flush_interval_ms = flush_interval_ms >= 1 ? flush_interval_ms : 1;
+                this->flush_thd = std::thread(&_ProfilerState::flushLoop, this);
+                this->on.store(true, std::memory_order_release);
+                return true;
+            }
+
+            void stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lk(this->mtx);
+                    if (!this->file || this->stopping)
+                        return;
+                    this->on.store(false, std::memory_order_release);
+                    this->stopping = true;
+                }
+                this->cond.notify_all();
+                this->flush_thd.join();
+                std::unique_lock<std::mutex> lk(this->mtx);
+                this->flush(lk);
+                fprintf(this->file, "\n]\n");
+                fclose(this->file);
+                this->file = nullptr;
+                if (this->num_dropped > 0)
+                    printf("!Warning!: mtime::stopProfiler: %lld profile zones were dropped because the ring buffer was full, please increase MINE_PROFILER_RING_SIZE!\n", this->num_dropped);
+            }
+
+            void flushLoop()
+            {
+                std::unique_lock<std::mutex> lk(this->mtx);
+                while (!this->stopping)
+                {
+                    this->cond.wait_for(lk, std::chrono::milliseconds(this->flush_interval_ms));
+                    this->flush(lk);
+                }
+            }
+
+            //待写出的区间，ts_ns已减去base_ns
+            struct PendingEvent
+            {
+                const char* name;
+                long long ts_ns;
+                long long dur_ns;
+                int tid;
+                bool name_thread;   //写出区间前先写出线程名
+            };
+
+            /*  调用前需持有lk；持锁取空各缓冲区到write_batch，解锁后再写文件，返回前重新加锁
+                写文件期间ProfileZone析构和新线程登记缓冲区都不会被阻塞；开始于本次运行之前的区间被丢弃  */
+            void flush(std::unique_lock<std::mutex>& lk)
+            {
+                this->write_batch.clear();
+                for (size_t i = 0; i < this->rings.size();)
+                {
+                    _ProfileRing& ring = *this->rings[i];
+                    bool retired = ring.retired.load(std::memory_order_acquire);
+                    ring.drain([this, &ring](const _ProfileEvent& event)
+                        {
+                            if (event.start_ns < this->base_ns)
+                                return;
+                            this->write_batch.push_back({ event.name, event.start_ns - this->base_ns, event.dur_ns, ring.tid, !ring.named });
+                            ring.named = true;
+                        });
+                    this->num_dropped += ring.takeNumDropped();
+                    if (retired && ring.empty())
+                        this->rings.erase(this->rings.begin() + i);
+                    else i++;
+                }
+                lk.unlock();
+                for (const PendingEvent& event : this->write_batch)
+                    this->writeEvent(event);
+                fflush(this->file);
+                lk.lock();
+            }
+
+            //只由写文件的线程调用，不需要持有mtx
+            void writeEvent(const PendingEvent& event)
+            {
+                if (event.name_thread)
+                {
+                    fprintf(this->file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", this->first_event ? "" : ",", event.tid, event.tid);
+                    this->first_event = false;
+                }
+                fprintf(this->file, "%s\n{\"name\":\"", this->first_event ? "" : ",");
+                for (const char* c = event.name; *c; c++)
+                {
+                    if (*c == '\"' || *c == '\\')
+                        fputc('\\', this->file);
+                    if (static_cast<unsigned char>(*c) >= 0x20)
+                        fputc(*c, this->file);
+                }
+                fprintf(this->file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", event.tid, event.ts_ns / 1000.0, event.dur_ns / 1000.0);
+                this->first_event = false;
+            }
+
+            std::shared_ptr<_ProfileRing> addRing(std::thread::id owner)
+            {
+                std::lock_guard<std::mutex> lk(this->mtx);
+                std::shared_ptr<_ProfileRing> ring(new _ProfileRing(this->next_tid++));
+                ring->owner = owner;
+                this->rings.push_back(ring);
+                return ring;
+            }
+
+            std::atomic<bool> on;
+            std::mutex mtx;
+            std::condition_variable cond;
+            std::vector<std::shared_ptr<_ProfileRing>> rings;
+            int next_tid = 1;
+            FILE* file = nullptr;
+            bool first_event = true;
+            bool stopping = false;
+            long long base_ns = 0;
+            long long flush_interval_ms = 100;
+            long long num_dropped = 0;
+            std::thread flush_thd;
+            std::vector<PendingEvent> write_batch;
+            std::mutex owner_mtx;
+            std::vector<std::shared_ptr<_ProfileRing>> owner_rings;   //不支持thread_local时按线程id查找缓冲区用，与rings分开加锁
         };
+
+        inline _ProfilerState& _getProfilerState()
+        {
+            static _ProfilerState state;
+            return state;
+        }
+
+        inline _ProfileRing* _getProfileRing()
+        {
+            _ProfilerState& state = mtime::_getProfilerState();
+#if MINE_HAVE_THREAD_LOCAL
+            //线程退出时标记缓冲区，由后台线程取空后移除
+            struct Holder
+            {
+                std::shared_ptr<_ProfileRing> ring;
+                ~Holder()
+                {
+                    if (this->ring)
+                        this->ring->retired.store(true, std::memory_order_release);
+                }
+            };
+            static thread_local Holder holder;
+            if (!holder.ring)
+                holder.ring = state.addRing(std::this_thread::get_id());
+            return holder.ring.get();
+#else
+            /*  不支持thread_local时按线程id查找，只加owner_mtx，不会等待正在写文件的后台线程
+                无法感知线程退出，缓冲区不会被移除，可被复用同一id的新线程继续使用  */
+            std::thread::id thread_id = std::this_thread::get_id();
+            {
+                std::lock_guard<std::mutex> lk(state.owner_mtx);
+                for (auto& ring : state.owner_rings)
+                {
+                    if (ring->owner == thread_id)
+                        return ring.get();
+                }
+            }
+            std::shared_ptr<_ProfileRing> ring = state.addRing(thread_id);
+            std::lock_guard<std::mutex> lk(state.owner_mtx);
+            state.owner_rings.push_back(ring);
+            return ring.get();
+#endif
+        }
+
+        inline bool startProfiler(const std::string& json_path, long long flush_interval_ms)
+        {
+            return mtime::_getProfilerState().start(json_path, flush_interval_ms);
+        }
+
+        inline void stopProfiler()
+        {
+            mtime::_getProfilerState().stop();
+        }
+
+        inline bool isProfilerRunning()
+        {
+            return mtime::_getProfilerState().on.load(std::memory_order_acquire);
+        }
+
+        inline ProfileZone::ProfileZone(const char* zone_name)
+        {
+            if (mtime::_getTimeCounterOn().load(std::memory_order_relaxed) && mtime::_getProfilerState().on.load(std::memory_order_relaxed) && zone_name)
+            {
+                this->zone_name_ = zone_name;
+                this->start_ns_ = mtime::ns(mtime::_timingNow().time_since_epoch());
+            }
+        }
+
+        inline ProfileZone::~ProfileZone()
+        {
+            if (this->zone_name_)
+            {
+                long long end_ns = mtime::ns(mtime::_timingNow().time_since_epoch());
+                mtime::_getProfileRing()->push({ this->zone_name_, this->start_ns_, end_ns - this->start_ns_ });
+            }
+        }
+
+
+        //MINE_TIMEIT系列宏共用的计数器
+        inline ConcurrentMeanTimeCounter& _getTimeitCounter()
+        {
+            static ConcurrentMeanTimeCounter time_counter(MINE_TIMEIT_TARGET_COUNT);
+            return time_counter;
+        }
+
+        //MINE_TIMEIT_SCOPE展开后的RAII对象，计数器的统计区间嵌套在性能分析区间之内
+        class _TimeitScope
+        {
+        public:
+            _TimeitScope(int tag_handle, const char* zone_name) :zone_(zone_name)
+            {
+                this->tag_handle_ = tag_handle;
+                mtime::_getTimeitCounter().addStart(tag_handle);
+            }
+
+            ~_TimeitScope()
+            {
+                mtime::_getTimeitCounter().addEnd(this->tag_handle_);
+            }
+
+            _TimeitScope(const _TimeitScope& _temp) = delete;
+            _TimeitScope(_TimeitScope&& _temp) = delete;
+            _TimeitScope& operator=(const _TimeitScope& _temp) = delete;
+            _TimeitScope& operator=(_TimeitScope&& _temp) = delete;
+
+        private:
+            ProfileZone zone_;
+            int tag_handle_ = -1;
+        };
+
+
+
+        //已废弃
+        class mdeprecated(R"(Deprecated. Please replace with class "MeanTimeCounter"(in time.hpp) )") MultiMeanTimeCounter :public MeanTimeCounter
+        {
+        public:
+            MultiMeanTimeCounter() :MeanTimeCounter() {}
+            explicit MultiMeanTimeCounter(int target_count_times, bool time_counter_on = true) :MeanTimeCounter(target_count_times, time_counter_on) {}
+        };
+
+        //已废弃
+        class mdeprecated(R"(Deprecated. Please replace with class "TimeCounterGuard"(in time.hpp) )") LocalTimeCounter :public TimeCounterGuard
+        {
+        public:
+            LocalTimeCounter(const std::string & codeblock_tag, mtime::Unit time_unit = mtime::Unit::ms, bool time_counter_on = true) :TimeCounterGuard(codeblock_tag, time_unit, time_counter_on) {}
+            LocalTimeCounter(const std::string & print_head, const std::string & codeblock_tag, mtime::Unit time_unit = mtime::Unit::ms, bool time_counter_on = true) :TimeCounterGuard(print_head, codeblock_tag, time_unit, time_counter_on) {}
+        };
+
+        //已废弃
+        class mdeprecated(R"(Deprecated. Please replace with class "TimeControllerGuard"(in time.hpp) )") LocalTimeController :public TimeControllerGuard
+        {
+        public:
+            LocalTimeController(long long target_time, mtime::Unit time_unit = mtime::Unit::ms) :TimeControllerGuard(target_time, time_unit) {}
+        };
+    }
+
+
+#ifdef MINEUTILS_TEST_MODULES
+    namespace _mtimecheck
+    {
+        inline bool _isNear(double value, double expect, double ratio)
+        {
+            return value >= expect * (1 - ratio) && value <= expect * (1 + ratio);
+        }
+
+        inline void TimeCostStatsTest()
+        {
+            {
+                //1~10000ns均匀分布，分位数的相对误差不超过1/32
+                mtime::_TimeCostRecorder recorder;
+                for (int i = 1; i <= 10000; i++)
+                    recorder.record(i);
+                mtime::TimeCostStats stats = recorder.getStats();
+                bool ret = stats.count == 10000 && stats.min_ns == 1 && stats.max_ns == 10000 && _isNear(stats.mean_ns, 5000.5, 1e-9);
+                ret = ret && _isNear(stats.stddev_ns, std::sqrt((10000.0 * 10000.0 - 1) / 12), 1e-6);
+                ret = ret && _isNear(stats.p50_ns, 5000, 1.0 / 32) && _isNear(stats.p90_ns, 9000, 1.0 / 32);
+                ret = ret && _isNear(stats.p99_ns, 9900, 1.0 / 32) && _isNear(stats.p999_ns, 9990, 1.0 / 32);
+                printf("%s TimeCostStats percentile check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //偶发的长耗时在均值中几乎看不出，但会体现在max和p99.9上
+                mtime::_TimeCostRecorder recorder;
+                for (int i = 0; i < 999; i++)
+                    recorder.record(1900000);
+                recorder.record(80000000);
+                mtime::TimeCostStats stats = recorder.getStats();
+                bool ret = stats.max_ns == 80000000 && stats.min_ns == 1900000 && _isNear(stats.p50_ns, 1900000, 1.0 / 32);
+                ret = ret && _isNear(stats.p999_ns, 1900000, 1.0 / 32) && stats.stddev_ns > 2000000;
+                recorder.record(80000000);
+                ret = ret && _isNear(recorder.getStats().p999_ns, 80000000, 1.0 / 32);
+                //超出直方图范围的样本计入溢出桶，最值仍然精确
+                recorder.reset();
+                recorder.record(1LL << 41);
+                recorder.record(-5);
+                stats = recorder.getStats();
+                ret = ret && stats.count == 2 && stats.max_ns == (1LL << 41) && stats.min_ns == 0 && stats.p999_ns == (1LL << 41);
+                //直方图最后一个桶内的样本不与溢出样本混在一起
+                const long long top_ns = (1LL << 40) - (1LL << 34);
+                recorder.reset();
+                for (int i = 0; i < 100; i++)
+                    recorder.record(top_ns);
+                recorder.record(1LL << 45);
+                stats = recorder.getStats();
+                ret = ret && _isNear(stats.p50_ns, top_ns, 1.0 / 32) && _isNear(stats.p99_ns, top_ns, 1.0 / 32) && stats.max_ns == (1LL << 45);
+                printf("%s TimeCostStats outlier check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //分开统计再合并与一次统计结果相同
+                mtime::_TimeCostRecorder all, part_a, part_b, empty;
+                for (int i = 0; i < 3000; i++)
+                {
+                    long long value = (i * 7919LL) % 100000 + 100;
+                    all.record(value);
+                    if (i % 3 == 0)
+                        part_a.record(value);
+                    else part_b.record(value);
+                }
+                empty.mergeFrom(part_a);
+                empty.mergeFrom(part_b);
+                mtime::TimeCostStats expect = all.getStats();
+                mtime::TimeCostStats merged = empty.getStats();
+                bool ret = merged.count == expect.count && merged.min_ns == expect.min_ns && merged.max_ns == expect.max_ns;
+                ret = ret && _isNear(merged.mean_ns, expect.mean_ns, 1e-9) && _isNear(merged.stddev_ns, expect.stddev_ns, 1e-9);
+                ret = ret && merged.p50_ns == expect.p50_ns && merged.p99_ns == expect.p99_ns && merged.p999_ns == expect.p999_ns;
+                printf("%s TimeCostStats merge check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                mtime::MeanTimeCounter time_counter(5);
+                bool ret = time_counter.getStats("sleep 2ms").count == 0;
+                for (int i = 0; i < 5; i++)
+                {
+                    auto guard = time_counter.addGuard("sleep 2ms");
+                    mtime::msleep(2);
+                }
+                mtime::TimeCostStats stats = time_counter.getStats("sleep 2ms");
+                ret = ret && stats.count == 5 && stats.min_ns >= 2000000 && stats.max_ns >= stats.p50_ns && stats.p50_ns >= stats.min_ns;
+                long long mean_us = time_counter.printMeanTimeCost("sleep 2ms", mtime::Unit::us);
+                ret = ret && mean_us == static_cast<long long>(stats.mean_ns) / 1000 && time_counter.getStats("sleep 2ms").count == 0;
+                printf("%s MeanTimeCounter getStats check.\n", ret ? "Passed." : "Failed!");
+            }
+            printf("\n");
+        }
+
+        inline void ConcurrentMeanTimeCounterTest()
+        {
+            {
+                mtime::ConcurrentMeanTimeCounter time_counter;
+                int tag_a = time_counter.registerTag("a");
+                int tag_b = time_counter.registerTag("b");
+                bool ret = tag_a == 0 && tag_b == 1 && time_counter.registerTag("a") == tag_a;
+                for (int i = 2; i < MINE_TIMECOUNTER_MAX_TAGS; i++)
+                    time_counter.registerTag("tag" + std::to_string(i));
+                ret = ret && time_counter.registerTag("overflow") == -1 && time_counter.registerTag("b") == tag_b;
+                //无效句柄的计时和输出被忽略
+                time_counter.addStart(-1);
+                time_counter.addEnd(-1);
+                ret = ret && time_counter.printMeanTimeCost(-1) == -1 && time_counter.printMeanTimeCost(MINE_TIMECOUNTER_MAX_TAGS) == -1;
+                printf("%s ConcurrentMeanTimeCounter::registerTag check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //多个线程同时统计同一代码段，线程退出后打印时合并所有线程的数据
+                const int num_thds = 4;
+                const int num_loops = 20;
+                mtime::ConcurrentMeanTimeCounter time_counter(num_thds * num_loops);
+                int sleep_tag = time_counter.registerTag("sleep 2ms");
+                std::vector<std::thread> thds;
+                for (int i = 0; i < num_thds; i++)
+                {
+                    thds.emplace_back([&time_counter, sleep_tag]()
+                        {
+                            for (int j = 0; j < num_loops; j++)
+                            {
+                                auto guard = time_counter.addGuard(sleep_tag);
+                                mtime::msleep(2);
+                            }
+                        });
+                }
+                bool ret = time_counter.printMeanTimeCost(sleep_tag, mtime::Unit::us) == -1;
+                for (auto& thd : thds)
+                    thd.join();
+                mtime::TimeCostStats stats = time_counter.getStats(sleep_tag);
+                ret = ret && stats.count == num_thds * num_loops && stats.min_ns >= 2000000 && stats.p99_ns <= stats.max_ns;
+                long long mean_us = time_counter.printMeanTimeCost(sleep_tag, mtime::Unit::us);
+                ret = ret && mean_us >= 2000 && mean_us < 20000 && time_counter.getStats(sleep_tag).count == 0;
+                //输出后重新开始统计，本轮次数不足时返回-1
+                time_counter.addStart(sleep_tag);
+                time_counter.addEnd(sleep_tag);
+                ret = ret && time_counter.printMeanTimeCost(sleep_tag, mtime::Unit::us) == -1;
+                printf("%s ConcurrentMeanTimeCounter multi-thread merge check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                mtime::ConcurrentMeanTimeCounter time_counter(1);
+                int tag = time_counter.registerTag("off");
+                mtime::setGlobalTimeCounterOn(false);
+                time_counter.addStart(tag);
+                time_counter.addEnd(tag);
+                mtime::setGlobalTimeCounterOn(true);
+                bool ret = time_counter.printMeanTimeCost(tag) == -1;
+                printf("%s ConcurrentMeanTimeCounter setGlobalTimeCounterOn check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //同一线程交替使用的计数器多于线程缓存容量时，addStart和addEnd仍落在同一统计槽中
+                const int num_counters = 40;
+                std::vector<std::unique_ptr<mtime::ConcurrentMeanTimeCounter>> time_counters;
+                for (int i = 0; i < num_counters; i++)
+                    time_counters.emplace_back(new mtime::ConcurrentMeanTimeCounter(1));
+                for (auto& time_counter : time_counters)
+                    time_counter->addStart(time_counter->registerTag("evict"));
+                for (auto& time_counter : time_counters)
+                    time_counter->addEnd(0);
+                bool ret = true;
+                for (auto& time_counter : time_counters)
+                    ret = ret && time_counter->getStats(0).count == 1;
+                printf("%s ConcurrentMeanTimeCounter thread cache eviction check.\n", ret ? "Passed." : "Failed!");
+            }
+            printf("\n");
+        }
+
+        inline void MeanTimeCounterBenchmark()
+        {
+            //空代码段上一对addStart和addEnd的开销
+            const int num_loops = 1000000;
+            {
+                mtime::MeanTimeCounter time_counter(num_loops);
+                auto start_t = mtime::now();
+                for (int i = 0; i < num_loops; i++)
+                {
+                    time_counter.addStart("empty");
+                    time_counter.addEnd("empty");
+                }
+                printf("Benchmark. MeanTimeCounter addStart/addEnd: %.1fns/pair.\n", mtime::ns(mtime::now() - start_t) * 1.0 / num_loops);
+            }
+            {
+                mtime::ConcurrentMeanTimeCounter time_counter(num_loops);
+                int tag = time_counter.registerTag("empty");
+                auto start_t = mtime::now();
+                for (int i = 0; i < num_loops; i++)
+                {
+                    time_counter.addStart(tag);
+                    time_counter.addEnd(tag);
+                }
+                printf("Benchmark. ConcurrentMeanTimeCounter addStart/addEnd: %.1fns/pair.\n", mtime::ns(mtime::now() - start_t) * 1.0 / num_loops);
+            }
+#ifndef MINE_DISABLE_TIMEIT
+            {
+                auto start_t = mtime::now();
+                for (int i = 0; i < num_loops; i++)
+                {
+                    MINE_TIMEIT_SCOPE("_mtimecheck empty");
+                }
+                printf("Benchmark. MINE_TIMEIT_SCOPE: %.1fns/scope.\n", mtime::ns(mtime::now() - start_t) * 1.0 / num_loops);
+            }
+#endif
+            printf("\n");
+        }
+
+        inline std::string _readFile(const std::string& path)
+        {
+            std::string content;
+            FILE* file = fopen(path.c_str(), "r");
+            if (!file)
+                return content;
+            char buf[4096];
+            size_t n;
+            while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+                content.append(buf, n);
+            fclose(file);
+            return content;
+        }
+
+        inline int _countSubstr(const std::string& str, const std::string& sub)
+        {
+            int count = 0;
+            for (size_t pos = str.find(sub); pos != std::string::npos; pos = str.find(sub, pos + sub.size()))
+                count++;
+            return count;
+        }
+
+        inline void FastClockTest()
+        {
+            {
+                //连续读取不倒退，测得的时间段与steady_clock接近
+                bool ret = true;
+                mtime::TimePoint last_t = mtime::fastNow();
+                for (int i = 0; i < 10000 && ret; i++)
+                {
+                    mtime::TimePoint t = mtime::fastNow();
+                    ret = t >= last_t;
+                    last_t = t;
+                }
+                auto fast_start = mtime::fastNow();
+                auto steady_start = std::chrono::steady_clock::now();
+                mtime::msleep(20);
+                long long fast_ns = mtime::ns(mtime::fastNow() - fast_start);
+                long long steady_ns = mtime::ns(std::chrono::steady_clock::now() - steady_start);
+                ret = ret && fast_ns >= 20000000 * 0.95 && _isNear(fast_ns, steady_ns, 0.02);
+                //与steady_clock的时间基准一致
+                long long offset_ns = mtime::ns(mtime::fastNow() - std::chrono::steady_clock::now());
+                ret = ret && offset_ns > -1000000 && offset_ns < 1000000;
+                //无论是否定义MINE_TIME_USE_FAST_CLOCK，now()都与steady_clock一致，可以作为等待的截止时间
+                auto steady_before = std::chrono::steady_clock::now();
+                mtime::TimePoint now_t = mtime::now();
+                ret = ret && now_t >= steady_before && now_t <= std::chrono::steady_clock::now();
+                printf("%s mtime::fastNow check(cycle counter %s).\n", ret ? "Passed." : "Failed!", mtime::isFastClockAvailable() ? "on" : "off");
+            }
+            printf("\n");
+        }
+
+        inline void ProfilerTest()
+        {
+            const std::string json_path = "_mtimecheck_profile.json";
+            {
+                //未启动时区间不被记录，启动后多个线程中的嵌套区间写入同一文件
+                {
+                    mtime::ProfileZone zone("before start");
+                }
+                bool ret = !mtime::isProfilerRunning() && mtime::startProfiler(json_path, 5);
+                ret = ret && mtime::isProfilerRunning() && !mtime::startProfiler(json_path);
+                const int num_thds = 3;
+                const int num_loops = 50;
+                std::vector<std::thread> thds;
+                for (int i = 0; i < num_thds; i++)
+                {
+                    thds.emplace_back([]()
+                        {
+                            for (int j = 0; j < num_loops; j++)
+                            {
+                                mtime::ProfileZone outer("frame");
+                                mtime::ProfileZone inner("decode \"part\"");
+                            }
+                        });
+                }
+                for (auto& thd : thds)
+                    thd.join();
+                {
+                    mtime::ProfileZone outer("main");
+                    mtime::msleep(1);
+                    mtime::setGlobalTimeCounterOn(false);
+                    mtime::ProfileZone off("global off");
+                    mtime::setGlobalTimeCounterOn(true);
+                }
+                mtime::stopProfiler();
+                {
+                    mtime::ProfileZone zone("after stop");
+                }
+                mtime::stopProfiler();
+                ret = ret && !mtime::isProfilerRunning();
+
+                std::string content = _readFile(json_path);
+                ret = ret && content.find("[") == 0 && content.find("\n]\n") == content.size() - 3;
+                ret = ret && _countSubstr(content, "\"name\":\"frame\"") == num_thds * num_loops;
+                ret = ret && _countSubstr(content, "\"name\":\"decode \\\"part\\\"\"") == num_thds * num_loops;
+                ret = ret && _countSubstr(content, "\"name\":\"main\"") == 1 && _countSubstr(content, "\"ph\":\"M\"") == num_thds + 1;
+                ret = ret && content.find("before start") == std::string::npos && content.find("after stop") == std::string::npos && content.find("global off") == std::string::npos;
+                //区间按结束顺序写出，嵌套的区间先于外层区间
+                ret = ret && content.find("decode") < content.find("\"name\":\"frame\"");
+                printf("%s mtime::startProfiler/ProfileZone check.\n", ret ? "Passed." : "Failed!");
+            }
+
+            {
+                //重新启动时覆盖文件，不含上次运行残留的区间
+                bool ret = mtime::startProfiler(json_path, 1000);
+                {
+                    mtime::ProfileZone zone("second run");
+                }
+                //其他线程持有mtx时，已登记缓冲区的线程结束区间不被阻塞
+                std::atomic<int> step(0);
+                std::thread zone_thd([&step]()
+                    {
+                        {
+                            mtime::ProfileZone zone("second run");
+                        }
+                        step = 1;
+                        while (step != 2)
+                            std::this_thread::yield();
+                        {
+                            mtime::ProfileZone zone("second run");
+                        }
+                        step = 3;
+                    });
+                while (step != 1)
+                    std::this_thread::yield();
+                bool zone_ended = false;
+                {
+                    std::lock_guard<std::mutex> lk(mtime::_getProfilerState().mtx);
+                    step = 2;
+                    for (int i = 0; i < 1000 && step != 3; i++)
+                        mtime::msleep(1);
+                    zone_ended = step == 3;
+                }
+                zone_thd.join();
+                mtime::stopProfiler();
+                std::string content = _readFile(json_path);
+                ret = ret && _countSubstr(content, "\"ph\":\"X\"") == 3 && _countSubstr(content, "second run") == 3;
+                printf("%s mtime::startProfiler restart check.\n", ret ? "Passed." : "Failed!");
+                printf("%s mtime::ProfileZone not blocked by profiler lock check.\n", zone_ended ? "Passed." : "Failed!");
+            }
+            remove(json_path.c_str());
+            printf("\n");
+        }
+
+        inline void TimeitMacroTest()
+        {
+            const std::string json_path = "_mtimecheck_profile.json";
+            bool ret = mtime::startProfiler(json_path, 1000);
+            for (int i = 0; i < 3; i++)
+            {
+                MINE_TIMEIT_SCOPE("_mtimecheck timeit");
+                mtime::usleep(100);
+            }
+            mtime::stopProfiler();
+            int tag_handle = mtime::_getTimeitCounter().registerTag("_mtimecheck timeit");
+            mtime::TimeCostStats stats = mtime::_getTimeitCounter().getStats(tag_handle);
+#ifdef MINE_DISABLE_TIMEIT
+            //宏展开为空，tag未被注册，计数器和性能分析器都没有记录
+            ret = ret && tag_handle >= 0 && stats.count == 0;
+            ret = ret && _countSubstr(_readFile(json_path), "\"name\":\"_mtimecheck timeit\"") == 0;
+#else
+            //同一tag只注册一次，计数器和性能分析器都记录了3次
+            ret = ret && tag_handle >= 0 && stats.count == 3 && stats.min_ns >= 100000;
+            ret = ret && _countSubstr(_readFile(json_path), "\"name\":\"_mtimecheck timeit\"") == 3;
+#endif
+            remove(json_path.c_str());
+            printf("%s MINE_TIMEIT_SCOPE check.\n", ret ? "Passed." : "Failed!");
+            printf("\n");
+        }
+
+        inline void FastClockBenchmark()
+        {
+            const int num_loops = 1000000;
+            {
+                auto start_t = std::chrono::steady_clock::now();
+                for (int i = 0; i < num_loops; i++)
+                    std::chrono::steady_clock::now();
+                printf("Benchmark. std::chrono::steady_clock::now: %.1fns/call.\n", mtime::ns(std::chrono::steady_clock::now() - start_t) * 1.0 / num_loops);
+            }
+            {
+                mtime::fastNow();
+                auto start_t = std::chrono::steady_clock::now();
+                for (int i = 0; i < num_loops; i++)
+                    mtime::fastNow();
+                printf("Benchmark. mtime::fastNow(cycle counter %s): %.1fns/call.\n", mtime::isFastClockAvailable() ? "on" : "off", mtime::ns(std::chrono::steady_clock::now() - start_t) * 1.0 / num_loops);
+            }
+            printf("\n");
+        }
+
+        inline void ProfilerBenchmark()
+        {
+            //性能分析未启动和启动时一个空区间的开销
+            const int num_loops = 1000000;
+            {
+                auto start_t = mtime::now();
+                for (int i = 0; i < num_loops; i++)
+                {
+                    mtime::ProfileZone zone("empty");
+                }
+                printf("Benchmark. ProfileZone when profiler is stopped: %.1fns/zone.\n", mtime::ns(mtime::now() - start_t) * 1.0 / num_loops);
+            }
+            {
+                const std::string json_path = "_mtimecheck_profile.json";
+                mtime::startProfiler(json_path, 1);
+                const int num_zones = MINE_PROFILER_RING_SIZE / 2;   //不超过环形缓冲区大小，避免测到丢弃的路径
+                auto start_t = mtime::now();
+                for (int i = 0; i < num_zones; i++)
+                {
+                    mtime::ProfileZone zone("empty");
+                }
+                printf("Benchmark. ProfileZone when profiler is running: %.1fns/zone.\n", mtime::ns(mtime::now() - start_t) * 1.0 / num_zones);
+                mtime::stopProfiler();
+                remove(json_path.c_str());
+            }
+            printf("\n");
+        }
+
+        inline void check()
+        {
+            printf("\n--------------------check mtime start--------------------\n\n");
+            FastClockTest();
+            TimeCostStatsTest();
+            ConcurrentMeanTimeCounterTest();
+            ProfilerTest();
+            TimeitMacroTest();
+            printf("--------------------check mtime end--------------------\n\n");
+        }
+
+        inline void benchmark()
+        {
+            printf("\n--------------------benchmark mtime start--------------------\n\n");
+            FastClockBenchmark();
+            MeanTimeCounterBenchmark();
+            ProfilerBenchmark();
+            printf("--------------------benchmark mtime end--------------------\n\n");
+        }
     }
+#endif
 }
 
 #endif // !TIME_HPP_MINEUTILS
\ No newline at end of file